@@ -1,5 +1,6 @@
 #include "Camera.h"
 #include "../GUI/GUI.h"
+#include "../Culling/FrustumCulling.h"
 
 namespace vm
 {
@@ -168,50 +169,7 @@ namespace vm
 
 	void Camera::ExtractFrustum()
 	{
-		// transpose just to make the calculations look simpler
-		mat4 pvm = transpose(projection * view);
-
-		/* Extract the numbers for the RIGHT plane */
-		vec4 temp = pvm[3] - pvm[0];
-		temp /= length(vec3(temp));
-
-		frustum[0].normal = vec3(temp);
-		frustum[0].d = temp.w;
-
-		/* Extract the numbers for the LEFT plane */
-		temp = pvm[3] + pvm[0];
-		temp /= length(vec3(temp));
-
-		frustum[1].normal = vec3(temp);
-		frustum[1].d = temp.w;
-
-		/* Extract the BOTTOM plane */
-		temp = pvm[3] - pvm[1];
-		temp /= length(vec3(temp));
-
-		frustum[2].normal = vec3(temp);
-		frustum[2].d = temp.w;
-
-		/* Extract the TOP plane */
-		temp = pvm[3] + pvm[1];
-		temp /= length(vec3(temp));
-
-		frustum[3].normal = vec3(temp);
-		frustum[3].d = temp.w;
-
-		/* Extract the FAR plane */
-		temp = pvm[3] - pvm[2];
-		temp /= length(vec3(temp));
-
-		frustum[4].normal = vec3(temp);
-		frustum[4].d = temp.w;
-
-		/* Extract the NEAR plane */
-		temp = pvm[3] + pvm[2];
-		temp /= length(vec3(temp));
-
-		frustum[5].normal = vec3(temp);
-		frustum[5].d = temp.w;
+		FrustumCulling::ExtractPlanes(projection * view, frustum.data());
 	}
 
 	// center x,y,z - radius w 
@@ -222,9 +180,6 @@ namespace vm
 
 			if (dist < -boundingSphere.w)
 				return false;
-
-			if (fabs(dist) < boundingSphere.w)
-				return true;
 		}
 		return true;
 	}
@@ -1,5 +1,6 @@
 #include "Console.h"
 #include "../Core/Queue.h"  // for Queue, Queue::loadModel
+#include "../MemoryHash/MemoryHash.h"
 
 namespace vm
 {
@@ -14,6 +15,7 @@ namespace vm
 		Commands.push_back("HISTORY");
 		Commands.push_back("CLEAR");
 		Commands.push_back("CLOSE");
+		Commands.push_back("HASH BENCHMARK");
 		AddLog("Welcome to Dear ImGui!");
 	}
 
@@ -183,6 +185,14 @@ namespace vm
 		{
 			close_app = true;
 		}
+		else if (Stricmp(command_line, "HASH BENCHMARK") == 0)
+		{
+			AddLog("MemoryHash throughput (legacy / scalar / avx2):");
+			for (size_t size : { 64, 256, 4096, 65536, 1048576 }) {
+				const auto result = MemoryHash::Benchmark(size);
+				AddLog("%8zu bytes: %.2f / %.2f / %.2f GB/s", result.size, result.legacy, result.scalar, result.avx2);
+			}
+		}
 		//else if (Stricmp(command_line, "LOAD MODEL SPONZA") == 0)
 		//{
 		//	Queue::loadModel.push_back({ "objects/sponza/", "sponza.obj" });
@@ -1,13 +1,16 @@
 #include "vulkanPCH.h"
 #include "Buffer.h"
 #include "../VulkanContext/VulkanContext.h"
+#include "UniformRing.h"
+#include "../MemoryHash/MemoryHash.h"
+#include <algorithm>
 
 namespace vm
 {
 	Buffer::Buffer()
 	{
 		buffer = make_ref(vk::Buffer());
-		memory = make_ref(vk::DeviceMemory());
+		allocation = make_ref(MemoryAllocation());
 		size = 0;
 	}
 
@@ -16,6 +19,7 @@ namespace vm
 		auto vulkan = VulkanContext::get();
 		this->size = size;
 		data = nullptr;
+		uploadHashes.clear();
 
 		vk::BufferCreateInfo bufferInfo;
 		bufferInfo.size = size;
@@ -37,28 +41,45 @@ namespace vm
 
 		if (this->size < memRequirements.size)
 			this->size = memRequirements.size;
-		//allocate memory of buffer
-		vk::MemoryAllocateInfo allocInfo;
-		allocInfo.allocationSize = this->size;
-		allocInfo.memoryTypeIndex = memTypeIndex;
-		memory = make_ref(vulkan->device->allocateMemory(allocInfo));
+		// a buffer that is only a copy source is a staging buffer, it lives until its upload is done
+		const AllocationKind kind = usage == vk::BufferUsageFlags(vk::BufferUsageFlagBits::eTransferSrc) ? AllocationKind::Staging : AllocationKind::Buffer;
+		*allocation = MemoryAllocator::get()->allocate(memTypeIndex, memRequirements, kind);
 
 		//binding memory with buffer
-		vulkan->device->bindBufferMemory(*buffer, *memory, 0);
+		vulkan->device->bindBufferMemory(*buffer, *allocation->memory, allocation->offset);
+	}
+
+	void Buffer::createRingBuffer(size_t size)
+	{
+		this->size = size;
+		data = nullptr;
+		ringBacked = true;
+		ringOffset = UniformRing::get()->allocate(size);
+		buffer = UniformRing::get()->getBuffer();
+		uploadHashes.clear();
 	}
 
 	void Buffer::map(size_t offset)
 	{
 		if (data)
 			throw std::runtime_error("Map called when buffer data is not null");
-		data = VulkanContext::get()->device->mapMemory(*memory, offset, size - offset, vk::MemoryMapFlags());
+		// written directly, the hashes of the uploads say nothing about the contents anymore
+		uploadHashes.clear();
+		// the ring is always mapped, a ring buffer is written in the cpu copy of its slice
+		if (ringBacked) {
+			data = static_cast<char*>(UniformRing::get()->mirror(ringOffset)) + offset;
+			return;
+		}
+		// host visible memory is persistently mapped by the allocator
+		if (!allocation->mapped)
+			throw std::runtime_error("Map called on buffer memory that is not host visible");
+		data = static_cast<char*>(allocation->mapped) + offset;
 	}
 
 	void Buffer::unmap()
 	{
 		if (!data)
 			throw std::runtime_error("Buffer is not mapped");
-		VulkanContext::get()->device->unmapMemory(*memory);
 		data = nullptr;
 	}
 
@@ -76,7 +97,7 @@ namespace vm
 		memcpy((char*)data + offset, srcData, srcSize > 0 ? srcSize : size);
 	}
 
-	void Buffer::copyBuffer(const vk::Buffer srcBuffer, const size_t size) const
+	void Buffer::copyBuffer(const vk::Buffer srcBuffer, const size_t size, const size_t dstOffset) const
 	{
 		vk::CommandBufferAllocateInfo cbai;
 		cbai.level = vk::CommandBufferLevel::ePrimary;
@@ -90,6 +111,7 @@ namespace vm
 
 		vk::BufferCopy bufferCopy{};
 		bufferCopy.size = size;
+		bufferCopy.dstOffset = dstOffset;
 
 		copyCmd.copyBuffer(srcBuffer, *buffer, bufferCopy);
 
@@ -104,21 +126,49 @@ namespace vm
 	{
 		if (!data)
 			throw std::runtime_error("Buffer is not mapped");
+		if (ringBacked) {
+			UniformRing::get()->markDirty(ringOffset, size > 0 ? size : this->size);
+			return;
+		}
 
 		vk::MappedMemoryRange range;
-		range.memory = *memory;
-		range.size = size > 0 ? size : this->size;
+		range.memory = *allocation->memory;
+		range.offset = allocation->offset;
+		range.size = MemoryAllocator::get()->flushSize(*allocation, size > 0 ? size : this->size);
 
 		VulkanContext::get()->device->flushMappedMemoryRanges(range);
 	}
 
+	bool Buffer::uploadChanged(const void* srcData, size_t srcSize, size_t offset)
+	{
+		const size_t hash = MemoryHash(srcData, srcSize).getHash();
+
+		for (auto& uploaded : uploadHashes)
+			if (uploaded.offset == offset && uploaded.size == srcSize && uploaded.hash == hash)
+				return false;
+
+		// the ranges this one overlaps are (partly) overwritten, their hashes are stale
+		uploadHashes.erase(std::remove_if(uploadHashes.begin(), uploadHashes.end(), [offset, srcSize](const UploadHash& uploaded) {
+			return uploaded.offset < offset + srcSize && offset < uploaded.offset + uploaded.size;
+		}), uploadHashes.end());
+		uploadHashes.push_back({ offset, srcSize, hash });
+		return true;
+	}
+
 	void Buffer::destroy()
 	{
+		uploadHashes.clear();
+		// the ring buffer is shared, only the slice is given back
+		if (ringBacked) {
+			UniformRing::get()->release(ringOffset, size);
+			ringBacked = false;
+			ringOffset = 0;
+			buffer = make_ref(vk::Buffer());
+			return;
+		}
 		if (*buffer)
 			VulkanContext::get()->device->destroyBuffer(*buffer);
-		if (*memory)
-			VulkanContext::get()->device->freeMemory(*memory);
+		MemoryAllocator::get()->free(*allocation);
 		*buffer = nullptr;
-		*memory = nullptr;
 	}
 }
@@ -1,10 +1,10 @@
 #pragma once
 #include "Base.h"
+#include "MemoryAllocator.h"
 
 namespace vk
 {
 	class Buffer;
-	class DeviceMemory;
 
 	template<class T1, class T2> class Flags;
 	enum class BufferUsageFlagBits;
@@ -20,17 +20,26 @@ namespace vm
 	public:
 		Buffer();
 		Ref<vk::Buffer> buffer;
-		Ref<vk::DeviceMemory> memory;
+		Ref<MemoryAllocation> allocation;
 		size_t size;
 		void *data = nullptr;
+		// a slice of the uniform ring, the buffer is the ring buffer and its descriptors are dynamic
+		bool ringBacked = false;
+		size_t ringOffset = 0;
+		// hashes of the ranges last requested for upload, written only by the thread that updates the buffer
+		struct UploadHash { size_t offset, size, hash; };
+		std::vector<UploadHash> uploadHashes{};
 
 		void createBuffer(size_t size, const vk::BufferUsageFlags& usage, const vk::MemoryPropertyFlags& properties);
+		void createRingBuffer(size_t size);
 		void map(size_t offset = 0);
 		void unmap();
 		void zero();
 		void copyData(const void* srcData, size_t srcSize = 0, size_t offset = 0);
-		void copyBuffer(vk::Buffer srcBuffer, size_t size) const;
+		void copyBuffer(vk::Buffer srcBuffer, size_t size, size_t dstOffset = 0) const;
 		void flush(size_t size = 0);
+		// Returns false when the data is the same as the last upload of the range, so it can be skipped
+		bool uploadChanged(const void* srcData, size_t srcSize, size_t offset);
 		void destroy();
 	};
 }
\ No newline at end of file
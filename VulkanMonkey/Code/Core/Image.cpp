@@ -8,6 +8,7 @@ namespace vm
 {
 	Image::Image()
 	{
+		allocation = make_ref(MemoryAllocation());
 		samples = make_ref(vk::SampleCountFlagBits::e1);
 		layoutState = LayoutState::ColorWrite;
 		format = make_ref(vk::Format::eUndefined);
@@ -134,12 +135,8 @@ namespace vm
 		if (memTypeIndex == UINT32_MAX)
 			throw std::runtime_error("createImage(): no suitable memory type");
 
-		vk::MemoryAllocateInfo allocInfo;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = memTypeIndex;
-
-		memory = make_ref(vCtx->device->allocateMemory(allocInfo));
-		vCtx->device->bindImageMemory(*image, *memory, 0);
+		*allocation = MemoryAllocator::get()->allocate(memTypeIndex, memRequirements, AllocationKind::Image);
+		vCtx->device->bindImageMemory(*image, *allocation->memory, allocation->offset);
 
 		vCtx->SetDebugObjectName(*image, "");
 	}
@@ -236,6 +233,12 @@ namespace vm
 			srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
 			dstStage = vk::PipelineStageFlagBits::eFragmentShader;
 		}
+		else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eGeneral) {
+			barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+
+			srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
+			dstStage = vk::PipelineStageFlagBits::eComputeShader;
+		}
 		else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::ePresentSrcKHR) {
 			srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
 			dstStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
@@ -348,62 +351,24 @@ namespace vm
 		vCtx->device->freeCommandBuffers(*vCtx->commandPool2, commandBuffer);
 	}
 
-	void Image::copyColorAttachment(const vk::CommandBuffer& cmd, Image& renderedImage) const
+	void Image::copyImage(const vk::CommandBuffer& cmd, const Image& source) const
 	{
-		transitionImageLayout(
-			cmd,
-			vk::ImageLayout::eShaderReadOnlyOptimal,
-			vk::ImageLayout::eTransferDstOptimal,
-			vk::PipelineStageFlagBits::eFragmentShader,
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::AccessFlagBits::eShaderRead,
-			vk::AccessFlagBits::eTransferWrite,
-			vk::ImageAspectFlagBits::eColor);
-		renderedImage.transitionImageLayout(
-			cmd,
-			vk::ImageLayout::eColorAttachmentOptimal,
-			vk::ImageLayout::eTransferSrcOptimal,
-			vk::PipelineStageFlagBits::eColorAttachmentOutput,
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::AccessFlagBits::eColorAttachmentWrite,
-			vk::AccessFlagBits::eTransferRead,
-			vk::ImageAspectFlagBits::eColor);
-
-		// copy the image
+		// the layouts are the render graph's, the source is a transfer source and this image a transfer destination
 		vk::ImageCopy region;
 		region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
 		region.srcSubresource.layerCount = 1;
 		region.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
 		region.dstSubresource.layerCount = 1;
-		region.extent.width = renderedImage.width;
-		region.extent.height = renderedImage.height;
+		region.extent.width = source.width;
+		region.extent.height = source.height;
 		region.extent.depth = 1;
 
 		cmd.copyImage(
-			*renderedImage.image,
+			*source.image,
 			vk::ImageLayout::eTransferSrcOptimal,
 			*image,
 			vk::ImageLayout::eTransferDstOptimal,
 			region);
-
-		transitionImageLayout(
-			cmd,
-			vk::ImageLayout::eTransferDstOptimal,
-			vk::ImageLayout::eShaderReadOnlyOptimal,
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::PipelineStageFlagBits::eFragmentShader,
-			vk::AccessFlagBits::eTransferWrite,
-			vk::AccessFlagBits::eShaderRead,
-			vk::ImageAspectFlagBits::eColor);
-		renderedImage.transitionImageLayout(
-			cmd,
-			vk::ImageLayout::eTransferSrcOptimal,
-			vk::ImageLayout::eColorAttachmentOptimal,
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::PipelineStageFlagBits::eColorAttachmentOutput,
-			vk::AccessFlagBits::eTransferRead,
-			vk::AccessFlagBits::eColorAttachmentWrite,
-			vk::ImageAspectFlagBits::eColor);
 	}
 
 	void Image::generateMipMaps() const
@@ -564,11 +529,10 @@ namespace vm
 
 		if (*view) vCtx->device->destroyImageView(*view);
 		if (*image) vCtx->device->destroyImage(*image);
-		if (*memory) vCtx->device->freeMemory(*memory);
+		MemoryAllocator::get()->free(*allocation);
 		if (*sampler) vCtx->device->destroySampler(*sampler);
 		*view = nullptr;
 		*image = nullptr;
-		*memory = nullptr;
 		*sampler = nullptr;
 	}
 }
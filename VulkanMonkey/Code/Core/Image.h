@@ -1,10 +1,10 @@
 #pragma once
 #include "Base.h"
+#include "MemoryAllocator.h"
 
 namespace vk
 {
 	class Image;
-	class DeviceMemory;
 	class ImageView;
 	class Sampler;
 	struct Extent2D;
@@ -45,7 +45,9 @@ namespace vm
 		ColorRead,
 		ColorWrite,
 		DepthRead,
-		DepthWrite
+		DepthWrite,
+		TransferRead,
+		TransferWrite
 	};
 
 	class Context;
@@ -56,7 +58,7 @@ namespace vm
 		Image();
 		~Image();
 		Ref<vk::Image> image;
-		Ref<vk::DeviceMemory> memory;
+		Ref<MemoryAllocation> allocation;
 		Ref<vk::ImageView> view;
 		Ref<vk::Sampler> sampler;
 		uint32_t width;
@@ -99,7 +101,7 @@ namespace vm
 		void transitionImageLayout(vk::ImageLayout oldLayout, vk::ImageLayout newLayout) const;
 		void changeLayout(const vk::CommandBuffer& cmd, LayoutState state);
 		void copyBufferToImage(vk::Buffer buffer, uint32_t baseLayer = 0) const;
-		void copyColorAttachment(const vk::CommandBuffer& cmd, Image& renderedImage) const;
+		void copyImage(const vk::CommandBuffer& cmd, const Image& source) const;
 		void generateMipMaps() const;
 		void createSampler();
 		void destroy();
@@ -0,0 +1,212 @@
+#include "JobSystem.h"
+#include <chrono>
+#include <algorithm>
+
+namespace vm
+{
+	// index of the worker owning the current thread, threads outside the pool have none
+	static thread_local uint32_t workerIndex = UINT32_MAX;
+
+	void JobSystem::Init(uint32_t threads)
+	{
+		if (running)
+			return;
+
+		if (threads == 0)
+			threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+		queues.resize(threads);
+		for (auto& queue : queues)
+			queue = std::make_shared<WorkQueue>();
+
+		running = true;
+		workers.reserve(threads);
+		for (uint32_t i = 0; i < threads; i++)
+			workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+
+	void JobSystem::destroy()
+	{
+		if (!running)
+			return;
+
+		{
+			std::lock_guard<std::mutex> guard(sleepMutex);
+			running = false;
+		}
+		wake.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+		workers.clear();
+		queues.clear();
+	}
+
+	Job JobSystem::Execute(std::function<void()> func, const std::vector<Job>& dependencies)
+	{
+		Job counter = std::make_shared<JobCounter>();
+		counter->pending = 1;
+
+		auto task = std::make_shared<JobTask>();
+		task->func = std::move(func);
+		task->counter = counter;
+		Submit(task, dependencies);
+
+		return counter;
+	}
+
+	Job JobSystem::parallel_for(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t)>& func, const std::vector<Job>& dependencies)
+	{
+		Job counter = std::make_shared<JobCounter>();
+		if (count == 0)
+			return counter;
+
+		batchSize = std::max(batchSize, 1u);
+		const uint32_t batches = (count + batchSize - 1) / batchSize;
+		counter->pending = batches;
+
+		// the batches outlive the caller's std::function when the caller does not wait right away
+		auto shared = std::make_shared<std::function<void(uint32_t)>>(func);
+
+		for (uint32_t b = 0; b < batches; b++) {
+			const uint32_t first = b * batchSize;
+			const uint32_t last = std::min(first + batchSize, count);
+
+			auto task = std::make_shared<JobTask>();
+			task->func = [shared, first, last]() { for (uint32_t i = first; i < last; i++) (*shared)(i); };
+			task->counter = counter;
+			Submit(task, dependencies);
+		}
+
+		return counter;
+	}
+
+	void JobSystem::Wait(const Job& job)
+	{
+		if (!job)
+			return;
+
+		while (job->pending > 0) {
+			if (!RunOne())
+				std::this_thread::yield();
+		}
+	}
+
+	void JobSystem::Wait(const std::vector<Job>& jobs)
+	{
+		for (auto& job : jobs)
+			Wait(job);
+	}
+
+	void JobSystem::Submit(const Ref<JobTask>& task, const std::vector<Job>& dependencies)
+	{
+		// the extra count keeps the task from being scheduled while the dependencies are still being registered
+		task->dependencies = static_cast<uint32_t>(dependencies.size()) + 1;
+		for (auto& dependency : dependencies) {
+			if (!dependency) {
+				task->dependencies--;
+				continue;
+			}
+			std::lock_guard<std::mutex> guard(dependency->mutex);
+			if (dependency->pending > 0)
+				dependency->continuations.push_back(task);
+			else
+				task->dependencies--;
+		}
+		if (--task->dependencies == 0)
+			Schedule(task);
+	}
+
+	void JobSystem::Schedule(const Ref<JobTask>& task)
+	{
+		// no workers, run in place
+		if (queues.empty()) {
+			task->func();
+			Finish(task->counter);
+			return;
+		}
+
+		const uint32_t index = workerIndex != UINT32_MAX ? workerIndex : nextQueue++ % static_cast<uint32_t>(queues.size());
+		{
+			std::lock_guard<std::mutex> guard(queues[index]->mutex);
+			queues[index]->tasks.push_back(task);
+		}
+		queued++;
+		wake.notify_one();
+	}
+
+	void JobSystem::Finish(const Job& counter)
+	{
+		if (--counter->pending > 0)
+			return;
+
+		std::vector<Ref<JobTask>> continuations;
+		{
+			std::lock_guard<std::mutex> guard(counter->mutex);
+			continuations.swap(counter->continuations);
+		}
+		for (auto& continuation : continuations) {
+			if (--continuation->dependencies == 0)
+				Schedule(continuation);
+		}
+	}
+
+	bool JobSystem::RunOne()
+	{
+		if (queues.empty())
+			return false;
+
+		Ref<JobTask> task = workerIndex != UINT32_MAX ? Pop(workerIndex) : nullptr;
+		if (!task)
+			task = Steal(workerIndex != UINT32_MAX ? workerIndex : 0);
+		if (!task)
+			return false;
+
+		queued--;
+		const auto start = std::chrono::high_resolution_clock::now();
+		task->func();
+		const auto end = std::chrono::high_resolution_clock::now();
+		taskTimeNanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+		taskCount++;
+
+		Finish(task->counter);
+		return true;
+	}
+
+	Ref<JobTask> JobSystem::Pop(uint32_t index)
+	{
+		auto& queue = *queues[index];
+		std::lock_guard<std::mutex> guard(queue.mutex);
+		if (queue.tasks.empty())
+			return nullptr;
+		Ref<JobTask> task = queue.tasks.back();
+		queue.tasks.pop_back();
+		return task;
+	}
+
+	Ref<JobTask> JobSystem::Steal(uint32_t index)
+	{
+		const uint32_t size = static_cast<uint32_t>(queues.size());
+		for (uint32_t i = 0; i < size; i++) {
+			auto& queue = *queues[(index + i) % size];
+			std::lock_guard<std::mutex> guard(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+			Ref<JobTask> task = queue.tasks.front();
+			queue.tasks.pop_front();
+			return task;
+		}
+		return nullptr;
+	}
+
+	void JobSystem::WorkerLoop(uint32_t index)
+	{
+		workerIndex = index;
+		while (running) {
+			if (RunOne())
+				continue;
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait_for(lock, std::chrono::milliseconds(1), [this]() { return !running || queued > 0; });
+		}
+	}
+}
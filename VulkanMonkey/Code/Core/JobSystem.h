@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include "Base.h"
+
+namespace vm
+{
+	struct JobCounter;
+	struct JobTask;
+
+	// Handle to one job or to a parallel_for batch set, used for Wait() and as a dependency of other jobs
+	using Job = Ref<JobCounter>;
+
+	struct JobCounter
+	{
+		std::atomic<uint32_t> pending{ 0 };
+		std::mutex mutex;
+		std::vector<Ref<JobTask>> continuations{};	// tasks that can not start until pending reaches zero
+	};
+
+	struct JobTask
+	{
+		std::function<void()> func;
+		Job counter;
+		std::atomic<uint32_t> dependencies{ 0 };
+	};
+
+	// Fixed size work stealing thread pool, every worker owns a deque, pops its own work LIFO and steals FIFO from the others
+	class JobSystem
+	{
+	public:
+		void Init(uint32_t threads = 0);	// 0: hardware concurrency - 1, the calling thread helps inside Wait()
+		void destroy();
+
+		Job Execute(std::function<void()> func, const std::vector<Job>& dependencies = {});
+		// Splits [0, count) in batches of batchSize, func(i) is called once for every index
+		Job parallel_for(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t)>& func, const std::vector<Job>& dependencies = {});
+		// Runs queued jobs while waiting, so it is safe to call from inside a job
+		void Wait(const Job& job);
+		void Wait(const std::vector<Job>& jobs);
+
+		// Per frame statistics, read and reset once per frame
+		uint32_t getTaskCount() const { return taskCount.load(); }
+		double getTaskTime() const { return static_cast<double>(taskTimeNanoseconds.load()) * 1e-6; }
+		void resetStats() { taskCount = 0; taskTimeNanoseconds = 0; }
+
+		uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+	private:
+		struct WorkQueue
+		{
+			std::mutex mutex;
+			std::deque<Ref<JobTask>> tasks;
+		};
+
+		std::vector<std::thread> workers{};
+		std::vector<Ref<WorkQueue>> queues{};
+		std::atomic<bool> running{ false };
+		std::atomic<int32_t> queued{ 0 };
+		std::atomic<uint32_t> nextQueue{ 0 };
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+
+		std::atomic<uint32_t> taskCount{ 0 };
+		std::atomic<uint64_t> taskTimeNanoseconds{ 0 };
+
+		void Submit(const Ref<JobTask>& task, const std::vector<Job>& dependencies);
+		void Schedule(const Ref<JobTask>& task);
+		void Finish(const Job& counter);
+		bool RunOne();
+		Ref<JobTask> Pop(uint32_t index);
+		Ref<JobTask> Steal(uint32_t index);
+		void WorkerLoop(uint32_t index);
+
+	public:
+		static auto get() noexcept { static auto js = new JobSystem(); return js; }
+		static auto remove() noexcept { using type = decltype(get()); if (std::is_pointer<type>::value) delete get(); }
+
+		JobSystem(JobSystem const&) = delete;				// copy constructor
+		JobSystem(JobSystem&&) noexcept = delete;			// move constructor
+		JobSystem& operator=(JobSystem const&) = delete;	// copy assignment
+		JobSystem& operator=(JobSystem&&) = delete;			// move assignment
+	private:
+		JobSystem() = default;								// default constructor
+		~JobSystem() = default;								// destructor
+	};
+}
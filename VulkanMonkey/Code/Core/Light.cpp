@@ -22,7 +22,7 @@ namespace vm
 	{
 		getDescriptorSetLayout();
 
-		uniform.createBuffer(sizeof(LightsUBO), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		uniform.createRingBuffer(sizeof(LightsUBO));
 		uniform.map();
 		uniform.copyData(&lubo);
 		uniform.flush();
@@ -36,7 +36,7 @@ namespace vm
 
 		vk::DescriptorBufferInfo dbi;
 		dbi.buffer = *uniform.buffer;
-		dbi.offset = 0;
+		dbi.offset = uniform.ringOffset;
 		dbi.range = uniform.size;
 
 		vk::WriteDescriptorSet writeSet;
@@ -44,7 +44,7 @@ namespace vm
 		writeSet.dstBinding = 0;
 		writeSet.dstArrayElement = 0;
 		writeSet.descriptorCount = 1;
-		writeSet.descriptorType = vk::DescriptorType::eUniformBuffer;
+		writeSet.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 		writeSet.pBufferInfo = &dbi;
 		VulkanContext::get()->device->updateDescriptorSets(writeSet, nullptr);
 	}
@@ -104,7 +104,7 @@ namespace vm
 			vk::DescriptorSetLayoutBinding descriptorSetLayoutBinding;
 			descriptorSetLayoutBinding.binding = 0;
 			descriptorSetLayoutBinding.descriptorCount = 1;
-			descriptorSetLayoutBinding.descriptorType = vk::DescriptorType::eUniformBuffer;
+			descriptorSetLayoutBinding.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 			descriptorSetLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eFragment;
 
 			vk::DescriptorSetLayoutCreateInfo createInfo;
@@ -0,0 +1,479 @@
+#include "vulkanPCH.h"
+#include "MemoryAllocator.h"
+#include "../VulkanContext/VulkanContext.h"
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace vm
+{
+	namespace
+	{
+		constexpr size_t BLOCK_SIZE = 64 * 1024 * 1024;
+		constexpr size_t STAGING_BLOCK_SIZE = 32 * 1024 * 1024;
+		constexpr size_t GRANULARITY = 256;	// offsets and sizes of sub-allocations are multiples of it
+		constexpr uint32_t SL_BITS = 4;
+		constexpr uint32_t SL_COUNT = 1 << SL_BITS;
+		constexpr uint32_t FL_COUNT = 64;
+		constexpr uint32_t NONE = UINT32_MAX;
+
+		inline uint32_t Msb(uint64_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanReverse64(&index, value);
+			return static_cast<uint32_t>(index);
+#else
+			return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+		}
+
+		inline uint32_t Lsb(uint64_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward64(&index, value);
+			return static_cast<uint32_t>(index);
+#else
+			return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+		}
+
+		inline size_t AlignUp(size_t value, size_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		// Free ranges of a block are listed by size class, a power of two split in 16 linear steps. The bitmaps give a
+		// class big enough for a request in constant time, and a freed range is merged with its free neighbours.
+		class TLSF
+		{
+		public:
+			void Init(size_t size)
+			{
+				nodes.clear();
+				unusedNodes.clear();
+				flBitmap = 0;
+				std::fill(std::begin(slBitmap), std::end(slBitmap), 0u);
+				for (auto& fl : heads)
+					std::fill(std::begin(fl), std::end(fl), NONE);
+				used = 0;
+
+				const uint32_t node = newNode();
+				nodes[node].offset = 0;
+				nodes[node].size = size;
+				insertFree(node);
+			}
+
+			bool allocate(size_t size, size_t alignment, size_t& offset, uint32_t& node)
+			{
+				// room for the front padding that brings a granularity aligned offset to the alignment
+				const size_t request = alignment > GRANULARITY ? size + alignment - GRANULARITY : size;
+				node = findFree(request);
+				if (node == NONE)
+					return false;
+				removeFree(node);
+
+				const size_t aligned = AlignUp(nodes[node].offset, alignment);
+				if (aligned > nodes[node].offset) {
+					const uint32_t padding = newNode();
+					nodes[padding].offset = nodes[node].offset;
+					nodes[padding].size = aligned - nodes[node].offset;
+					nodes[padding].prevPhys = nodes[node].prevPhys;
+					nodes[padding].nextPhys = node;
+					if (nodes[padding].prevPhys != NONE)
+						nodes[nodes[padding].prevPhys].nextPhys = padding;
+					nodes[node].prevPhys = padding;
+					nodes[node].offset = aligned;
+					nodes[node].size -= nodes[padding].size;
+					insertFree(padding);
+				}
+				if (nodes[node].size > size) {
+					const uint32_t rest = newNode();
+					nodes[rest].offset = nodes[node].offset + size;
+					nodes[rest].size = nodes[node].size - size;
+					nodes[rest].prevPhys = node;
+					nodes[rest].nextPhys = nodes[node].nextPhys;
+					if (nodes[rest].nextPhys != NONE)
+						nodes[nodes[rest].nextPhys].prevPhys = rest;
+					nodes[node].nextPhys = rest;
+					nodes[node].size = size;
+					insertFree(rest);
+				}
+
+				nodes[node].free = false;
+				used += nodes[node].size;
+				offset = nodes[node].offset;
+				return true;
+			}
+
+			void free(uint32_t node)
+			{
+				used -= nodes[node].size;
+
+				const uint32_t prev = nodes[node].prevPhys;
+				if (prev != NONE && nodes[prev].free) {
+					removeFree(prev);
+					nodes[prev].size += nodes[node].size;
+					unlink(node);
+					node = prev;
+				}
+				const uint32_t next = nodes[node].nextPhys;
+				if (next != NONE && nodes[next].free) {
+					removeFree(next);
+					nodes[node].size += nodes[next].size;
+					unlink(next);
+				}
+				insertFree(node);
+			}
+
+			bool empty() const { return used == 0; }
+			size_t getUsed() const { return used; }
+
+			void freeStats(size_t& freeBytes, size_t& largest) const
+			{
+				freeBytes = 0;
+				largest = 0;
+				for (auto& node : nodes) {
+					if (node.free && node.size) {
+						freeBytes += node.size;
+						largest = std::max(largest, node.size);
+					}
+				}
+			}
+
+		private:
+			struct Node
+			{
+				size_t offset = 0;
+				size_t size = 0;
+				uint32_t prevPhys = NONE, nextPhys = NONE;
+				uint32_t prevFree = NONE, nextFree = NONE;
+				bool free = false;
+			};
+			std::vector<Node> nodes{};
+			std::vector<uint32_t> unusedNodes{};
+			uint64_t flBitmap = 0;
+			uint32_t slBitmap[FL_COUNT]{};
+			uint32_t heads[FL_COUNT][SL_COUNT]{};
+			size_t used = 0;
+
+			static void Mapping(size_t size, uint32_t& fl, uint32_t& sl)
+			{
+				fl = Msb(size);
+				sl = static_cast<uint32_t>(size >> (fl - SL_BITS)) & (SL_COUNT - 1);
+			}
+
+			uint32_t newNode()
+			{
+				if (!unusedNodes.empty()) {
+					const uint32_t node = unusedNodes.back();
+					unusedNodes.pop_back();
+					nodes[node] = Node();
+					return node;
+				}
+				nodes.emplace_back();
+				return static_cast<uint32_t>(nodes.size() - 1);
+			}
+
+			// takes a node out of the physical order, its range has been merged into a neighbour
+			void unlink(uint32_t node)
+			{
+				const uint32_t prev = nodes[node].prevPhys;
+				const uint32_t next = nodes[node].nextPhys;
+				if (prev != NONE)
+					nodes[prev].nextPhys = next;
+				if (next != NONE)
+					nodes[next].prevPhys = prev;
+				nodes[node] = Node();
+				unusedNodes.push_back(node);
+			}
+
+			void insertFree(uint32_t node)
+			{
+				uint32_t fl, sl;
+				Mapping(nodes[node].size, fl, sl);
+				nodes[node].free = true;
+				nodes[node].prevFree = NONE;
+				nodes[node].nextFree = heads[fl][sl];
+				if (heads[fl][sl] != NONE)
+					nodes[heads[fl][sl]].prevFree = node;
+				heads[fl][sl] = node;
+				flBitmap |= 1ull << fl;
+				slBitmap[fl] |= 1u << sl;
+			}
+
+			void removeFree(uint32_t node)
+			{
+				uint32_t fl, sl;
+				Mapping(nodes[node].size, fl, sl);
+				const uint32_t prev = nodes[node].prevFree;
+				const uint32_t next = nodes[node].nextFree;
+				if (prev != NONE)
+					nodes[prev].nextFree = next;
+				else
+					heads[fl][sl] = next;
+				if (next != NONE)
+					nodes[next].prevFree = prev;
+				if (heads[fl][sl] == NONE) {
+					slBitmap[fl] &= ~(1u << sl);
+					if (!slBitmap[fl])
+						flBitmap &= ~(1ull << fl);
+				}
+				nodes[node].free = false;
+				nodes[node].prevFree = NONE;
+				nodes[node].nextFree = NONE;
+			}
+
+			// the first range of a class whose every member fits the size
+			uint32_t findFree(size_t size) const
+			{
+				uint32_t fl, sl;
+				Mapping(size + (static_cast<size_t>(1) << (Msb(size) - SL_BITS)) - 1, fl, sl);
+				uint32_t slMap = slBitmap[fl] & (~0u << sl);
+				if (!slMap) {
+					const uint64_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0ull << (fl + 1)) : 0;
+					if (!flMap)
+						return NONE;
+					fl = Lsb(flMap);
+					slMap = slBitmap[fl];
+				}
+				sl = Lsb(slMap);
+				return heads[fl][sl];
+			}
+		};
+	}
+
+	struct MemoryAllocator::Pool
+	{
+		struct Block
+		{
+			Ref<vk::DeviceMemory> memory;
+			void* mapped = nullptr;
+			TLSF tlsf{};
+			size_t linearOffset = 0;
+			uint32_t linearLive = 0;
+		};
+
+		uint32_t memoryType;
+		AllocationKind kind;
+		size_t blockSize;
+		std::vector<Block> blocks{};
+	};
+
+	void MemoryAllocator::Init()
+	{
+		auto vulkan = VulkanContext::get();
+		const auto& limits = vulkan->gpuProperties->limits;
+		atomSize = std::max(GRANULARITY, static_cast<size_t>(limits.nonCoherentAtomSize));
+		maxDeviceAllocations = limits.maxMemoryAllocationCount;
+
+		const auto memProperties = vulkan->gpu->getMemoryProperties();
+		hostVisible.assign(memProperties.memoryTypeCount, false);
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+			hostVisible[i] = static_cast<bool>(memProperties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+	}
+
+	void MemoryAllocator::destroy()
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		for (auto& pool : pools)
+			for (auto& block : pool->blocks)
+				if (block.memory)
+					freeDeviceMemory(block.memory);
+		pools.clear();
+
+		for (auto& memory : dedicated)
+			freeDeviceMemory(memory.first);
+		dedicated.clear();
+		liveAllocations = 0;
+	}
+
+	Ref<vk::DeviceMemory> MemoryAllocator::allocateDeviceMemory(uint32_t memoryType, size_t size, void*& mapped)
+	{
+		auto vulkan = VulkanContext::get();
+
+		vk::MemoryAllocateInfo allocInfo;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+		auto memory = make_ref(vulkan->device->allocateMemory(allocInfo));
+
+		// host visible memory stays mapped for its lifetime
+		mapped = hostVisible[memoryType] ? vulkan->device->mapMemory(*memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags()) : nullptr;
+		return memory;
+	}
+
+	void MemoryAllocator::freeDeviceMemory(const Ref<vk::DeviceMemory>& memory)
+	{
+		// mapped memory is implicitly unmapped when freed
+		VulkanContext::get()->device->freeMemory(*memory);
+		*memory = nullptr;
+	}
+
+	MemoryAllocator::Pool& MemoryAllocator::getPool(uint32_t memoryType, AllocationKind kind, uint32_t& index)
+	{
+		for (index = 0; index < pools.size(); index++)
+			if (pools[index]->memoryType == memoryType && pools[index]->kind == kind)
+				return *pools[index];
+
+		auto pool = make_ref(Pool());
+		pool->memoryType = memoryType;
+		pool->kind = kind;
+		pool->blockSize = kind == AllocationKind::Staging ? STAGING_BLOCK_SIZE : BLOCK_SIZE;
+		pools.push_back(pool);
+		index = static_cast<uint32_t>(pools.size() - 1);
+		return *pool;
+	}
+
+	MemoryAllocation MemoryAllocator::allocate(uint32_t memoryType, const vk::MemoryRequirements& requirements, AllocationKind kind)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		MemoryAllocation allocation;
+		allocation.size = AlignUp(static_cast<size_t>(requirements.size), atomSize);
+		const size_t alignment = std::max(static_cast<size_t>(requirements.alignment), atomSize);
+
+		uint32_t poolIndex;
+		Pool& pool = getPool(memoryType, kind, poolIndex);
+
+		if (allocation.size > pool.blockSize / 2) {
+			allocation.memory = allocateDeviceMemory(memoryType, allocation.size, allocation.mapped);
+			dedicated.emplace_back(allocation.memory, allocation.size);
+			liveAllocations++;
+			return allocation;
+		}
+
+		auto place = [&](Pool::Block& block) -> bool {
+			if (kind == AllocationKind::Staging) {
+				const size_t offset = AlignUp(block.linearOffset, alignment);
+				if (offset + allocation.size > pool.blockSize)
+					return false;
+				block.linearOffset = offset + allocation.size;
+				block.linearLive++;
+				allocation.offset = offset;
+				return true;
+			}
+			return block.tlsf.allocate(allocation.size, alignment, allocation.offset, allocation.node);
+		};
+
+		uint32_t blockIndex = NONE;
+		for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+			if (pool.blocks[i].memory && place(pool.blocks[i])) {
+				blockIndex = i;
+				break;
+			}
+		}
+
+		if (blockIndex == NONE) {
+			// a released block slot is reused, so the indices held by live allocations stay valid
+			for (blockIndex = 0; blockIndex < pool.blocks.size(); blockIndex++)
+				if (!pool.blocks[blockIndex].memory)
+					break;
+			if (blockIndex == pool.blocks.size())
+				pool.blocks.emplace_back();
+
+			auto& block = pool.blocks[blockIndex];
+			block.memory = allocateDeviceMemory(memoryType, pool.blockSize, block.mapped);
+			block.tlsf.Init(pool.blockSize);
+			block.linearOffset = 0;
+			block.linearLive = 0;
+			if (!place(block))
+				throw std::runtime_error("MemoryAllocator: allocation does not fit in a new block");
+		}
+
+		auto& block = pool.blocks[blockIndex];
+		allocation.memory = block.memory;
+		allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + allocation.offset : nullptr;
+		allocation.pool = poolIndex;
+		allocation.block = blockIndex;
+		liveAllocations++;
+		return allocation;
+	}
+
+	void MemoryAllocator::free(MemoryAllocation& allocation)
+	{
+		if (!allocation.memory || !*allocation.memory)
+			return;
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (allocation.pool == NONE) {
+			dedicated.erase(std::find_if(dedicated.begin(), dedicated.end(), [&allocation](const std::pair<Ref<vk::DeviceMemory>, size_t>& memory) { return memory.first == allocation.memory; }));
+			freeDeviceMemory(allocation.memory);
+		}
+		else {
+			Pool& pool = *pools[allocation.pool];
+			auto& block = pool.blocks[allocation.block];
+			bool empty;
+			if (pool.kind == AllocationKind::Staging) {
+				empty = --block.linearLive == 0;
+				if (empty)
+					block.linearOffset = 0;
+			}
+			else {
+				block.tlsf.free(allocation.node);
+				empty = block.tlsf.empty();
+			}
+
+			// an empty block is given back to the device, unless it is the last one of the pool
+			if (empty) {
+				const auto liveBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const Pool::Block& b) { return b.memory != nullptr; });
+				if (liveBlocks > 1) {
+					freeDeviceMemory(block.memory);
+					block.memory = nullptr;
+					block.mapped = nullptr;
+				}
+			}
+		}
+
+		liveAllocations--;
+		allocation = MemoryAllocation();
+	}
+
+	size_t MemoryAllocator::flushSize(const MemoryAllocation& allocation, size_t size) const
+	{
+		return std::min(AlignUp(size, atomSize), allocation.size);
+	}
+
+	MemoryAllocator::Stats MemoryAllocator::getStats()
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		Stats stats;
+		stats.maxDeviceAllocations = maxDeviceAllocations;
+		stats.allocations = liveAllocations;
+		stats.dedicated = static_cast<uint32_t>(dedicated.size());
+
+		size_t freeBytes = 0, largestFreeSum = 0;
+		for (auto& pool : pools) {
+			for (auto& block : pool->blocks) {
+				if (!block.memory)
+					continue;
+				stats.blocks++;
+				stats.reserved += pool->blockSize;
+				if (pool->kind == AllocationKind::Staging) {
+					stats.used += block.linearOffset;
+					stats.largestFree = std::max(stats.largestFree, pool->blockSize - block.linearOffset);
+					continue;
+				}
+				size_t blockFree, blockLargest;
+				block.tlsf.freeStats(blockFree, blockLargest);
+				stats.used += block.tlsf.getUsed();
+				stats.largestFree = std::max(stats.largestFree, blockLargest);
+				freeBytes += blockFree;
+				largestFreeSum += blockLargest;
+			}
+		}
+
+		for (auto& memory : dedicated) {
+			stats.reserved += memory.second;
+			stats.used += memory.second;
+		}
+
+		stats.deviceAllocations = stats.blocks + stats.dedicated;
+		stats.fragmentation = freeBytes ? 1.f - static_cast<float>(largestFreeSum) / static_cast<float>(freeBytes) : 0.f;
+		return stats;
+	}
+}
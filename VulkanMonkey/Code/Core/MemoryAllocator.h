@@ -0,0 +1,90 @@
+#pragma once
+#include "Base.h"
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace vk
+{
+	class DeviceMemory;
+	struct MemoryRequirements;
+}
+
+namespace vm
+{
+	// A range of device memory given to a buffer or an image, the memory is shared with other allocations of the block
+	struct MemoryAllocation
+	{
+		Ref<vk::DeviceMemory> memory;
+		size_t offset = 0;
+		size_t size = 0;
+		void* mapped = nullptr;		// persistently mapped address of offset, null when the memory is not host visible
+		uint32_t pool = UINT32_MAX;	// UINT32_MAX: a dedicated device allocation
+		uint32_t block = 0;
+		uint32_t node = 0;
+	};
+
+	// Buffers and images are kept in separate pools, so linear and optimal resources never share a granularity page
+	enum class AllocationKind
+	{
+		Buffer,
+		Image,
+		Staging	// short lived upload sources, bump allocated
+	};
+
+	// Sub-allocates device memory out of large blocks, a pool per memory type and allocation kind.
+	// Buffer and image pools place allocations with a two level segregated fit (TLSF) over each block, staging pools
+	// bump a linear offset that is rewound once every allocation of the block is freed. Allocations bigger than half
+	// a block get their own device memory.
+	class MemoryAllocator
+	{
+	public:
+		struct Stats
+		{
+			uint32_t blocks = 0;
+			uint32_t dedicated = 0;
+			uint32_t allocations = 0;
+			uint32_t deviceAllocations = 0;
+			uint32_t maxDeviceAllocations = 0;
+			size_t reserved = 0;		// bytes of device memory allocated
+			size_t used = 0;			// bytes given out
+			size_t largestFree = 0;		// biggest free range of a block
+			float fragmentation = 0.f;	// 1 - largest free range / free bytes, of the TLSF blocks
+		};
+
+		void Init();
+		void destroy();
+
+		MemoryAllocation allocate(uint32_t memoryType, const vk::MemoryRequirements& requirements, AllocationKind kind);
+		void free(MemoryAllocation& allocation);
+		// Size of a flush of the allocation, rounded to the non coherent atom size
+		size_t flushSize(const MemoryAllocation& allocation, size_t size) const;
+		Stats getStats();
+
+	private:
+		struct Pool;
+		std::vector<Ref<Pool>> pools{};
+		std::vector<std::pair<Ref<vk::DeviceMemory>, size_t>> dedicated{};	// memory, size
+		std::mutex mutex;
+		size_t atomSize = 256;
+		uint32_t maxDeviceAllocations = 0;
+		uint32_t liveAllocations = 0;
+		std::vector<bool> hostVisible{};
+
+		Pool& getPool(uint32_t memoryType, AllocationKind kind, uint32_t& index);
+		Ref<vk::DeviceMemory> allocateDeviceMemory(uint32_t memoryType, size_t size, void*& mapped);
+		void freeDeviceMemory(const Ref<vk::DeviceMemory>& memory);
+
+	public:
+		static auto get() noexcept { static auto ma = new MemoryAllocator(); return ma; }
+		static auto remove() noexcept { using type = decltype(get()); if (std::is_pointer<type>::value) delete get(); }
+
+		MemoryAllocator(MemoryAllocator const&) = delete;				// copy constructor
+		MemoryAllocator(MemoryAllocator&&) noexcept = delete;			// move constructor
+		MemoryAllocator& operator=(MemoryAllocator const&) = delete;	// copy assignment
+		MemoryAllocator& operator=(MemoryAllocator&&) = delete;			// move assignment
+	private:
+		MemoryAllocator() = default;									// default constructor
+		~MemoryAllocator() = default;									// destructor
+	};
+}
@@ -1,5 +1,5 @@
 #include "Node.h"
-#include <future>
+#include "JobSystem.h"
 #include "../Model/Mesh.h"
 #include "Queue.h"
 
@@ -49,11 +49,8 @@ void Node::update(Camera& camera)
 
 			// async calls should be at least bigger than a number, else this will be slower
 			if (numJoints > 3) {
-				std::vector<std::future<void>> futures(numJoints);
-				for (size_t i = 0; i < numJoints; i++)
-					futures[i] = std::async(std::launch::async, calculateMeshJointMatrixAsync, mesh, skin, inverseTransform, i);
-				for (auto& f : futures)
-					f.get();
+				auto calculateJoint = [this, &inverseTransform](uint32_t i) { calculateMeshJointMatrixAsync(mesh, skin, inverseTransform, i); };
+				JobSystem::get()->Wait(JobSystem::get()->parallel_for(static_cast<uint32_t>(numJoints), 4, calculateJoint));
 			}
 			else {
 				for (size_t i = 0; i < numJoints; i++)
@@ -5,7 +5,9 @@
 #include <deque>
 #include <any>
 #include <mutex>
+#include <atomic>
 #include "Buffer.h"
+#include "UniformRing.h"
 #include "../MemoryHash/MemoryHash.h"
 
 namespace vm
@@ -18,6 +20,12 @@ namespace vm
 
 		void exec_mem_copy()
 		{
+			// only the written ranges of a ring slice are copied to the frame regions
+			if (buffer->ringBacked) {
+				for (auto& memory_range : memory_ranges)
+					UniformRing::get()->write(buffer->ringOffset + memory_range.offset, memory_range.data, memory_range.size);
+				return;
+			}
 			buffer->map();
 			for (auto& memory_range : memory_ranges)
 				buffer->copyData(memory_range.data, memory_range.size, memory_range.offset);
@@ -30,7 +38,7 @@ namespace vm
 	{
 	public:
 		// std::deque insertion and deletion at either end of a deque never invalidates pointers or references to the rest of the elements
-		inline static std::deque<std::tuple<std::string, std::string>> loadModel{};
+		inline static std::deque<std::tuple<std::string, std::string, uint32_t>> loadModel{}; // folder, file, instances
 		inline static std::deque<int> unloadModel{};
 		inline static std::deque<std::tuple<int, std::string>> addScript{};
 		inline static std::deque<int> removeScript{};
@@ -39,22 +47,43 @@ namespace vm
 	private:
 		inline static std::vector<CopyRequest> m_async_copy_requests{};
 		inline static std::mutex m_mem_cpy_request_mutex{};
+		inline static std::atomic<size_t> m_uploaded_bytes{ 0 };
+		inline static std::atomic<size_t> m_skipped_bytes{ 0 };
 	public:
+		// The ranges with the same contents as their last upload are dropped, they are neither copied nor flushed
 		inline static void memcpyRequest(Buffer* buffer, const std::vector<MemoryRange>& ranges)
 		{
+			std::vector<MemoryRange> changed{};
+			changed.reserve(ranges.size());
+			size_t uploaded = 0, skipped = 0;
+			for (auto& range : ranges) {
+				if (buffer->uploadChanged(range.data, range.size, range.offset)) {
+					changed.push_back(range);
+					uploaded += range.size;
+				}
+				else {
+					skipped += range.size;
+				}
+			}
+			m_uploaded_bytes += uploaded;
+			m_skipped_bytes += skipped;
+			if (changed.empty())
+				return;
+
 			std::lock_guard<std::mutex> guard(m_mem_cpy_request_mutex);
-			m_async_copy_requests.push_back({ buffer, ranges });
+			m_async_copy_requests.push_back({ buffer, std::move(changed) });
 		}
-		inline static void exec_memcpyRequests()
+		// bytes requested and bytes skipped as unchanged, since the last call
+		inline static std::pair<size_t, size_t> takeUploadStats()
 		{
-			std::vector<std::future<void>> futureNodes(m_async_copy_requests.size());
-			for (uint32_t i = 0; i < m_async_copy_requests.size(); i++)
-				futureNodes[i] = std::async(std::launch::async, std::bind(&CopyRequest::exec_mem_copy, m_async_copy_requests[i]));
-
-			for (auto& f : futureNodes)
-				f.get();
-
-			m_async_copy_requests.clear();
+			return { m_uploaded_bytes.exchange(0), m_skipped_bytes.exchange(0) };
+		}
+		inline static std::vector<CopyRequest> takeMemcpyRequests()
+		{
+			std::lock_guard<std::mutex> guard(m_mem_cpy_request_mutex);
+			std::vector<CopyRequest> requests{};
+			requests.swap(m_async_copy_requests);
+			return requests;
 		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "vulkanPCH.h"
+#include "RangeAllocator.h"
+
+namespace vm
+{
+	void RangeAllocator::reset(uint32_t capacity)
+	{
+		freeRanges.clear();
+		if (capacity)
+			freeRanges[0] = capacity;
+	}
+
+	uint32_t RangeAllocator::allocate(uint32_t count)
+	{
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+			if (it->second < count)
+				continue;
+			const uint32_t first = it->first;
+			const uint32_t rest = it->second - count;
+			freeRanges.erase(it);
+			if (rest)
+				freeRanges[first + count] = rest;
+			return first;
+		}
+		return UINT32_MAX;
+	}
+
+	void RangeAllocator::free(uint32_t first, uint32_t count)
+	{
+		auto next = freeRanges.lower_bound(first);
+
+		// merged with the range after it
+		if (next != freeRanges.end() && first + count == next->first) {
+			count += next->second;
+			next = freeRanges.erase(next);
+		}
+		// and with the range before it
+		if (next != freeRanges.begin()) {
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == first) {
+				previous->second += count;
+				return;
+			}
+		}
+		freeRanges[first] = count;
+	}
+}
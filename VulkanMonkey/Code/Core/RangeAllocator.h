@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <map>
+
+namespace vm
+{
+	// First fit over the free ranges of an array, neighbouring ranges are merged when freed. Not thread safe, the
+	// owners lock around it.
+	class RangeAllocator
+	{
+	public:
+		void reset(uint32_t capacity);
+		// First element of the range, UINT32_MAX when no free range is big enough
+		uint32_t allocate(uint32_t count);
+		void free(uint32_t first, uint32_t count);
+
+	private:
+		std::map<uint32_t, uint32_t> freeRanges{}; // first, count
+	};
+}
@@ -0,0 +1,146 @@
+#include "vulkanPCH.h"
+#include "UniformRing.h"
+#include "../VulkanContext/VulkanContext.h"
+#include <algorithm>
+
+namespace vm
+{
+	void UniformRing::Init(uint32_t frames, size_t frameCapacity)
+	{
+		// a block can be bound as a slice and flushed on its own
+		const auto& limits = VulkanContext::get()->gpuProperties->limits;
+		blockSize = std::max({ static_cast<size_t>(256), static_cast<size_t>(limits.minUniformBufferOffsetAlignment), static_cast<size_t>(limits.minStorageBufferOffsetAlignment), static_cast<size_t>(limits.nonCoherentAtomSize) });
+		this->frameCapacity = (frameCapacity + blockSize - 1) / blockSize * blockSize;
+
+		ring.createBuffer(
+			this->frameCapacity * frames,
+			vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer,
+			vk::MemoryPropertyFlagBits::eHostVisible);
+		ring.map();
+
+		mirrorData.assign(this->frameCapacity, 0);
+
+		const size_t words = (this->frameCapacity / blockSize + 63) / 64;
+		dirty.resize(frames);
+		for (auto& frameDirty : dirty)
+			frameDirty = std::make_shared<std::vector<std::atomic<uint64_t>>>(words);
+
+		head = 0;
+		currentFrameOffset = 0;
+	}
+
+	void UniformRing::destroy()
+	{
+		if (ring.data)
+			ring.unmap();
+		ring.destroy();
+		mirrorData.clear();
+		dirty.clear();
+		released.clear();
+		releasedCount = 0;
+	}
+
+	size_t UniformRing::allocate(size_t size)
+	{
+		size = (std::max(size, static_cast<size_t>(1)) + blockSize - 1) / blockSize * blockSize;
+
+		if (releasedCount > 0) {
+			std::lock_guard<std::mutex> guard(releasedMutex);
+			for (auto it = released.begin(); it != released.end(); ++it) {
+				if (it->second == size) {
+					const size_t offset = it->first;
+					released.erase(it);
+					releasedCount--;
+					return offset;
+				}
+			}
+		}
+
+		const size_t offset = head.fetch_add(size);
+		if (offset + size > frameCapacity)
+			throw std::runtime_error("Uniform ring is out of memory");
+		return offset;
+	}
+
+	void UniformRing::release(size_t offset, size_t size)
+	{
+		size = (std::max(size, static_cast<size_t>(1)) + blockSize - 1) / blockSize * blockSize;
+
+		std::lock_guard<std::mutex> guard(releasedMutex);
+		released.emplace_back(offset, size);
+		releasedCount++;
+	}
+
+	void UniformRing::write(size_t offset, const void* data, size_t size)
+	{
+		memcpy(mirrorData.data() + offset, data, size);
+		markDirty(offset, size);
+	}
+
+	void UniformRing::markDirty(size_t offset, size_t size)
+	{
+		if (!size)
+			return;
+
+		const size_t first = offset / blockSize;
+		const size_t last = (offset + size - 1) / blockSize;
+		for (auto& frameDirty : dirty) {
+			for (size_t word = first / 64; word <= last / 64; word++) {
+				const size_t begin = std::max(first, word * 64) - word * 64;
+				const size_t end = std::min(last, word * 64 + 63) - word * 64;
+				const uint64_t bits = (end - begin == 63 ? ~0ull : ((1ull << (end - begin + 1)) - 1)) << begin;
+				(*frameDirty)[word].fetch_or(bits);
+			}
+		}
+	}
+
+	void UniformRing::beginFrame(uint32_t frame)
+	{
+		const size_t regionOffset = frame * frameCapacity;
+		currentFrameOffset = static_cast<uint32_t>(regionOffset);
+
+		auto* region = static_cast<uint8_t*>(ring.data) + regionOffset;
+		auto& frameDirty = *dirty[frame];
+		std::vector<vk::MappedMemoryRange> ranges{};
+
+		// consecutive dirty blocks are copied and flushed as one range
+		size_t runStart = SIZE_MAX;
+		auto endRun = [&](size_t block) {
+			if (runStart == SIZE_MAX)
+				return;
+			const size_t offset = runStart * blockSize;
+			const size_t size = (block - runStart) * blockSize;
+			memcpy(region + offset, mirrorData.data() + offset, size);
+			ranges.emplace_back(*ring.allocation->memory, ring.allocation->offset + regionOffset + offset, size);
+			runStart = SIZE_MAX;
+		};
+
+		const size_t usedBlocks = (head.load() + blockSize - 1) / blockSize;
+		for (size_t word = 0; word * 64 < usedBlocks; word++) {
+			const uint64_t bits = frameDirty[word].exchange(0);
+			if (!bits) {
+				endRun(word * 64);
+				continue;
+			}
+			for (size_t bit = 0; bit < 64; bit++) {
+				const size_t block = word * 64 + bit;
+				if (bits & (1ull << bit)) {
+					if (runStart == SIZE_MAX)
+						runStart = block;
+				}
+				else {
+					endRun(block);
+				}
+			}
+		}
+		endRun(usedBlocks);
+
+		size_t bytes = 0;
+		for (auto& range : ranges)
+			bytes += range.size;
+		flushedBytes = bytes;
+
+		if (!ranges.empty())
+			VulkanContext::get()->device->flushMappedMemoryRanges(ranges);
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "Buffer.h"
+
+namespace vm
+{
+	// Persistently mapped uniform memory with a region per frame in flight. Every ring backed buffer is a slice at the
+	// same offset of each region, its descriptor (uniform or storage) is dynamic and is bound with the offset of the
+	// recorded frame region.
+	// Writes go to a cpu copy that holds the latest contents and mark the blocks they touch for every frame, a region
+	// is brought up to date (copying and flushing only those blocks) once the gpu is done with its previous frame.
+	class UniformRing
+	{
+	public:
+		void Init(uint32_t frames, size_t frameCapacity);
+		void destroy();
+
+		// Reserves an aligned slice in every frame region, lock free unless a released slice of the same size is reused
+		size_t allocate(size_t size);
+		void release(size_t offset, size_t size);
+
+		// The latest contents of the slices, written on the render thread, the update thread queues its writes
+		// (Queue::memcpyRequest) and they are made as the snapshot of its frame is rendered
+		void* mirror(size_t offset) { return mirrorData.data() + offset; }
+		void write(size_t offset, const void* data, size_t size);
+		void markDirty(size_t offset, size_t size);
+
+		// Copies the blocks written since the frame region was last brought up to date and flushes them
+		void beginFrame(uint32_t frame);
+		// The dynamic offset of every slice descriptor in the frame that is recorded
+		uint32_t frameOffset() const { return currentFrameOffset; }
+		const Ref<vk::Buffer>& getBuffer() const { return ring.buffer; }
+		size_t getBlockSize() const { return blockSize; }
+		// bytes copied and flushed by the last beginFrame
+		size_t getFlushedBytes() const { return flushedBytes; }
+
+	private:
+		Buffer ring;
+		std::vector<uint8_t> mirrorData{};
+		size_t frameCapacity = 0;
+		size_t blockSize = 256;
+		uint32_t currentFrameOffset = 0;
+		std::atomic<size_t> flushedBytes{ 0 };
+
+		std::atomic<size_t> head{ 0 };
+		std::mutex releasedMutex;
+		std::vector<std::pair<size_t, size_t>> released{}; // offset, aligned size
+		std::atomic<uint32_t> releasedCount{ 0 };
+
+		// a bit per block, per frame region
+		std::vector<Ref<std::vector<std::atomic<uint64_t>>>> dirty{};
+
+	public:
+		static auto get() noexcept { static auto ur = new UniformRing(); return ur; }
+		static auto remove() noexcept { using type = decltype(get()); if (std::is_pointer<type>::value) delete get(); }
+
+		UniformRing(UniformRing const&) = delete;				// copy constructor
+		UniformRing(UniformRing&&) noexcept = delete;			// move constructor
+		UniformRing& operator=(UniformRing const&) = delete;	// copy assignment
+		UniformRing& operator=(UniformRing&&) = delete;			// move assignment
+	private:
+		UniformRing() = default;								// default constructor
+		~UniformRing() = default;								// destructor
+	};
+}
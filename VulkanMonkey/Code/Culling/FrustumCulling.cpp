@@ -0,0 +1,237 @@
+#include "FrustumCulling.h"
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace vm
+{
+	void VisibilityBitset::resize(size_t count)
+	{
+		this->count = count;
+		bytes.resize((count + 7) / 8);
+		reset();
+	}
+
+	void VisibilityBitset::reset()
+	{
+		std::fill(bytes.begin(), bytes.end(), static_cast<uint8_t>(0));
+	}
+
+	void VisibilityBitset::set(size_t index, bool visible)
+	{
+		const uint8_t bit = static_cast<uint8_t>(1u << (index & 7));
+		if (visible)
+			bytes[index >> 3] |= bit;
+		else
+			bytes[index >> 3] &= ~bit;
+	}
+
+	bool VisibilityBitset::test(size_t index) const
+	{
+		return index < count && (bytes[index >> 3] >> (index & 7)) & 1u;
+	}
+
+	size_t VisibilityBitset::size() const
+	{
+		return count;
+	}
+
+	size_t VisibilityBitset::visibleCount() const
+	{
+		size_t visible = 0;
+		for (auto& byte : bytes) {
+			for (uint8_t b = byte; b; b &= b - 1)
+				visible++;
+		}
+		return visible;
+	}
+
+	void CullingBounds::resize(size_t count)
+	{
+		this->count = count;
+		const size_t padded = (count + 7) & ~static_cast<size_t>(7);
+		for (auto* v : { &centerX, &centerY, &centerZ, &radius, &boxCenterX, &boxCenterY, &boxCenterZ, &boxExtentX, &boxExtentY, &boxExtentZ })
+			v->assign(padded, 0.f);
+	}
+
+	void CullingBounds::set(size_t index, cvec4& sphere, cvec3& boxCenter, cvec3& boxExtents)
+	{
+		centerX[index] = sphere.x;
+		centerY[index] = sphere.y;
+		centerZ[index] = sphere.z;
+		radius[index] = sphere.w;
+		boxCenterX[index] = boxCenter.x;
+		boxCenterY[index] = boxCenter.y;
+		boxCenterZ[index] = boxCenter.z;
+		boxExtentX[index] = boxExtents.x;
+		boxExtentY[index] = boxExtents.y;
+		boxExtentZ[index] = boxExtents.z;
+	}
+
+	size_t CullingBounds::size() const
+	{
+		return count;
+	}
+
+	size_t CullingBounds::paddedSize() const
+	{
+		return centerX.size();
+	}
+
+	void FrustumCulling::Cull(const CullingBounds& bounds, const Camera::Plane* planes, uint32_t planeCount, VisibilityBitset& visibility)
+	{
+		static const bool avx2 = HasAVX2();
+		if (avx2)
+			CullAVX2(bounds, planes, planeCount, visibility);
+		else
+			CullScalar(bounds, planes, planeCount, visibility);
+	}
+
+	void FrustumCulling::CullScalar(const CullingBounds& bounds, const Camera::Plane* planes, uint32_t planeCount, VisibilityBitset& visibility)
+	{
+		if (visibility.size() != bounds.size())
+			visibility.resize(bounds.size());
+
+		for (size_t i = 0; i < bounds.size(); i++) {
+			bool visible = true;
+			for (uint32_t p = 0; p < planeCount; p++) {
+				const Camera::Plane& plane = planes[p];
+
+				const float sphereDist = plane.normal.x * bounds.centerX[i] + plane.normal.y * bounds.centerY[i] + plane.normal.z * bounds.centerZ[i] + plane.d;
+				const float boxDist =
+					plane.normal.x * bounds.boxCenterX[i] + plane.normal.y * bounds.boxCenterY[i] + plane.normal.z * bounds.boxCenterZ[i] + plane.d +
+					fabs(plane.normal.x) * bounds.boxExtentX[i] + fabs(plane.normal.y) * bounds.boxExtentY[i] + fabs(plane.normal.z) * bounds.boxExtentZ[i];
+
+				visible &= sphereDist >= -bounds.radius[i] && boxDist >= 0.f;
+			}
+			visibility.set(i, visible);
+		}
+	}
+
+	TARGET_AVX2 void FrustumCulling::CullAVX2(const CullingBounds& bounds, const Camera::Plane* planes, uint32_t planeCount, VisibilityBitset& visibility)
+	{
+		if (visibility.size() != bounds.size())
+			visibility.resize(bounds.size());
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 signMask = _mm256_set1_ps(-0.f);
+
+		for (size_t i = 0; i < bounds.paddedSize(); i += 8) {
+			const __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+			const __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+			const __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+			const __m256 negRadius = _mm256_xor_ps(_mm256_loadu_ps(&bounds.radius[i]), signMask);
+			const __m256 bx = _mm256_loadu_ps(&bounds.boxCenterX[i]);
+			const __m256 by = _mm256_loadu_ps(&bounds.boxCenterY[i]);
+			const __m256 bz = _mm256_loadu_ps(&bounds.boxCenterZ[i]);
+			const __m256 ex = _mm256_loadu_ps(&bounds.boxExtentX[i]);
+			const __m256 ey = _mm256_loadu_ps(&bounds.boxExtentY[i]);
+			const __m256 ez = _mm256_loadu_ps(&bounds.boxExtentZ[i]);
+
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (uint32_t p = 0; p < planeCount; p++) {
+				const Camera::Plane& plane = planes[p];
+				const __m256 nx = _mm256_set1_ps(plane.normal.x);
+				const __m256 ny = _mm256_set1_ps(plane.normal.y);
+				const __m256 nz = _mm256_set1_ps(plane.normal.z);
+				const __m256 d = _mm256_set1_ps(plane.d);
+
+				// same operation order as the scalar path, so both produce identical results
+				__m256 sphereDist = _mm256_mul_ps(nx, cx);
+				sphereDist = _mm256_add_ps(sphereDist, _mm256_mul_ps(ny, cy));
+				sphereDist = _mm256_add_ps(sphereDist, _mm256_mul_ps(nz, cz));
+				sphereDist = _mm256_add_ps(sphereDist, d);
+
+				__m256 boxDist = _mm256_mul_ps(nx, bx);
+				boxDist = _mm256_add_ps(boxDist, _mm256_mul_ps(ny, by));
+				boxDist = _mm256_add_ps(boxDist, _mm256_mul_ps(nz, bz));
+				boxDist = _mm256_add_ps(boxDist, d);
+				boxDist = _mm256_add_ps(boxDist, _mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex));
+				boxDist = _mm256_add_ps(boxDist, _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey));
+				boxDist = _mm256_add_ps(boxDist, _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez));
+
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(sphereDist, negRadius, _CMP_GE_OQ));
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(boxDist, zero, _CMP_GE_OQ));
+
+				// the whole batch is outside
+				if (_mm256_testz_ps(visible, visible))
+					break;
+			}
+			visibility.bytes[i >> 3] = static_cast<uint8_t>(_mm256_movemask_ps(visible));
+		}
+
+		// clear the bits of the padding entries
+		if (const size_t tail = bounds.size() & 7)
+			visibility.bytes.back() &= static_cast<uint8_t>((1u << tail) - 1u);
+	}
+
+	void FrustumCulling::CullSmall(const CullingBounds& bounds, float minRadius, VisibilityBitset& visibility)
+	{
+		for (size_t i = 0; i < bounds.size(); i++) {
+			if (bounds.radius[i] < minRadius)
+				visibility.set(i, false);
+		}
+	}
+
+	bool FrustumCulling::HasAVX2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// avx support and the os saves the ymm registers
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+			return false;
+		if ((_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	void FrustumCulling::ExtractPlanes(cmat4& viewProjection, Camera::Plane* planes)
+	{
+		// transpose just to make the calculations look simpler
+		mat4 pvm = transpose(viewProjection);
+
+		const vec4 rows[6]{
+			pvm[3] - pvm[0], // right
+			pvm[3] + pvm[0], // left
+			pvm[3] - pvm[1], // bottom
+			pvm[3] + pvm[1], // top
+			pvm[3] - pvm[2], // far
+			pvm[3] + pvm[2]  // near
+		};
+
+		for (uint32_t i = 0; i < 6; i++) {
+			const vec4 temp = rows[i] / length(vec3(rows[i]));
+			planes[i].normal = vec3(temp);
+			planes[i].d = temp.w;
+		}
+	}
+
+	void FrustumCulling::TransformAABB(cmat4& matrix, cvec3& min, cvec3& max, vec3& center, vec3& extents)
+	{
+		mat4 m = matrix;
+		const vec3 localCenter = (max + min) * .5f;
+		const vec3 localExtents = (max - min) * .5f;
+
+		center = vec3(m * vec4(localCenter, 1.0f));
+		for (unsigned i = 0; i < 3; i++) {
+			extents[i] =
+				fabs(m[0][i]) * localExtents.x +
+				fabs(m[1][i]) * localExtents.y +
+				fabs(m[2][i]) * localExtents.z;
+		}
+	}
+}
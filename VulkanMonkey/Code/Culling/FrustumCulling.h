@@ -0,0 +1,59 @@
+#pragma once
+#include "../Core/Math.h"
+#include "../Camera/Camera.h"
+#include <vector>
+
+namespace vm
+{
+	// One bit per culled object, 8 objects are packed in every byte (matches one AVX2 batch)
+	class VisibilityBitset
+	{
+	public:
+		void resize(size_t count);
+		void reset();
+		void set(size_t index, bool visible);
+		bool test(size_t index) const;
+		size_t size() const;
+		size_t visibleCount() const;
+
+		std::vector<uint8_t> bytes{};
+	private:
+		size_t count = 0;
+	};
+
+	// World space bounds of the culled objects, stored as structure of arrays so 8 of them can be loaded at once.
+	// The arrays are padded to a multiple of 8, the padding entries are never reported as visible.
+	class CullingBounds
+	{
+	public:
+		void resize(size_t count);
+		void set(size_t index, cvec4& sphere, cvec3& boxCenter, cvec3& boxExtents);
+		size_t size() const;
+		size_t paddedSize() const;
+
+		// bounding spheres
+		std::vector<float> centerX{}, centerY{}, centerZ{}, radius{};
+		// axis aligned bounding boxes
+		std::vector<float> boxCenterX{}, boxCenterY{}, boxCenterZ{};
+		std::vector<float> boxExtentX{}, boxExtentY{}, boxExtentZ{};
+	private:
+		size_t count = 0;
+	};
+
+	class FrustumCulling
+	{
+	public:
+		// An object is visible when both its sphere and its box are not fully behind any of the planes
+		static void Cull(const CullingBounds& bounds, const Camera::Plane* planes, uint32_t planeCount, VisibilityBitset& visibility);
+		static void CullScalar(const CullingBounds& bounds, const Camera::Plane* planes, uint32_t planeCount, VisibilityBitset& visibility);
+		static void CullAVX2(const CullingBounds& bounds, const Camera::Plane* planes, uint32_t planeCount, VisibilityBitset& visibility);
+		static bool HasAVX2();
+		// Hides the visible objects with a bounding sphere radius below minRadius
+		static void CullSmall(const CullingBounds& bounds, float minRadius, VisibilityBitset& visibility);
+
+		// Extracts 6 normalized planes in the order right, left, bottom, top, far, near
+		static void ExtractPlanes(cmat4& viewProjection, Camera::Plane* planes);
+		// Transforms a local space box to a world space box (center, extents)
+		static void TransformAABB(cmat4& matrix, cvec3& min, cvec3& max, vec3& center, vec3& extents);
+	};
+}
@@ -0,0 +1,439 @@
+#include "vulkanPCH.h"
+#include "GPUCulling.h"
+#include "../Model/Mesh.h"
+#include "../Shadows/Shadows.h"
+#include "../Renderer/RenderSnapshot.h"
+#include "../Shader/Shader.h"
+#include "../VulkanContext/VulkanContext.h"
+#include <deque>
+
+namespace vm
+{
+	GPUCulling::GPUCulling()
+	{
+		DSDepthPyramid = make_ref(std::vector<vk::DescriptorSet>());
+		depthPyramidMips = make_ref(std::vector<vk::ImageView>());
+	}
+
+	void GPUCulling::Init(std::map<std::string, Image>& renderTargets)
+	{
+		createPipelines();
+		createSharedBuffers(1024);
+
+		const uint32_t frameCount = static_cast<uint32_t>(VulkanContext::get()->frames.size());
+		const std::vector<vk::DescriptorSetLayout> layouts(frameCount, Pipeline::getDescriptorSetLayoutGPUCulling());
+		vk::DescriptorSetAllocateInfo allocInfo;
+		allocInfo.descriptorPool = *VulkanContext::get()->descriptorPool;
+		allocInfo.descriptorSetCount = frameCount;
+		allocInfo.pSetLayouts = layouts.data();
+		const auto sets = VulkanContext::get()->device->allocateDescriptorSets(allocInfo);
+		frames.resize(frameCount);
+		for (uint32_t i = 0; i < frameCount; i++) {
+			frames[i].DSCull = make_ref(sets[i]);
+			createInputs(frames[i], 1024);
+		}
+
+		createDepthPyramid(renderTargets);
+	}
+
+	void GPUCulling::createSharedBuffers(uint32_t capacity)
+	{
+		slotCapacity = capacity;
+
+		commandBuffer.createBuffer(
+			static_cast<size_t>(COMMAND_STRIDE) * capacity * MAX_VIEWS,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		countBuffer.createBuffer(
+			sizeof(uint32_t) * capacity * MAX_VIEWS,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+	}
+
+	void GPUCulling::createInputs(FrameInputs& inputs, uint32_t capacity)
+	{
+		inputs.capacity = capacity;
+		inputs.uniform.createBuffer(sizeof(UBO), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		inputs.boundsBuffer.createBuffer(sizeof(Bounds) * capacity, vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		inputs.drawInputBuffer.createBuffer(sizeof(DrawInput) * capacity, vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		inputs.generation = 0;
+	}
+
+	void GPUCulling::destroyInputs(FrameInputs& inputs)
+	{
+		inputs.uniform.destroy();
+		inputs.boundsBuffer.destroy();
+		inputs.drawInputBuffer.destroy();
+		inputs.capacity = 0;
+	}
+
+	void GPUCulling::createPipelines()
+	{
+		Shader comp{ "shaders/Culling/cull.comp", ShaderType::Compute, true };
+		pipeline.info.pCompShader = &comp;
+		pipeline.info.descriptorSetLayouts = make_ref(std::vector<vk::DescriptorSetLayout>{ Pipeline::getDescriptorSetLayoutGPUCulling() });
+		pipeline.info.pushConstantStage = PushConstantStage::Compute;
+		pipeline.info.pushConstantSize = 4 * sizeof(uint32_t);
+		pipeline.createComputePipeline();
+
+		Shader compPyramid{ "shaders/Culling/depthPyramid.comp", ShaderType::Compute, true };
+		pipelineDepthPyramid.info.pCompShader = &compPyramid;
+		pipelineDepthPyramid.info.descriptorSetLayouts = make_ref(std::vector<vk::DescriptorSetLayout>{ Pipeline::getDescriptorSetLayoutDepthPyramid() });
+		pipelineDepthPyramid.createComputePipeline();
+	}
+
+	void GPUCulling::createDepthPyramid(std::map<std::string, Image>& renderTargets)
+	{
+		// the biggest power of two that fits in the depth target, so every level halves exactly
+		const auto previousPowerOfTwo = [](uint32_t value) {
+			uint32_t result = 1;
+			while (result * 2 <= value)
+				result *= 2;
+			return maximum(result, 2u);
+		};
+		const uint32_t width = previousPowerOfTwo(renderTargets["depth"].width);
+		const uint32_t height = previousPowerOfTwo(renderTargets["depth"].height);
+
+		uint32_t mipLevels = 1;
+		while ((maximum(width, height) >> mipLevels) > 0)
+			mipLevels++;
+
+		depthPyramid.format = make_ref(vk::Format::eR32Sfloat);
+		depthPyramid.initialLayout = make_ref(vk::ImageLayout::eUndefined);
+		depthPyramid.mipLevels = mipLevels;
+		depthPyramid.createImage(width, height, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		depthPyramid.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+		depthPyramid.createImageView(vk::ImageAspectFlagBits::eColor);
+		depthPyramid.filter = make_ref(vk::Filter::eNearest);
+		depthPyramid.samplerMipmapMode = make_ref(vk::SamplerMipmapMode::eNearest);
+		depthPyramid.addressMode = make_ref(vk::SamplerAddressMode::eClampToEdge);
+		depthPyramid.anisotropyEnabled = VK_FALSE;
+		depthPyramid.maxLod = static_cast<float>(mipLevels);
+		depthPyramid.createSampler();
+
+		auto& device = *VulkanContext::get()->device;
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			vk::ImageViewCreateInfo viewInfo;
+			viewInfo.image = *depthPyramid.image;
+			viewInfo.viewType = vk::ImageViewType::e2D;
+			viewInfo.format = *depthPyramid.format;
+			viewInfo.subresourceRange = { vk::ImageAspectFlagBits::eColor, i, 1, 0, 1 };
+			depthPyramidMips->push_back(device.createImageView(viewInfo));
+		}
+
+		// descriptor sets are never freed back to the pool, keep the ones of a previous (resized) pyramid
+		if (DSDepthPyramid->size() < mipLevels) {
+			const std::vector<vk::DescriptorSetLayout> layouts(mipLevels - DSDepthPyramid->size(), Pipeline::getDescriptorSetLayoutDepthPyramid());
+			vk::DescriptorSetAllocateInfo allocInfo;
+			allocInfo.descriptorPool = *VulkanContext::get()->descriptorPool;
+			allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+			allocInfo.pSetLayouts = layouts.data();
+			for (auto& set : device.allocateDescriptorSets(allocInfo))
+				DSDepthPyramid->push_back(set);
+		}
+
+		depthPyramidValid = false;
+
+		// level 0 reads the depth target, every other level reads the previous one
+		std::deque<vk::DescriptorImageInfo> dsii{};
+		const auto wSetImage = [&dsii](const vk::DescriptorSet& dstSet, uint32_t dstBinding, vk::Sampler sampler, vk::ImageView view, vk::ImageLayout imageLayout, vk::DescriptorType type) {
+			dsii.emplace_back(sampler, view, imageLayout);
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, type, &dsii.back(), nullptr, nullptr };
+		};
+		std::vector<vk::WriteDescriptorSet> writeDescriptorSets{};
+		auto& depth = renderTargets["depth"];
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			if (i == 0)
+				writeDescriptorSets.push_back(wSetImage((*DSDepthPyramid)[i], 0, *depth.sampler, *depth.view, vk::ImageLayout::eShaderReadOnlyOptimal, vk::DescriptorType::eCombinedImageSampler));
+			else
+				writeDescriptorSets.push_back(wSetImage((*DSDepthPyramid)[i], 0, *depthPyramid.sampler, (*depthPyramidMips)[i - 1], vk::ImageLayout::eGeneral, vk::DescriptorType::eCombinedImageSampler));
+			writeDescriptorSets.push_back(wSetImage((*DSDepthPyramid)[i], 1, nullptr, (*depthPyramidMips)[i], vk::ImageLayout::eGeneral, vk::DescriptorType::eStorageImage));
+		}
+		device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+		generation++;
+	}
+
+	void GPUCulling::updateDescriptorSet(FrameInputs& inputs)
+	{
+		std::deque<vk::DescriptorImageInfo> dsii{};
+		const auto wSetImage = [&dsii](const vk::DescriptorSet& dstSet, uint32_t dstBinding, vk::Sampler sampler, vk::ImageView view, vk::ImageLayout imageLayout) {
+			dsii.emplace_back(sampler, view, imageLayout);
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eCombinedImageSampler, &dsii.back(), nullptr, nullptr };
+		};
+		std::deque<vk::DescriptorBufferInfo> dsbi{};
+		const auto wSetBuffer = [&dsbi](const vk::DescriptorSet& dstSet, uint32_t dstBinding, Buffer& buffer, vk::DescriptorType type) {
+			dsbi.emplace_back(*buffer.buffer, 0, buffer.size);
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, type, nullptr, &dsbi.back(), nullptr };
+		};
+
+		const vk::DescriptorSet& set = *inputs.DSCull;
+		std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+			wSetBuffer(set, 0, inputs.uniform, vk::DescriptorType::eUniformBuffer),
+			wSetBuffer(set, 1, inputs.boundsBuffer, vk::DescriptorType::eStorageBuffer),
+			wSetBuffer(set, 2, inputs.drawInputBuffer, vk::DescriptorType::eStorageBuffer),
+			wSetBuffer(set, 3, commandBuffer, vk::DescriptorType::eStorageBuffer),
+			wSetBuffer(set, 4, countBuffer, vk::DescriptorType::eStorageBuffer),
+			wSetImage(set, 5, *depthPyramid.sampler, *depthPyramid.view, vk::ImageLayout::eGeneral)
+		};
+		VulkanContext::get()->device->updateDescriptorSets(writeDescriptorSets, nullptr);
+		inputs.generation = generation;
+	}
+
+	void GPUCulling::prepare(RenderSnapshot& frame, uint32_t frameIndex)
+	{
+		this->frameIndex = frameIndex;
+
+		// every prepare follows the fence wait of a frame, after as many as the other frames in flight the submits
+		// that could use a retired buffer are done
+		for (auto it = retired.begin(); it != retired.end();) {
+			if (!it->frames || !--it->frames) {
+				it->buffer.destroy();
+				it = retired.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+
+		// every primitive of every model gets a slot, the slots of a mesh are consecutive
+		const bool bindless = frame.settings.useBindless;
+		uint32_t slots = 0;
+		std::vector<uint32_t> leaders{}, filled{};
+		for (auto& model : frame.models) {
+			auto& primitives = model.primitives;
+			model.cullSlot = slots;
+			slots += static_cast<uint32_t>(primitives.size());
+
+			// the camera groups split the command range of the model, a primitive joins the first one of its mesh with
+			// the same material and alpha mode, the blended ones are drawn back to front so each stays alone
+			leaders.assign(primitives.size(), 0);
+			for (uint32_t p = 0, meshFirst = 0; p < primitives.size(); p++) {
+				if (primitives[p].mesh != primitives[meshFirst].mesh)
+					meshFirst = p;
+				const Primitive& primitive = *primitives[p].primitive;
+				const uint16_t alphaMode = primitive.pbrMaterial.alphaMode;
+				uint32_t leader = p;
+				if (bindless && alphaMode != 3) {
+					for (uint32_t q = meshFirst; q < p; q++) {
+						const Primitive& other = *primitives[q].primitive;
+						if (leaders[q] == q && other.materialIndex == primitive.materialIndex && other.pbrMaterial.alphaMode == alphaMode) {
+							leader = q;
+							break;
+						}
+					}
+				}
+				leaders[p] = leader;
+				primitives[p].cullGroupSize = 0;
+				primitives[leader].cullGroupSize++;
+			}
+			// the members follow the first primitive of the group in the order of the mesh
+			filled.assign(primitives.size(), 0);
+			uint32_t command = 0;
+			for (uint32_t p = 0; p < primitives.size(); p++) {
+				PrimitiveSnapshot& primitive = primitives[p];
+				if (leaders[p] == p) {
+					primitive.cullGroup = command;
+					command += primitive.cullGroupSize;
+				}
+				else {
+					primitive.cullGroup = primitives[leaders[p]].cullGroup;
+				}
+				primitive.cullCommand = primitive.cullGroup + filled[leaders[p]]++;
+			}
+		}
+		slotCount = slots;
+
+		// the other frames in flight may still draw with the shared buffers, they are retired instead of waited on
+		if (slotCount > slotCapacity) {
+			const uint32_t framesInFlight = static_cast<uint32_t>(frames.size()) - 1;
+			retired.push_back({ commandBuffer, framesInFlight });
+			retired.push_back({ countBuffer, framesInFlight });
+			commandBuffer = Buffer();
+			countBuffer = Buffer();
+			createSharedBuffers(maximum(slotCount, slotCapacity * 2));
+			generation++;
+		}
+
+		// the fence of the frame is signaled, nothing reads its inputs and its descriptor set
+		FrameInputs& inputs = frames[frameIndex];
+		if (slotCount > inputs.capacity) {
+			const uint32_t capacity = maximum(slotCount, inputs.capacity * 2);
+			destroyInputs(inputs);
+			createInputs(inputs, capacity);
+		}
+		if (inputs.generation != generation)
+			updateDescriptorSet(inputs);
+	}
+
+	void GPUCulling::update(const RenderSnapshot& frame)
+	{
+		FrameInputs& inputs = frames[frameIndex];
+		Buffer& boundsBuffer = inputs.boundsBuffer;
+		Buffer& drawInputBuffer = inputs.drawInputBuffer;
+		Buffer& uniform = inputs.uniform;
+
+		boundsBuffer.map();
+		drawInputBuffer.map();
+		auto* bounds = static_cast<Bounds*>(boundsBuffer.data);
+		auto* draws = static_cast<DrawInput*>(drawInputBuffer.data);
+		for (auto& model : frame.models) {
+			const CullingBounds& cb = model.cullingBounds;
+			for (size_t i = 0; i < cb.size(); i++) {
+				Bounds& b = bounds[model.cullSlot + i];
+				b.sphere = vec4(cb.centerX[i], cb.centerY[i], cb.centerZ[i], cb.radius[i]);
+				b.boxCenter = vec4(cb.boxCenterX[i], cb.boxCenterY[i], cb.boxCenterZ[i], 0.f);
+				b.boxExtents = vec4(cb.boxExtentX[i], cb.boxExtentY[i], cb.boxExtentZ[i], 0.f);
+			}
+			for (uint32_t i = 0, meshFirst = 0; i < model.primitives.size(); i++) {
+				const PrimitiveSnapshot& p = model.primitives[i];
+				if (p.mesh != model.primitives[meshFirst].mesh)
+					meshFirst = i;
+				const Mesh& mesh = *p.mesh;
+				const Primitive& primitive = *p.primitive;
+				DrawInput& d = draws[model.cullSlot + i];
+				d.indexCount = primitive.indicesSize;
+				d.firstIndex = mesh.indexOffset + primitive.indexOffset;
+				d.vertexOffset = static_cast<int32_t>(mesh.vertexOffset + primitive.vertexOffset);
+				// an instanced model culls its instances on the cpu and is drawn directly
+				d.enabled = model.render && p.render && !model.instanced ? 1 : 0;
+				d.groupFirst = model.cullSlot + meshFirst;
+				d.cameraGroup = model.cullSlot + p.cullGroup;
+				d.cameraCommand = model.cullSlot + p.cullCommand;
+			}
+		}
+		boundsBuffer.flush();
+		drawInputBuffer.flush();
+		boundsBuffer.unmap();
+		drawInputBuffer.unmap();
+
+		for (uint32_t p = 0; p < 6; p++)
+			ubo.planes[0][p] = vec4(frame.frustum[p].normal, frame.frustum[p].d);
+		for (uint32_t c = 0; c < MAX_VIEWS - 1; c++)
+			for (uint32_t p = 0; p < 5; p++)
+				ubo.planes[c + 1][p] = vec4(frame.casterPlanes[c][p].normal, frame.casterPlanes[c][p].d);
+		ubo.minRadius = vec4(0.f, frame.casterMinRadius[0], frame.casterMinRadius[1], frame.casterMinRadius[2]);
+		ubo.hizViewProjection = depthPyramidViewProjection;
+		ubo.hizSize = vec4(depthPyramid.width_f, depthPyramid.height_f, static_cast<float>(depthPyramid.mipLevels), depthPyramidValid ? 1.f : 0.f);
+		ubo.slotCount = slotCount;
+		cameraViewProjection = frame.viewProjection;
+
+		uniform.map();
+		uniform.copyData(&ubo, sizeof(ubo));
+		uniform.flush();
+		uniform.unmap();
+	}
+
+	void GPUCulling::cull(vk::CommandBuffer cmd, uint32_t view, bool useHiZ)
+	{
+		if (!slotCount)
+			return;
+
+		// previous indirect reads and pyramid writes are done before the buffers are rewritten
+		vk::MemoryBarrier barrier;
+		barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eIndirectCommandRead;
+		barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		cmd.pipelineBarrier(
+			vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+			vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+		cmd.fillBuffer(*countBuffer.buffer, sizeof(uint32_t) * view * slotCount, sizeof(uint32_t) * slotCount, 0);
+
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+		// the cascades test their caster volumes, extruded toward the light
+		const uint32_t constants[4]{ view, view == 0 ? 6u : 5u, useHiZ ? 1u : 0u, compacted() ? 1u : 0u };
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline.handle);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipeline.layout, 0, *frames[frameIndex].DSCull, nullptr);
+		cmd.pushConstants(*pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), constants);
+		cmd.dispatch((slotCount + 63) / 64, 1, 1);
+
+		barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, vk::DependencyFlags(), barrier, nullptr, nullptr);
+	}
+
+	void GPUCulling::buildDepthPyramid(vk::CommandBuffer cmd)
+	{
+		// the depth target is already in shader read layout, wait for its writes and the culling reads of the pyramid
+		vk::MemoryBarrier barrier;
+		barrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eShaderRead;
+		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		cmd.pipelineBarrier(
+			vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eComputeShader,
+			vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *pipelineDepthPyramid.handle);
+		for (uint32_t i = 0; i < depthPyramid.mipLevels; i++) {
+			const uint32_t width = maximum(depthPyramid.width >> i, 1u);
+			const uint32_t height = maximum(depthPyramid.height >> i, 1u);
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineDepthPyramid.layout, 0, (*DSDepthPyramid)[i], nullptr);
+			cmd.dispatch((width + 7) / 8, (height + 7) / 8, 1);
+
+			barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+			barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), barrier, nullptr, nullptr);
+		}
+
+		depthPyramidValid = true;
+		depthPyramidViewProjection = cameraViewProjection;
+	}
+
+	bool GPUCulling::compacted() const
+	{
+		return VulkanContext::get()->supportsDrawIndirectCount;
+	}
+
+	void GPUCulling::drawGroup(vk::CommandBuffer cmd, uint32_t view, uint32_t firstCommand, uint32_t commands) const
+	{
+		const uint32_t first = view * slotCount + firstCommand;
+		const vk::DeviceSize offset = static_cast<vk::DeviceSize>(COMMAND_STRIDE) * first;
+		if (compacted()) {
+			cmd.drawIndexedIndirectCountKHR(*commandBuffer.buffer, offset, *countBuffer.buffer, sizeof(uint32_t) * first, commands, COMMAND_STRIDE, *VulkanContext::get()->dispatchLoaderDynamic);
+		}
+		else if (VulkanContext::get()->gpuFeatures->multiDrawIndirect) {
+			cmd.drawIndexedIndirect(*commandBuffer.buffer, offset, commands, COMMAND_STRIDE);
+		}
+		else {
+			for (uint32_t i = 0; i < commands; i++)
+				cmd.drawIndexedIndirect(*commandBuffer.buffer, offset + static_cast<vk::DeviceSize>(COMMAND_STRIDE) * i, 1, COMMAND_STRIDE);
+		}
+	}
+
+	void GPUCulling::destroyDepthPyramid()
+	{
+		for (auto& view : *depthPyramidMips)
+			VulkanContext::get()->device->destroyImageView(view);
+		depthPyramidMips->clear();
+		if (depthPyramid.image)
+			depthPyramid.destroy();
+		depthPyramidValid = false;
+	}
+
+	void GPUCulling::destroy()
+	{
+		for (auto& inputs : frames)
+			destroyInputs(inputs);
+		frames.clear();
+		for (auto& entry : retired)
+			entry.buffer.destroy();
+		retired.clear();
+		commandBuffer.destroy();
+		countBuffer.destroy();
+		pipeline.destroy();
+		pipelineDepthPyramid.destroy();
+		destroyDepthPyramid();
+		if (Pipeline::getDescriptorSetLayoutGPUCulling()) {
+			VulkanContext::get()->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutGPUCulling());
+			Pipeline::getDescriptorSetLayoutGPUCulling() = nullptr;
+		}
+		if (Pipeline::getDescriptorSetLayoutDepthPyramid()) {
+			VulkanContext::get()->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutDepthPyramid());
+			Pipeline::getDescriptorSetLayoutDepthPyramid() = nullptr;
+		}
+	}
+}
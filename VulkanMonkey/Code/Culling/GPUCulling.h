@@ -0,0 +1,122 @@
+#pragma once
+#include "../Core/Buffer.h"
+#include "../Core/Image.h"
+#include "../Core/Math.h"
+#include "../Camera/Camera.h"
+#include "../Renderer/Pipeline.h"
+#include <vector>
+#include <map>
+
+namespace vk
+{
+	class CommandBuffer;
+	class DescriptorSet;
+	class ImageView;
+}
+
+namespace vm
+{
+	class Shadows;
+	struct RenderSnapshot;
+
+	// GPU driven culling. The primitive bounds and draw arguments of every model live in storage buffers, a compute
+	// pass tests them against a view (frustum planes, plus the previous frame depth pyramid for the camera) and writes
+	// the indirect draw commands. View 0 is the camera, views 1-3 are the shadow cascades.
+	// The commands are written to the range of the group of the primitive, a group is drawn with one indirect call:
+	// a mesh for the cascades, the primitives of a mesh the G-buffer records with the same binds for the camera.
+	// With VK_KHR_draw_indirect_count the visible commands are compacted and drawn with a gpu written count,
+	// otherwise every primitive keeps its command and the hidden ones get an instance count of 0.
+	// The inputs the cpu writes have a copy per frame in flight, a frame rewrites its own once its fence is signaled.
+	// The commands and counts are only written by the gpu and shared, a pass orders them after the previous frame.
+	class GPUCulling
+	{
+	public:
+		static constexpr uint32_t MAX_VIEWS = 4;
+		static constexpr uint32_t COMMAND_STRIDE = 5 * sizeof(uint32_t); // VkDrawIndexedIndirectCommand
+
+		struct Bounds { vec4 sphere, boxCenter, boxExtents; };
+		struct DrawInput
+		{
+			uint32_t indexCount;
+			uint32_t firstIndex;
+			int32_t vertexOffset;
+			uint32_t enabled;
+			uint32_t groupFirst;	// first slot of the mesh, the group of the cascades
+			uint32_t cameraGroup;	// first command of the group of the camera view
+			uint32_t cameraCommand;	// command of the primitive in it, when the commands are not compacted
+			uint32_t dummy;
+		};
+		struct UBO
+		{
+			vec4 planes[MAX_VIEWS][6];
+			mat4 hizViewProjection;
+			vec4 hizSize;
+			vec4 minRadius;
+			uint32_t slotCount;
+			uint32_t dummy[3];
+		} ubo;
+
+		struct FrameInputs
+		{
+			Buffer uniform;
+			Buffer boundsBuffer;
+			Buffer drawInputBuffer;
+			Ref<vk::DescriptorSet> DSCull;
+			uint32_t capacity = 0;
+			uint32_t generation = 0; // of the shared buffers and pyramid its descriptor set points to
+		};
+		std::vector<FrameInputs> frames{};
+		uint32_t frameIndex = 0; // the frame that is recorded
+
+		Buffer commandBuffer;
+		Buffer countBuffer;
+		Pipeline pipeline;
+		Pipeline pipelineDepthPyramid;
+		Ref<std::vector<vk::DescriptorSet>> DSDepthPyramid;
+
+		Image depthPyramid;
+		Ref<std::vector<vk::ImageView>> depthPyramidMips;
+		bool depthPyramidValid = false;
+		mat4 depthPyramidViewProjection = mat4::identity();
+		mat4 cameraViewProjection = mat4::identity();
+
+		uint32_t slotCount = 0;
+		uint32_t slotCapacity = 0; // of the commands and counts
+
+		GPUCulling();
+		void Init(std::map<std::string, Image>& renderTargets);
+		// Assigns the slots and camera groups of the models of the snapshot and grows the buffers, before the frame is
+		// recorded and once its fence is signaled. With bindless textures the primitives of a mesh with the same material
+		// share a group, else each is alone.
+		void prepare(RenderSnapshot& frame, uint32_t frameIndex);
+		// Uploads the bounds, draw inputs and view planes to the inputs of the frame prepared last
+		void update(const RenderSnapshot& frame);
+		// Records the culling of one view, must be outside of a render pass
+		void cull(vk::CommandBuffer cmd, uint32_t view, bool useHiZ);
+		// Reduces the depth render target to the depth pyramid used by the next frame
+		void buildDepthPyramid(vk::CommandBuffer cmd);
+		// Draws the commands of a group of a view, the range starting at its first command
+		void drawGroup(vk::CommandBuffer cmd, uint32_t view, uint32_t firstCommand, uint32_t commands) const;
+		bool compacted() const;
+		void createDepthPyramid(std::map<std::string, Image>& renderTargets);
+		void destroyDepthPyramid();
+		void destroy();
+
+	private:
+		// bumped when the shared buffers or the pyramid are replaced, the frames rewrite their sets before they cull
+		uint32_t generation = 1;
+		// shared buffers replaced by a grow, destroyed once every frame in flight that may use them is done
+		struct Retired
+		{
+			Buffer buffer;
+			uint32_t frames;
+		};
+		std::vector<Retired> retired{};
+
+		void createSharedBuffers(uint32_t capacity);
+		void createInputs(FrameInputs& inputs, uint32_t capacity);
+		void destroyInputs(FrameInputs& inputs);
+		void updateDescriptorSet(FrameInputs& inputs);
+		void createPipelines();
+	};
+}
@@ -0,0 +1,349 @@
+#include "OcclusionCulling.h"
+#include "FrustumCulling.h"
+#include "../Model/Model.h"
+#include "../Model/Mesh.h"
+#include "../Core/JobSystem.h"
+#include <immintrin.h>
+#include <cfloat>
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace vm
+{
+	void OcclusionCulling::Init(uint32_t width, uint32_t height)
+	{
+		// the rasterizer works in 8 pixel spans and 8x8 tiles
+		this->width = (width + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+		this->height = (height + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+		tilesX = this->width / TILE_SIZE;
+		tilesY = this->height / TILE_SIZE;
+		depth.resize(static_cast<size_t>(this->width) * this->height);
+		tileDepth.resize(static_cast<size_t>(tilesX) * tilesY);
+		Clear();
+	}
+
+	void OcclusionCulling::Clear()
+	{
+		std::fill(depth.begin(), depth.end(), 0.f);
+		std::fill(tileDepth.begin(), tileDepth.end(), 0.f);
+		triangles.clear();
+	}
+
+	void OcclusionCulling::AddOccluder(cmat4& worldViewProjection, const Vertex* vertices, const uint32_t* indices, uint32_t indexCount)
+	{
+		mat4 mvp = worldViewProjection;
+		const vec2 halfSize(width * .5f, height * .5f);
+
+		const auto toScreen = [&](cvec3& position, vec3& screen) {
+			const vec4 clip = mvp * vec4(position, 1.0f);
+			if (clip.w <= nearClip)
+				return false;
+			const float invW = 1.f / clip.w;
+			screen = vec3((clip.x * invW + 1.f) * halfSize.x, (clip.y * invW + 1.f) * halfSize.y, invW);
+			return true;
+		};
+
+		for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+			Triangle triangle;
+			if (toScreen(vertices[indices[i]].position, triangle.v0) &&
+				toScreen(vertices[indices[i + 1]].position, triangle.v1) &&
+				toScreen(vertices[indices[i + 2]].position, triangle.v2))
+				triangles.push_back(triangle);
+		}
+	}
+
+	void OcclusionCulling::Rasterize()
+	{
+		const uint32_t bands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+		auto rasterizeBand = [this](uint32_t band) {
+			const uint32_t row = band * BAND_HEIGHT;
+			RasterizeBand(row, minimum(row + BAND_HEIGHT, height));
+		};
+		JobSystem::get()->Wait(JobSystem::get()->parallel_for(bands, 1, rasterizeBand));
+	}
+
+	void OcclusionCulling::RasterizeBand(uint32_t firstRow, uint32_t lastRow)
+	{
+		static const bool avx2 = FrustumCulling::HasAVX2();
+		for (auto& triangle : triangles) {
+			if (avx2)
+				RasterizeTriangleAVX2(triangle, firstRow, lastRow);
+			else
+				RasterizeTriangle(triangle, firstRow, lastRow);
+		}
+		BuildTiles(firstRow, lastRow);
+	}
+
+	// Edge functions and the depth plane of a triangle, every value is evaluated as a*x + (b*y + c)
+	// by both rasterizer paths so they write identical depth buffers
+	struct TriangleSetup
+	{
+		float edgeA[3], edgeB[3], edgeC[3];
+		float depthA, depthB, depthC;
+		int minX, maxX, minY, maxY;
+	};
+
+	static bool setupTriangle(const OcclusionCulling::Triangle& triangle, uint32_t width, uint32_t firstRow, uint32_t lastRow, TriangleSetup& setup)
+	{
+		vec3 v0 = triangle.v0, v1 = triangle.v1, v2 = triangle.v2;
+
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (fabs(area) < 1e-6f)
+			return false;
+		if (area < 0.f) {
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		setup.minX = maximum(static_cast<int>(floor(minimum(v0.x, minimum(v1.x, v2.x)))), 0);
+		setup.maxX = minimum(static_cast<int>(ceil(maximum(v0.x, maximum(v1.x, v2.x)))), static_cast<int>(width) - 1);
+		setup.minY = maximum(static_cast<int>(floor(minimum(v0.y, minimum(v1.y, v2.y)))), static_cast<int>(firstRow));
+		setup.maxY = minimum(static_cast<int>(ceil(maximum(v0.y, maximum(v1.y, v2.y)))), static_cast<int>(lastRow) - 1);
+		if (setup.minX > setup.maxX || setup.minY > setup.maxY)
+			return false;
+
+		// edge i is opposite of vertex i, so the edge value divided by the area is the barycentric of that vertex
+		const vec3* a[3] = { &v1, &v2, &v0 };
+		const vec3* b[3] = { &v2, &v0, &v1 };
+		for (int i = 0; i < 3; i++) {
+			setup.edgeA[i] = -(b[i]->y - a[i]->y);
+			setup.edgeB[i] = b[i]->x - a[i]->x;
+			setup.edgeC[i] = -(setup.edgeA[i] * a[i]->x + setup.edgeB[i] * a[i]->y);
+		}
+
+		const float invArea = 1.f / area;
+		const float z[3] = { v0.z * invArea, v1.z * invArea, v2.z * invArea };
+		setup.depthA = setup.edgeA[0] * z[0] + setup.edgeA[1] * z[1] + setup.edgeA[2] * z[2];
+		setup.depthB = setup.edgeB[0] * z[0] + setup.edgeB[1] * z[1] + setup.edgeB[2] * z[2];
+		setup.depthC = setup.edgeC[0] * z[0] + setup.edgeC[1] * z[1] + setup.edgeC[2] * z[2];
+		return true;
+	}
+
+	void OcclusionCulling::RasterizeTriangle(const Triangle& triangle, uint32_t firstRow, uint32_t lastRow)
+	{
+		TriangleSetup s;
+		if (!setupTriangle(triangle, width, firstRow, lastRow, s))
+			return;
+
+		// same 8 pixel spans as the simd path
+		const int startX = s.minX & ~static_cast<int>(TILE_SIZE - 1);
+		const int endX = (s.maxX | static_cast<int>(TILE_SIZE - 1)) + 1;
+		for (int y = s.minY; y <= s.maxY; y++) {
+			const float py = static_cast<float>(y) + .5f;
+			const float rowE0 = s.edgeB[0] * py + s.edgeC[0];
+			const float rowE1 = s.edgeB[1] * py + s.edgeC[1];
+			const float rowE2 = s.edgeB[2] * py + s.edgeC[2];
+			const float rowZ = s.depthB * py + s.depthC;
+			float* row = &depth[static_cast<size_t>(y) * width];
+
+			for (int x = startX; x < endX; x++) {
+				const float px = static_cast<float>(x) + .5f;
+				if (s.edgeA[0] * px + rowE0 >= 0.f && s.edgeA[1] * px + rowE1 >= 0.f && s.edgeA[2] * px + rowE2 >= 0.f)
+					row[x] = maximum(row[x], s.depthA * px + rowZ);
+			}
+		}
+	}
+
+	TARGET_AVX2 void OcclusionCulling::RasterizeTriangleAVX2(const Triangle& triangle, uint32_t firstRow, uint32_t lastRow)
+	{
+		TriangleSetup s;
+		if (!setupTriangle(triangle, width, firstRow, lastRow, s))
+			return;
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 offsets = _mm256_setr_ps(.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		const __m256 a0 = _mm256_set1_ps(s.edgeA[0]);
+		const __m256 a1 = _mm256_set1_ps(s.edgeA[1]);
+		const __m256 a2 = _mm256_set1_ps(s.edgeA[2]);
+		const __m256 az = _mm256_set1_ps(s.depthA);
+
+		const int startX = s.minX & ~static_cast<int>(TILE_SIZE - 1);
+		for (int y = s.minY; y <= s.maxY; y++) {
+			const float py = static_cast<float>(y) + .5f;
+			const __m256 rowE0 = _mm256_set1_ps(s.edgeB[0] * py + s.edgeC[0]);
+			const __m256 rowE1 = _mm256_set1_ps(s.edgeB[1] * py + s.edgeC[1]);
+			const __m256 rowE2 = _mm256_set1_ps(s.edgeB[2] * py + s.edgeC[2]);
+			const __m256 rowZ = _mm256_set1_ps(s.depthB * py + s.depthC);
+			float* row = &depth[static_cast<size_t>(y) * width];
+
+			// spans start aligned to 8 and the width is a multiple of 8, so the whole span is always inside the row
+			for (int x = startX; x <= s.maxX; x += 8) {
+				const __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), offsets);
+				const __m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), rowE0);
+				const __m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), rowE1);
+				const __m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), rowE2);
+				__m256 inside = _mm256_cmp_ps(e0, zero, _CMP_GE_OQ);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(e1, zero, _CMP_GE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+				if (_mm256_testz_ps(inside, inside))
+					continue;
+
+				const __m256 z = _mm256_add_ps(_mm256_mul_ps(az, px), rowZ);
+				const __m256 current = _mm256_loadu_ps(&row[x]);
+				_mm256_storeu_ps(&row[x], _mm256_blendv_ps(current, _mm256_max_ps(current, z), inside));
+			}
+		}
+	}
+
+	void OcclusionCulling::BuildTiles(uint32_t firstRow, uint32_t lastRow)
+	{
+		for (uint32_t ty = firstRow / TILE_SIZE; ty < lastRow / TILE_SIZE; ty++) {
+			for (uint32_t tx = 0; tx < tilesX; tx++) {
+				float farthest = FLT_MAX;
+				for (uint32_t y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; y++) {
+					const float* row = &depth[static_cast<size_t>(y) * width + tx * TILE_SIZE];
+					for (uint32_t x = 0; x < TILE_SIZE; x++)
+						farthest = minimum(farthest, row[x]);
+				}
+				tileDepth[static_cast<size_t>(ty) * tilesX + tx] = farthest;
+			}
+		}
+	}
+
+	bool OcclusionCulling::TestAABB(cmat4& viewProjection, cvec3& center, cvec3& extents) const
+	{
+		mat4 vp = viewProjection;
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		float closest = 0.f;
+		for (int i = 0; i < 8; i++) {
+			const vec3 corner(
+				center.x + (i & 1 ? extents.x : -extents.x),
+				center.y + (i & 2 ? extents.y : -extents.y),
+				center.z + (i & 4 ? extents.z : -extents.z));
+			const vec4 clip = vp * vec4(corner, 1.0f);
+			if (clip.w <= nearClip)
+				return true; // crosses the near plane
+
+			const float invW = 1.f / clip.w;
+			const float x = (clip.x * invW + 1.f) * width * .5f;
+			const float y = (clip.y * invW + 1.f) * height * .5f;
+			minX = minimum(minX, x);
+			maxX = maximum(maxX, x);
+			minY = minimum(minY, y);
+			maxY = maximum(maxY, y);
+			closest = maximum(closest, invW);
+		}
+		closest *= 1.f + DEPTH_BIAS;
+		if (maxX < 0.f || maxY < 0.f || minX >= width || minY >= height)
+			return true; // left to the frustum culling
+
+		const int x0 = maximum(static_cast<int>(floor(minX)), 0);
+		const int y0 = maximum(static_cast<int>(floor(minY)), 0);
+		const int x1 = minimum(static_cast<int>(floor(maxX)), static_cast<int>(width) - 1);
+		const int y1 = minimum(static_cast<int>(floor(maxY)), static_cast<int>(height) - 1);
+
+		for (int ty = y0 / static_cast<int>(TILE_SIZE); ty <= y1 / static_cast<int>(TILE_SIZE); ty++) {
+			for (int tx = x0 / static_cast<int>(TILE_SIZE); tx <= x1 / static_cast<int>(TILE_SIZE); tx++) {
+				// every pixel of the tile has an occluder in front of the box
+				if (tileDepth[static_cast<size_t>(ty) * tilesX + tx] > closest)
+					continue;
+
+				// refine with the pixels of the tile that the box covers
+				const int px0 = maximum(x0, tx * static_cast<int>(TILE_SIZE));
+				const int px1 = minimum(x1, (tx + 1) * static_cast<int>(TILE_SIZE) - 1);
+				const int py0 = maximum(y0, ty * static_cast<int>(TILE_SIZE));
+				const int py1 = minimum(y1, (ty + 1) * static_cast<int>(TILE_SIZE) - 1);
+				for (int y = py0; y <= py1; y++) {
+					const float* row = &depth[static_cast<size_t>(y) * width];
+					for (int x = px0; x <= px1; x++) {
+						if (row[x] <= closest)
+							return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	uint32_t OcclusionCulling::Cull(Camera& camera, std::vector<Model>& models, uint32_t triangleBudget)
+	{
+		struct Occluder
+		{
+			float size;
+			uint32_t modelIndex;
+			Model* model;
+			Mesh* mesh;
+			Primitive* primitive;
+		};
+
+		Clear();
+		nearClip = minimum(camera.nearPlane, camera.farPlane); // near and far are reversed
+		const mat4 viewProjection = camera.projection * camera.view;
+
+		// the biggest opaque and static primitives on screen are the occluders
+		std::vector<Occluder> occluders{};
+		for (uint32_t m = 0; m < models.size(); m++) {
+			auto& model = models[m];
+			// the primitive bounds of an instanced model are not where its instances are
+			if (!model.render || model.isInstanced())
+				continue;
+			for (auto& node : model.linearNodes) {
+				if (!node->mesh)
+					continue;
+				for (auto& primitive : node->mesh->primitives) {
+					if (!primitive.render || primitive.hasBones || primitive.pbrMaterial.alphaMode != 1 || !model.visibility.test(primitive.cullIndex))
+						continue;
+					const float distance = maximum(length(vec3(primitive.transformedBS) - camera.position), nearClip);
+					occluders.push_back({ primitive.transformedBS.w / distance, m, &model, node->mesh.get(), &primitive });
+				}
+			}
+		}
+		std::stable_sort(occluders.begin(), occluders.end(), [](const Occluder& a, const Occluder& b) { return a.size > b.size; });
+
+		// a rasterized occluder would be tested against its own faces
+		std::vector<VisibilityBitset> rasterized(models.size());
+		for (size_t m = 0; m < models.size(); m++)
+			rasterized[m].resize(models[m].cullingBounds.size());
+
+		uint32_t triangleCount = 0;
+		for (auto& occluder : occluders) {
+			Mesh& mesh = *occluder.mesh;
+			Primitive& primitive = *occluder.primitive;
+			if (mesh.indices.empty() || mesh.vertices.empty())
+				continue;
+
+			const uint32_t count = primitive.indicesSize / 3;
+			if (triangleCount + count > triangleBudget)
+				continue;
+			triangleCount += count;
+			rasterized[occluder.modelIndex].set(primitive.cullIndex, true);
+
+			AddOccluder(
+				viewProjection * occluder.model->ubo.matrix * mesh.ubo.matrix,
+				&mesh.vertices[primitive.vertexOffset],
+				&mesh.indices[primitive.indexOffset],
+				primitive.indicesSize);
+		}
+
+		Rasterize();
+
+		// test the remaining visible primitives
+		const auto testModel = [this, &viewProjection](Model& model, const VisibilityBitset& occluders) {
+			uint32_t occluded = 0;
+			const CullingBounds& bounds = model.cullingBounds;
+			for (size_t i = 0; i < bounds.size(); i++) {
+				if (!model.visibility.test(i) || occluders.test(i))
+					continue;
+				const vec3 center(bounds.boxCenterX[i], bounds.boxCenterY[i], bounds.boxCenterZ[i]);
+				const vec3 extents(bounds.boxExtentX[i], bounds.boxExtentY[i], bounds.boxExtentZ[i]);
+				if (!TestAABB(viewProjection, center, extents)) {
+					model.visibility.set(i, false);
+					occluded++;
+				}
+			}
+			return occluded;
+		};
+
+		std::atomic<uint32_t> occluded{ 0 };
+		auto testModels = [&](uint32_t i) {
+			if (models[i].render && !models[i].isInstanced())
+				occluded += testModel(models[i], rasterized[i]);
+		};
+		JobSystem::get()->Wait(JobSystem::get()->parallel_for(static_cast<uint32_t>(models.size()), 1, testModels));
+
+		return occluded;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "../Core/Math.h"
+#include "../Core/Vertex.h"
+#include "../Camera/Camera.h"
+#include <vector>
+
+namespace vm
+{
+	class Model;
+
+	// Masked software occlusion culling. The biggest opaque primitives are rasterized on the cpu into a low resolution
+	// depth buffer, every other frustum visible primitive is tested against it and its 8x8 tile hierarchy.
+	// Depth is stored as 1/w (bigger is closer), so it interpolates linearly in screen space and clears to 0.
+	class OcclusionCulling
+	{
+	public:
+		static constexpr uint32_t TILE_SIZE = 8;
+		static constexpr uint32_t BAND_HEIGHT = 4 * TILE_SIZE;
+		// relative 1/w margin of the tests, a box touching an occluder is not hidden by the rounding of either
+		static constexpr float DEPTH_BIAS = 1e-3f;
+
+		// Screen space triangle, x and y in pixels, z is 1/w
+		struct Triangle
+		{
+			vec3 v0, v1, v2;
+		};
+
+		void Init(uint32_t width, uint32_t height);
+		void Clear();
+		// Transforms and appends the triangles of an occluder, triangles crossing the near plane are dropped
+		void AddOccluder(cmat4& worldViewProjection, const Vertex* vertices, const uint32_t* indices, uint32_t indexCount);
+		// Rasterizes the occluders, each band of rows is independent and runs on its own thread
+		void Rasterize();
+		void RasterizeBand(uint32_t firstRow, uint32_t lastRow);
+		// False only when the box is fully hidden behind the rasterized occluders
+		bool TestAABB(cmat4& viewProjection, cvec3& center, cvec3& extents) const;
+		// Selects the occluders among the frustum visible primitives, rasterizes them and clears the visibility bits
+		// of the hidden primitives, the occluders themselves are not tested. Returns the number of occluded primitives.
+		uint32_t Cull(Camera& camera, std::vector<Model>& models, uint32_t triangleBudget);
+
+		uint32_t width = 0, height = 0;
+		uint32_t tilesX = 0, tilesY = 0;
+		float nearClip = 0.f;
+		std::vector<float> depth{};
+		std::vector<float> tileDepth{}; // farthest occluder depth of every tile
+		std::vector<Triangle> triangles{};
+
+	private:
+		void RasterizeTriangle(const Triangle& triangle, uint32_t firstRow, uint32_t lastRow);
+		void RasterizeTriangleAVX2(const Triangle& triangle, uint32_t firstRow, uint32_t lastRow);
+		void BuildTiles(uint32_t firstRow, uint32_t lastRow);
+	};
+}
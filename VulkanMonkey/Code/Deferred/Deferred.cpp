@@ -11,6 +11,7 @@
 #include <deque>
 #include "../Shader/Reflection.h"
 #include "../VulkanContext/VulkanContext.h"
+#include "../Model/Bindless.h"
 
 namespace vm
 {
@@ -23,7 +24,7 @@ namespace vm
 	{
 	}
 
-	void Deferred::batchStart(vk::CommandBuffer cmd, uint32_t imageIndex, const vk::Extent2D& extent)
+	void Deferred::batchStart(vk::CommandBuffer cmd, uint32_t imageIndex, const vk::Extent2D& extent, vk::SubpassContents contents, bool bindless)
 	{
 		vk::ClearValue clearColor;
 		memcpy(clearColor.color.float32, GUI::clearColor.data(), 4 * sizeof(float));
@@ -32,7 +33,8 @@ namespace vm
 		depthStencil.depth = 0.f;
 		depthStencil.stencil = 0;
 
-		std::vector<vk::ClearValue> clearValues = { clearColor, clearColor, clearColor, clearColor, clearColor, clearColor, depthStencil };
+		// the depth target always clears to 0 (reversed depth), the composition and the depth pyramid rely on it
+		std::vector<vk::ClearValue> clearValues = { vk::ClearValue(), clearColor, clearColor, clearColor, clearColor, clearColor, depthStencil };
 
 		vk::RenderPassBeginInfo rpi;
 		rpi.renderPass = *renderPass.handle;
@@ -42,22 +44,22 @@ namespace vm
 		rpi.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		rpi.pClearValues = clearValues.data();
 
-		cmd.beginRenderPass(rpi, vk::SubpassContents::eInline);
+		cmd.beginRenderPass(rpi, contents);
 
-		*Model::commandBuffer = cmd;
 		Model::pipeline = &pipeline;
+		Model::pipelineBindless = bindless ? &pipelineBindless : nullptr;
 	}
 
-	void Deferred::batchEnd()
+	void Deferred::batchEnd(vk::CommandBuffer cmd)
 	{
-		Model::commandBuffer->endRenderPass();
-		*Model::commandBuffer = nullptr;
+		cmd.endRenderPass();
 		Model::pipeline = nullptr;
+		Model::pipelineBindless = nullptr;
 	}
 
 	void Deferred::createDeferredUniforms(std::map<std::string, Image>& renderTargets, LightUniforms& lightUniforms)
 	{
-		uniform.createBuffer(sizeof(ubo), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		uniform.createRingBuffer(sizeof(ubo));
 		uniform.map();
 		uniform.zero();
 		uniform.flush();
@@ -127,8 +129,8 @@ namespace vm
 		};
 		std::deque<vk::DescriptorBufferInfo> dsbi{};
 		auto const wSetBuffer = [&dsbi](const vk::DescriptorSet& dstSet, uint32_t dstBinding, Buffer& buffer) {
-			dsbi.emplace_back(*buffer.buffer, 0, buffer.size);
-			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &dsbi.back(), nullptr };
+			dsbi.emplace_back(*buffer.buffer, buffer.ringOffset, buffer.size);
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &dsbi.back(), nullptr };
 		};
 
 		std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
@@ -183,7 +185,8 @@ namespace vm
 		cmd.beginRenderPass(rpi, vk::SubpassContents::eInline);
 
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipelineComposition.handle);
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineComposition.layout, 0, { *DSComposition, (*shadows.descriptorSets)[0], (*shadows.descriptorSets)[1], (*shadows.descriptorSets)[2], *skybox.descriptorSet }, nullptr);
+		const uint32_t dynamicOffset = UniformRing::get()->frameOffset();
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineComposition.layout, 0, { *DSComposition, (*shadows.descriptorSets)[0], (*shadows.descriptorSets)[1], (*shadows.descriptorSets)[2], *skybox.descriptorSet }, { dynamicOffset, dynamicOffset, dynamicOffset, dynamicOffset, dynamicOffset });
 		cmd.draw(3, 1, 0, 0);
 		cmd.endRenderPass();
 		// End Composition
@@ -277,11 +280,33 @@ namespace vm
 		{
 			Pipeline::getDescriptorSetLayoutMesh(),
 			Pipeline::getDescriptorSetLayoutPrimitive(),
-			Pipeline::getDescriptorSetLayoutModel()
+			Pipeline::getDescriptorSetLayoutFrame()
 		});
 		pipeline.info.renderPass = renderPass;
+		// the index of the draw's material in the material table, the slot of its model's matrices and its coverage
+		pipeline.info.pushConstantStage = PushConstantStage::Vertex;
+		pipeline.info.pushConstantSize = 3 * sizeof(uint32_t);
 
 		pipeline.createGraphicsPipeline();
+
+		if (!Bindless::get()->supported())
+			return;
+
+		// same targets and material index, the material textures come from the bindless set
+		Shader vertBindless{ "shaders/Deferred/gBuffer.vert", ShaderType::Vertex, true, { { "BINDLESS" } } };
+		Shader fragBindless{ "shaders/Deferred/gBuffer.frag", ShaderType::Fragment, true, { { "BINDLESS" } } };
+
+		pipelineBindless.info = pipeline.info;
+		pipelineBindless.info.pVertShader = &vertBindless;
+		pipelineBindless.info.pFragShader = &fragBindless;
+		pipelineBindless.info.descriptorSetLayouts = make_ref(std::vector<vk::DescriptorSetLayout>
+		{
+			Pipeline::getDescriptorSetLayoutMesh(),
+			Pipeline::getDescriptorSetLayoutBindless(),
+			Pipeline::getDescriptorSetLayoutFrame()
+		});
+
+		pipelineBindless.createGraphicsPipeline();
 	}
 
 	void Deferred::createCompositionPipeline(std::map<std::string, Image>& renderTargets)
@@ -328,6 +353,7 @@ namespace vm
 		}
 		uniform.destroy();
 		pipeline.destroy();
+		pipelineBindless.destroy();
 		pipelineComposition.destroy();
 	}
 }
@@ -13,6 +13,7 @@ namespace vk
 {
 	class DescriptorSet;
 	class DescriptorSetLayout;
+	enum class SubpassContents;
 }
 
 namespace vm
@@ -26,14 +27,15 @@ namespace vm
 		std::vector<Framebuffer> framebuffers{}, compositionFramebuffers{};
 		Ref<vk::DescriptorSet> DSComposition;
 		Pipeline pipeline;
+		Pipeline pipelineBindless;
 		Pipeline pipelineComposition;
 		Image ibl_brdf_lut;
 
 		struct UBO { vec4 screenSpace[8]; } ubo;
 		Buffer uniform;
 
-		void batchStart(vk::CommandBuffer cmd, uint32_t imageIndex, const vk::Extent2D& extent);
-		static void batchEnd();
+		void batchStart(vk::CommandBuffer cmd, uint32_t imageIndex, const vk::Extent2D& extent, vk::SubpassContents contents, bool bindless);
+		static void batchEnd(vk::CommandBuffer cmd);
 		void createDeferredUniforms(std::map<std::string, Image>& renderTargets, LightUniforms& lightUniforms);
 		void updateDescriptorSets(std::map<std::string, Image>& renderTargets, LightUniforms& lightUniforms);
 		void update(mat4& invViewProj);
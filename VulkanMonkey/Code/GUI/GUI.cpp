@@ -9,6 +9,8 @@
 #include "../Core/Surface.h"
 #include "../Shader/Shader.h"
 #include "../VulkanContext/VulkanContext.h"
+#include "../Model/MaterialTable.h"
+#include "../Model/GeometryPool.h"
 
 namespace vm
 {
@@ -156,7 +158,7 @@ namespace vm
 					const std::string path(result);
 					std::string folderPath = path.substr(0, path.find_last_of('\\') + 1);
 					std::string modelName = path.substr(path.find_last_of('\\') + 1);
-					Queue::loadModel.emplace_back(folderPath, modelName);
+					Queue::loadModel.emplace_back(folderPath, modelName, 1);
 				}
 			
 				const int exit = async_messageBox_ImGuiMenuItem("Exit", "Exit", "Are you sure you want to exit?");
@@ -188,8 +190,21 @@ namespace vm
 
 		ImGui::Text("CPU Total: %.3f (waited %.3f) ms", cpuTime, cpuWaitingTime);
 		ImGui::Indent(16.0f); ImGui::Text("Updates Total: %.3f ms", updatesTime); ImGui::Unindent(16.0f);
+		ImGui::Indent(16.0f); ImGui::Text("Jobs: %i tasks (%.3f ms)", jobTasks, jobTime); ImGui::Unindent(16.0f);
+		ImGui::Indent(16.0f); ImGui::Text("Uploads: %.1f KB (unchanged %.1f KB)", uploadedKB, skippedKB); ImGui::Unindent(16.0f);
+		ImGui::Indent(16.0f); ImGui::Text("Flushed: %.1f KB", flushedKB); ImGui::Unindent(16.0f);
+		ImGui::Indent(16.0f); ImGui::Text("GPU Memory: %.1f / %.1f MB in %i blocks (%i dedicated)",
+			static_cast<float>(memoryStats.used) / (1024.f * 1024.f), static_cast<float>(memoryStats.reserved) / (1024.f * 1024.f), memoryStats.blocks, memoryStats.dedicated); ImGui::Unindent(16.0f);
+		ImGui::Indent(16.0f); ImGui::Text("Allocations: %i (%i of %i device), fragmentation %.1f%%",
+			memoryStats.allocations, memoryStats.deviceAllocations, memoryStats.maxDeviceAllocations, memoryStats.fragmentation * 100.f); ImGui::Unindent(16.0f);
+		ImGui::Indent(16.0f); ImGui::Text("Materials: %i unique of %i", MaterialTable::get()->getCount(), MaterialTable::get()->getRequested()); ImGui::Unindent(16.0f);
+		ImGui::Indent(16.0f); ImGui::Text("Geometry: %i of %i vertices, %i of %i indices",
+			GeometryPool::get()->getVertexCount(), GeometryPool::MAX_VERTICES, GeometryPool::get()->getIndexCount(), GeometryPool::MAX_INDICES); ImGui::Unindent(16.0f);
+		if (use_occlusion_culling) {
+			ImGui::Indent(16.0f); ImGui::Text("Occluded: %i primitives", occluded_primitives); ImGui::Unindent(16.0f);
+		}
 		ImGui::Separator();
-		ImGui::Text("GPU Total: %.3f ms", stats[0] + (shadow_cast ? stats[11] + stats[12] + stats[13] : 0.f) + (use_compute ? stats[14] : 0.f));
+		ImGui::Text("GPU Total: %.3f ms", stats[0] + (shadow_cast ? stats[11] : 0.f) + (use_compute ? stats[14] : 0.f));
 		ImGui::Separator();
 		ImGui::Text("Render Passes:");
 		//if (use_compute) {
@@ -199,8 +214,6 @@ namespace vm
 		ImGui::Indent(16.0f);
 		if (shadow_cast) {
 			ImGui::Text("Depth: %.3f ms", stats[11]); totalPasses++; totalTime += stats[11];
-			ImGui::Text("Depth: %.3f ms", stats[12]); totalPasses++; totalTime += stats[12];
-			ImGui::Text("Depth: %.3f ms", stats[13]); totalPasses++; totalTime += stats[13];
 		}
 		ImGui::Text("GBuffer: %.3f ms", stats[2]); totalPasses++; totalTime += stats[2];
 		if (show_ssao) {
@@ -317,7 +330,7 @@ namespace vm
 			const std::string path(result);
 			std::string folderPath = path.substr(0, path.find_last_of('\\') + 1);
 			std::string modelName = path.substr(path.find_last_of('\\') + 1);
-			Queue::loadModel.emplace_back(folderPath, modelName);
+			Queue::loadModel.emplace_back(folderPath, modelName, 1);
 		}
 
 		for (uint32_t i = 0; i < modelList.size(); i++) {
@@ -458,7 +471,9 @@ namespace vm
 			ImGui::Indent(16.0f);
 			ImGui::SliderFloat("Sun Intst", &sun_intensity, 0.1f, 50.f);
 			ImGui::InputFloat3("SunPos", sun_position.data(), 1);
-			ImGui::InputFloat("Slope", &depthBias[2], 0.15f, 0.5f, 5); ImGui::Separator(); ImGui::Separator();
+			ImGui::InputFloat("Slope", &depthBias[2], 0.15f, 0.5f, 5);
+			ImGui::Checkbox("Shadow Cache", &shadow_cache);
+			ImGui::Checkbox("Single Pass Cascades", &shadow_single_pass); ImGui::Separator(); ImGui::Separator();
 			{
 				vec3 sunDist(&sun_position[0]);
 				if (lengthSquared(sunDist) > 160000.f) {
@@ -470,6 +485,33 @@ namespace vm
 			}
 			ImGui::Unindent(16.0f);
 		}
+		ImGui::Checkbox("Occlusion Culling", &use_occlusion_culling);
+		if (use_occlusion_culling) {
+			ImGui::Indent(16.0f);
+			ImGui::InputInt("Occluder Tris", &occluder_triangle_budget, 1000, 5000);
+			occluder_triangle_budget = maximum(occluder_triangle_budget, 0);
+			ImGui::Unindent(16.0f);
+		}
+		ImGui::Checkbox("GPU Culling", &use_GPU_culling);
+		ImGui::Checkbox("Static Batching", &static_batching);
+		if (static_batching) {
+			// applies to the models loaded after it is changed
+			ImGui::Indent(16.0f);
+			ImGui::InputInt("Batch Verts", &static_batch_vertices, 1024, 8192);
+			static_batch_vertices = clamp(static_batch_vertices, 2, static_cast<int>(GeometryPool::MAX_VERTICES));
+			ImGui::Unindent(16.0f);
+		}
+		ImGui::Checkbox("Impostors", &use_impostors);
+		if (use_impostors) {
+			// the models loaded while it is off get no atlases
+			ImGui::Indent(16.0f);
+			ImGui::SliderFloat("Impostor Size", &impostor_screen_size, 0.01f, 0.5f);
+			ImGui::Unindent(16.0f);
+		}
+		ImGui::Checkbox("Bindless Materials", &use_bindless);
+		ImGui::SliderInt("Record Threads", &recording_threads, 1, 8);
+		ImGui::Checkbox("Cache Command Buffers", &cache_secondaries);
+		ImGui::Checkbox("Render Thread", &use_render_thread);
 		ImGui::InputFloat("CamSpeed", &cameraSpeed, 0.1f, 1.f, 3);
 		ImGui::SliderFloat4("ClearCol", clearColor.data(), 0.0f, 1.0f);
 		ImGui::InputFloat("TimeScale", &timeScale, 0.05f, 0.2f); ImGui::Separator(); ImGui::Separator();
@@ -655,7 +697,7 @@ namespace vm
 
 		vk::CommandBufferBeginInfo beginInfo;
 		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-		(*vulkan->dynamicCmdBuffers)[0].begin(beginInfo);
+		vulkan->frames[0].dynamicCmdBuffer->begin(beginInfo);
 
 		// Create fonts texture
 		unsigned char* pixels;
@@ -702,7 +744,7 @@ namespace vm
 			copy_barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
 			copy_barrier.subresourceRange.levelCount = 1;
 			copy_barrier.subresourceRange.layerCount = 1;
-			(*vulkan->dynamicCmdBuffers)[0].pipelineBarrier(
+			vulkan->frames[0].dynamicCmdBuffer->pipelineBarrier(
 				vk::PipelineStageFlagBits::eHost,
 				vk::PipelineStageFlagBits::eTransfer,
 				vk::DependencyFlagBits::eByRegion,
@@ -717,7 +759,7 @@ namespace vm
 			region.imageExtent.width = width;
 			region.imageExtent.height = height;
 			region.imageExtent.depth = 1;
-			(*vulkan->dynamicCmdBuffers)[0].copyBufferToImage(*stagingBuffer.buffer, *texture.image, vk::ImageLayout::eTransferDstOptimal, region);
+			vulkan->frames[0].dynamicCmdBuffer->copyBufferToImage(*stagingBuffer.buffer, *texture.image, vk::ImageLayout::eTransferDstOptimal, region);
 
 			vk::ImageMemoryBarrier use_barrier = {};
 			use_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
@@ -730,7 +772,7 @@ namespace vm
 			use_barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
 			use_barrier.subresourceRange.levelCount = 1;
 			use_barrier.subresourceRange.layerCount = 1;
-			(*vulkan->dynamicCmdBuffers)[0].pipelineBarrier(
+			vulkan->frames[0].dynamicCmdBuffer->pipelineBarrier(
 				vk::PipelineStageFlagBits::eTransfer,
 				vk::PipelineStageFlagBits::eFragmentShader,
 				vk::DependencyFlagBits::eByRegion,
@@ -743,9 +785,9 @@ namespace vm
 		// Store our identifier
 		io.Fonts->TexID = reinterpret_cast<ImTextureID>(reinterpret_cast<intptr_t>(static_cast<VkImage>(*texture.image)));
 
-		(*vulkan->dynamicCmdBuffers)[0].end();
+		vulkan->frames[0].dynamicCmdBuffer->end();
 
-		vulkan->submitAndWaitFence((*vulkan->dynamicCmdBuffers)[0], nullptr, nullptr, nullptr);
+		vulkan->submitAndWaitFence(*vulkan->frames[0].dynamicCmdBuffer, nullptr, nullptr, nullptr);
 
 		stagingBuffer.destroy();
 	}
@@ -771,15 +813,7 @@ namespace vm
 	{
 		Image& s_chain_Image = VulkanContext::get()->swapchain.images[imageIndex];
 
-		renderedImage.transitionImageLayout(
-			cmd,
-			vk::ImageLayout::eColorAttachmentOptimal,
-			vk::ImageLayout::eTransferSrcOptimal,
-			vk::PipelineStageFlagBits::eColorAttachmentOutput,
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::AccessFlagBits::eColorAttachmentWrite,
-			vk::AccessFlagBits::eTransferRead,
-			vk::ImageAspectFlagBits::eColor);
+		// the rendered image is already a transfer source, the render graph transitions it
 		s_chain_Image.transitionImageLayout(
 			cmd,
 			vk::ImageLayout::ePresentSrcKHR,
@@ -808,15 +842,6 @@ namespace vm
 			blit,
 			vk::Filter::eLinear);
 
-		renderedImage.transitionImageLayout(
-			cmd,
-			vk::ImageLayout::eTransferSrcOptimal,
-			vk::ImageLayout::eColorAttachmentOptimal,
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::PipelineStageFlagBits::eColorAttachmentOutput,
-			vk::AccessFlagBits::eTransferRead,
-			vk::AccessFlagBits::eColorAttachmentWrite,
-			vk::ImageAspectFlagBits::eColor);
 		s_chain_Image.transitionImageLayout(
 			cmd,
 			vk::ImageLayout::eTransferDstOptimal,
@@ -853,11 +878,13 @@ namespace vm
 
 			cmd.beginRenderPass(rpi, vk::SubpassContents::eInline);
 
-			const vk::DeviceSize offset{ 0 };
+			// the vertices and indices are slices of the uniform ring, in the region of the recorded frame
+			const vk::DeviceSize vertexOffset = vertexBuffer.ringOffset + UniformRing::get()->frameOffset();
+			const vk::DeviceSize indexOffset = indexBuffer.ringOffset + UniformRing::get()->frameOffset();
 			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline.handle);
 			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, *descriptorSet, nullptr);
-			cmd.bindVertexBuffers(0, *vertexBuffer.buffer, offset);
-			cmd.bindIndexBuffer(*indexBuffer.buffer, 0, vk::IndexType::eUint32);
+			cmd.bindVertexBuffers(0, *vertexBuffer.buffer, vertexOffset);
+			cmd.bindIndexBuffer(*indexBuffer.buffer, indexOffset, vk::IndexType::eUint32);
 
 			vk::Viewport viewport;
 			viewport.x = 0.f;
@@ -1095,18 +1122,18 @@ namespace vm
 
 	void GUI::createVertexBuffer(size_t vertex_size)
 	{
-		VulkanContext::get()->graphicsQueue->waitIdle();
+		// the frames in flight read their own region of the ring, the old slice can be given back without waiting
 		vertexBuffer.destroy();
 		//vertexBuffer.createBuffer(vertex_size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-		vertexBuffer.createBuffer(vertex_size, vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostCached | vk::MemoryPropertyFlagBits::eHostVisible);
+		// room to grow, so the slice is not replaced every time the gui gets a bit bigger
+		vertexBuffer.createRingBuffer(vertex_size + vertex_size / 2);
 	}
 
 	void GUI::createIndexBuffer(size_t index_size)
 	{
-		VulkanContext::get()->graphicsQueue->waitIdle();
 		indexBuffer.destroy();
 		//indexBuffer.createBuffer(index_size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-		indexBuffer.createBuffer(index_size, vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostCached | vk::MemoryPropertyFlagBits::eHostVisible);
+		indexBuffer.createRingBuffer(index_size + index_size / 2);
 	}
 
 	void GUI::createDescriptorSet(const vk::DescriptorSetLayout& descriptorSetLayout)
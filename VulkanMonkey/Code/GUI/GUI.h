@@ -75,6 +75,20 @@ namespace vm
 		static inline float									fog_global_thickness = 0.3f;
 		static inline float									fog_max_height = 3.0f;
 		static inline bool									shadow_cast = false;
+		static inline bool									shadow_cache = true;
+		static inline bool									shadow_single_pass = true;
+		static inline bool									use_occlusion_culling = false;
+		static inline int									occluder_triangle_budget = 20000;
+		static inline int									occluded_primitives = 0;
+		static inline bool									use_GPU_culling = false;
+		static inline bool									static_batching = true;
+		static inline int									static_batch_vertices = 16384;
+		static inline bool									use_impostors = true;
+		static inline float									impostor_screen_size = 0.05f; // of the screen height, below it the models are drawn as impostors
+		static inline bool									use_bindless = true;
+		static inline int									recording_threads = 4;
+		static inline bool									cache_secondaries = true;
+		static inline bool									use_render_thread = true;
 		static inline float									sun_intensity = 7.f;
 		static inline std::array<float, 3>					sun_position{ 160.0f, 300.0f, -120.0f };
 		static inline float									fps = 60.0f;
@@ -84,6 +98,17 @@ namespace vm
 		static inline float									cpuTime = 0;
 		static inline float									updatesTime = 0;
 		static inline float									updatesTimeCount = 0;
+		static inline int									jobTasks = 0;
+		static inline int									jobTasksCount = 0;
+		static inline float									jobTime = 0;
+		static inline float									jobTimeCount = 0;
+		static inline float									uploadedKB = 0;
+		static inline float									uploadedKBCount = 0;
+		static inline float									skippedKB = 0;
+		static inline float									skippedKBCount = 0;
+		static inline float									flushedKB = 0;
+		static inline float									flushedKBCount = 0;
+		static inline MemoryAllocator::Stats				memoryStats{};
 		static inline float									cpuWaitingTime = 0;
 		static inline float									timeScale = 1.f;
 		static inline std::array<float, 20>					metrics = {};
@@ -0,0 +1,414 @@
+#include "MemoryHash.h"
+#include "../Culling/FrustumCulling.h"
+#include <immintrin.h>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <functional>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace vm
+{
+	namespace
+	{
+		constexpr uint64_t PRIME32_1 = 0x9E3779B1ull;
+		constexpr uint64_t PRIME32_2 = 0x85EBCA77ull;
+		constexpr uint64_t PRIME32_3 = 0xC2B2AE3Dull;
+		constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+		constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+		constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+		constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+		constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+		constexpr size_t STRIPE = 64;				// bytes consumed by the 8 accumulators at once
+		constexpr size_t STRIPES_PER_BLOCK = 16;	// the accumulators are scrambled after every block
+		constexpr size_t SHORT_MAX = 128;			// up to this size the input is hashed without the accumulators
+
+		// Key words from splitmix64. A stripe uses the 8 words starting at its index in the block,
+		// the scramble, the last stripe and the merges use their own windows
+		struct Secret { uint64_t words[24]; };
+		constexpr Secret MakeSecret()
+		{
+			Secret secret{};
+			uint64_t x = PRIME64_1;
+			for (auto& word : secret.words) {
+				uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				word = z ^ (z >> 31);
+			}
+			return secret;
+		}
+		constexpr Secret secret = MakeSecret();
+		constexpr size_t SCRAMBLE_KEY = 16;
+		constexpr size_t LAST_STRIPE_KEY = 13;
+		constexpr size_t MERGE_LOW_KEY = 1;
+		constexpr size_t MERGE_HIGH_KEY = 12;
+
+		inline uint64_t Read64(const uint8_t* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+		inline uint64_t Read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+		// 64x64 bit multiply, the low half goes in a and the high half in b
+		inline void Mum(uint64_t& a, uint64_t& b)
+		{
+#if defined(_MSC_VER)
+			a = _umul128(a, b, &b);
+#else
+			const __uint128_t r = static_cast<__uint128_t>(a) * b;
+			a = static_cast<uint64_t>(r);
+			b = static_cast<uint64_t>(r >> 64);
+#endif
+		}
+
+		inline uint64_t Mix(uint64_t a, uint64_t b)
+		{
+			Mum(a, b);
+			return a ^ b;
+		}
+
+		inline uint64_t Avalanche(uint64_t h)
+		{
+			h ^= h >> 37;
+			h *= 0x165667919E3779F9ull;
+			h ^= h >> 32;
+			return h;
+		}
+
+		// inputs up to SHORT_MAX bytes, leaves the 128 bit product the digests are made from in a and b
+		void HashShort(const uint8_t* p, size_t len, uint64_t seed, uint64_t& a, uint64_t& b)
+		{
+			const uint64_t* s = secret.words;
+			seed ^= Mix(seed ^ s[0], s[1]);
+
+			if (len <= 16) {
+				if (len >= 4) {
+					const size_t middle = (len >> 3) << 2;
+					a = (Read32(p) << 32) | Read32(p + middle);
+					b = (Read32(p + len - 4) << 32) | Read32(p + len - 4 - middle);
+				}
+				else if (len > 0) {
+					a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+					b = 0;
+				}
+				else {
+					a = b = 0;
+				}
+			}
+			else {
+				size_t i = len;
+				if (i > 48) {
+					uint64_t see1 = seed, see2 = seed;
+					do {
+						seed = Mix(Read64(p) ^ s[1], Read64(p + 8) ^ seed);
+						see1 = Mix(Read64(p + 16) ^ s[2], Read64(p + 24) ^ see1);
+						see2 = Mix(Read64(p + 32) ^ s[3], Read64(p + 40) ^ see2);
+						p += 48;
+						i -= 48;
+					} while (i > 48);
+					seed ^= see1 ^ see2;
+				}
+				while (i > 16) {
+					seed = Mix(Read64(p) ^ s[1], Read64(p + 8) ^ seed);
+					p += 16;
+					i -= 16;
+				}
+				a = Read64(p + i - 16);
+				b = Read64(p + i - 8);
+			}
+
+			a ^= s[1];
+			b ^= seed;
+			Mum(a, b);
+		}
+
+		uint64_t DigestShort64(const uint8_t* p, size_t len, uint64_t seed)
+		{
+			uint64_t a, b;
+			HashShort(p, len, seed, a, b);
+			return Mix(a ^ secret.words[0] ^ len, b ^ secret.words[1]);
+		}
+
+		MemoryHash::Digest128 DigestShort128(const uint8_t* p, size_t len, uint64_t seed)
+		{
+			uint64_t a, b;
+			HashShort(p, len, seed, a, b);
+			return { Mix(a ^ secret.words[0] ^ len, b ^ secret.words[1]), Mix(b ^ secret.words[2] ^ len, a ^ secret.words[3]) };
+		}
+
+		void InitAccumulators(uint64_t* acc, uint64_t seed)
+		{
+			const uint64_t init[8]{ PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+			for (size_t i = 0; i < 8; i++)
+				acc[i] = init[i] + ((i & 1) ? 0 - seed : seed);
+		}
+
+		void AccumulateScalar(uint64_t* acc, const uint8_t* p, const uint64_t* key)
+		{
+			for (size_t i = 0; i < 8; i++) {
+				const uint64_t data = Read64(p + 8 * i);
+				const uint64_t dataKey = data ^ key[i];
+				acc[i ^ 1] += data;
+				acc[i] += (dataKey & 0xFFFFFFFFull) * (dataKey >> 32);
+			}
+		}
+
+		void ScrambleScalar(uint64_t* acc, const uint64_t* key)
+		{
+			for (size_t i = 0; i < 8; i++) {
+				uint64_t a = acc[i];
+				a ^= a >> 47;
+				a ^= key[i];
+				acc[i] = a * PRIME32_1;
+			}
+		}
+
+		// consumes count stripes, stripe is the index of the first one in the whole input and is advanced
+		void ConsumeStripesScalar(uint64_t* acc, const uint8_t* p, size_t count, size_t& stripe)
+		{
+			for (size_t n = 0; n < count; n++, p += STRIPE) {
+				AccumulateScalar(acc, p, secret.words + stripe % STRIPES_PER_BLOCK);
+				if (++stripe % STRIPES_PER_BLOCK == 0)
+					ScrambleScalar(acc, secret.words + SCRAMBLE_KEY);
+			}
+		}
+
+		TARGET_AVX2 inline __m256i AccumulateAVX2(__m256i acc, const uint8_t* p, const uint64_t* key)
+		{
+			const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			const __m256i dataKey = _mm256_xor_si256(data, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key)));
+			// the low 32 bits times the high 32 bits of every lane
+			const __m256i product = _mm256_mul_epu32(dataKey, _mm256_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1)));
+			// every lane gets the data of its neighbour
+			const __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+			return _mm256_add_epi64(product, _mm256_add_epi64(acc, swapped));
+		}
+
+		TARGET_AVX2 inline __m256i ScrambleAVX2(__m256i acc, const uint64_t* key)
+		{
+			const __m256i prime = _mm256_set1_epi32(static_cast<int>(PRIME32_1));
+			const __m256i shifted = _mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47));
+			const __m256i keyed = _mm256_xor_si256(shifted, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key)));
+			// 64 bit lanes times a 32 bit prime, from the two 32 bit halves
+			const __m256i low = _mm256_mul_epu32(keyed, prime);
+			const __m256i high = _mm256_mul_epu32(_mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+			return _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+		}
+
+		TARGET_AVX2 void ConsumeStripesAVX2(uint64_t* acc, const uint8_t* p, size_t count, size_t& stripe)
+		{
+			__m256i acc0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+			__m256i acc1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4));
+
+			for (size_t n = 0; n < count; n++, p += STRIPE) {
+				const uint64_t* key = secret.words + stripe % STRIPES_PER_BLOCK;
+				acc0 = AccumulateAVX2(acc0, p, key);
+				acc1 = AccumulateAVX2(acc1, p + 32, key + 4);
+				if (++stripe % STRIPES_PER_BLOCK == 0) {
+					acc0 = ScrambleAVX2(acc0, secret.words + SCRAMBLE_KEY);
+					acc1 = ScrambleAVX2(acc1, secret.words + SCRAMBLE_KEY + 4);
+				}
+			}
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), acc0);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4), acc1);
+		}
+
+		using ConsumeStripesFunc = void(*)(uint64_t* acc, const uint8_t* p, size_t count, size_t& stripe);
+
+		ConsumeStripesFunc ConsumeStripes()
+		{
+			static const ConsumeStripesFunc func = FrustumCulling::HasAVX2() ? ConsumeStripesAVX2 : ConsumeStripesScalar;
+			return func;
+		}
+
+		// inputs over SHORT_MAX bytes, the last byte is always left for the last stripe
+		void HashLong(const uint8_t* p, size_t len, uint64_t seed, ConsumeStripesFunc consume, uint64_t* acc)
+		{
+			InitAccumulators(acc, seed);
+			size_t stripe = 0;
+			consume(acc, p, (len - 1) / STRIPE, stripe);
+			AccumulateScalar(acc, p + len - STRIPE, secret.words + LAST_STRIPE_KEY);
+		}
+
+		uint64_t MergeAccumulators(const uint64_t* acc, const uint64_t* key, uint64_t start)
+		{
+			uint64_t result = start;
+			for (size_t i = 0; i < 4; i++)
+				result += Mix(acc[2 * i] ^ key[2 * i], acc[2 * i + 1] ^ key[2 * i + 1]);
+			return Avalanche(result);
+		}
+
+		uint64_t DigestLong64(const uint64_t* acc, size_t len, uint64_t seed)
+		{
+			return MergeAccumulators(acc, secret.words + MERGE_LOW_KEY, (len * PRIME64_1) ^ seed);
+		}
+
+		MemoryHash::Digest128 DigestLong128(const uint64_t* acc, size_t len, uint64_t seed)
+		{
+			return {
+				MergeAccumulators(acc, secret.words + MERGE_LOW_KEY, (len * PRIME64_1) ^ seed),
+				MergeAccumulators(acc, secret.words + MERGE_HIGH_KEY, ~(len * PRIME64_2) ^ seed)
+			};
+		}
+
+		// the implementation the new one replaced, kept for the benchmark
+		size_t LegacyHash(const void* data, size_t size)
+		{
+			const size_t* array = static_cast<const size_t*>(data);
+			const size_t arraySize = size / sizeof(size_t);
+			const size_t bytesToFit = size % sizeof(size_t);
+
+			size_t hash = 0;
+			for (size_t i = 0; i < arraySize; i++)
+				hash ^= std::hash<size_t>()(array[i]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+			if (bytesToFit) {
+				size_t lastBytes = 0;
+				memcpy(&lastBytes, &array[arraySize], bytesToFit);
+				hash ^= std::hash<size_t>()(lastBytes) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+			}
+			return hash;
+		}
+	}
+
+	uint64_t MemoryHash::Hash64(const void* data, size_t size, uint64_t seed)
+	{
+		const auto p = static_cast<const uint8_t*>(data);
+		if (size <= SHORT_MAX)
+			return DigestShort64(p, size, seed);
+
+		alignas(32) uint64_t acc[8];
+		HashLong(p, size, seed, ConsumeStripes(), acc);
+		return DigestLong64(acc, size, seed);
+	}
+
+	MemoryHash::Digest128 MemoryHash::Hash128(const void* data, size_t size, uint64_t seed)
+	{
+		const auto p = static_cast<const uint8_t*>(data);
+		if (size <= SHORT_MAX)
+			return DigestShort128(p, size, seed);
+
+		alignas(32) uint64_t acc[8];
+		HashLong(p, size, seed, ConsumeStripes(), acc);
+		return DigestLong128(acc, size, seed);
+	}
+
+	MemoryHash::Stream::Stream(uint64_t seed) : seed(seed)
+	{
+		InitAccumulators(acc, seed);
+	}
+
+	void MemoryHash::Stream::update(const void* data, size_t size)
+	{
+		auto p = static_cast<const uint8_t*>(data);
+		total += size;
+
+		// the buffered data is only consumed once more data follows, the last stripe of the input is left for the digest
+		if (buffered + size <= BUFFER_SIZE) {
+			memcpy(buffer + buffered, p, size);
+			buffered += size;
+			return;
+		}
+		if (buffered) {
+			const size_t fill = BUFFER_SIZE - buffered;
+			memcpy(buffer + buffered, p, fill);
+			p += fill;
+			size -= fill;
+			ConsumeStripes()(acc, buffer, BUFFER_SIZE / STRIPE, stripe);
+			memcpy(lastStripe, buffer + BUFFER_SIZE - STRIPE, STRIPE);
+		}
+		// big updates are consumed in place
+		if (size > BUFFER_SIZE) {
+			const size_t direct = (size - 1) / BUFFER_SIZE * BUFFER_SIZE;
+			ConsumeStripes()(acc, p, direct / STRIPE, stripe);
+			memcpy(lastStripe, p + direct - STRIPE, STRIPE);
+			p += direct;
+			size -= direct;
+		}
+		memcpy(buffer, p, size);
+		buffered = size;
+	}
+
+	void MemoryHash::Stream::finish(uint64_t* accumulators) const
+	{
+		memcpy(accumulators, acc, sizeof(acc));
+		size_t s = stripe;
+		ConsumeStripes()(accumulators, buffer, (buffered - 1) / STRIPE, s);
+
+		// the last stripe may start in the data consumed before the buffer
+		if (buffered >= STRIPE) {
+			AccumulateScalar(accumulators, buffer + buffered - STRIPE, secret.words + LAST_STRIPE_KEY);
+		}
+		else {
+			uint8_t last[STRIPE];
+			memcpy(last, lastStripe + buffered, STRIPE - buffered);
+			memcpy(last + STRIPE - buffered, buffer, buffered);
+			AccumulateScalar(accumulators, last, secret.words + LAST_STRIPE_KEY);
+		}
+	}
+
+	uint64_t MemoryHash::Stream::digest() const
+	{
+		if (total <= SHORT_MAX)
+			return DigestShort64(buffer, total, seed);
+
+		alignas(32) uint64_t accumulators[8];
+		finish(accumulators);
+		return DigestLong64(accumulators, total, seed);
+	}
+
+	MemoryHash::Digest128 MemoryHash::Stream::digest128() const
+	{
+		if (total <= SHORT_MAX)
+			return DigestShort128(buffer, total, seed);
+
+		alignas(32) uint64_t accumulators[8];
+		finish(accumulators);
+		return DigestLong128(accumulators, total, seed);
+	}
+
+	MemoryHash::BenchmarkResult MemoryHash::Benchmark(size_t size, double seconds)
+	{
+		std::vector<uint8_t> data(size);
+		uint64_t x = PRIME64_5;
+		for (auto& byte : data) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			byte = static_cast<uint8_t>(x);
+		}
+
+		// repeats the hash until the time is spent, the results are kept so the calls are not optimized out
+		volatile uint64_t sink = 0;
+		const auto throughput = [&](const std::function<uint64_t()>& hash) {
+			using clock = std::chrono::high_resolution_clock;
+			size_t iterations = 0;
+			const auto start = clock::now();
+			double elapsed = 0.0;
+			do {
+				for (int i = 0; i < 64; i++)
+					sink = sink + hash();
+				iterations += 64;
+				elapsed = std::chrono::duration<double>(clock::now() - start).count();
+			} while (elapsed < seconds);
+			return static_cast<double>(iterations) * static_cast<double>(size) / elapsed / 1e9;
+		};
+
+		const auto hashWith = [&](ConsumeStripesFunc consume) -> uint64_t {
+			if (size <= SHORT_MAX)
+				return DigestShort64(data.data(), size, 0);
+			alignas(32) uint64_t acc[8];
+			HashLong(data.data(), size, 0, consume, acc);
+			return DigestLong64(acc, size, 0);
+		};
+
+		BenchmarkResult result{};
+		result.size = size;
+		result.legacy = throughput([&]() { return static_cast<uint64_t>(LegacyHash(data.data(), size)); });
+		result.scalar = throughput([&]() { return hashWith(ConsumeStripesScalar); });
+		result.avx2 = FrustumCulling::HasAVX2() ? throughput([&]() { return hashWith(ConsumeStripesAVX2); }) : 0.0;
+		return result;
+	}
+}
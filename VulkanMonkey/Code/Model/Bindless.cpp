@@ -0,0 +1,111 @@
+#include "vulkanPCH.h"
+#include "Bindless.h"
+#include "../Core/Image.h"
+#include "MaterialTable.h"
+#include "../Renderer/Pipeline.h"
+#include "../VulkanContext/VulkanContext.h"
+
+namespace vm
+{
+	Bindless::Bindless()
+	{
+		descriptorPool = make_ref(vk::DescriptorPool());
+		descriptorSet = make_ref(vk::DescriptorSet());
+	}
+
+	void Bindless::Init()
+	{
+		auto vulkan = VulkanContext::get();
+		enabled = vulkan->supportsDescriptorIndexing;
+		if (!enabled)
+			return;
+
+		// textures of models loaded later are written while the set is used by frames in flight
+		std::vector<vk::DescriptorPoolSize> poolSizes{
+			{ vk::DescriptorType::eCombinedImageSampler, MAX_TEXTURES },
+			{ vk::DescriptorType::eStorageBuffer, 1 }
+		};
+		vk::DescriptorPoolCreateInfo poolInfo;
+		poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = 1;
+		descriptorPool = make_ref(vulkan->device->createDescriptorPool(poolInfo));
+
+		vk::DescriptorSetAllocateInfo allocateInfo;
+		allocateInfo.descriptorPool = *descriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &Pipeline::getDescriptorSetLayoutBindless();
+		descriptorSet = make_ref(vulkan->device->allocateDescriptorSets(allocateInfo).at(0));
+
+		const Buffer& materials = MaterialTable::get()->getBuffer();
+		vk::DescriptorBufferInfo dbi{ *materials.buffer, 0, materials.size };
+		vk::WriteDescriptorSet write{ *descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &dbi, nullptr };
+		vulkan->device->updateDescriptorSets(write, nullptr);
+	}
+
+	void Bindless::destroy()
+	{
+		auto vulkan = VulkanContext::get();
+
+		textures.clear();
+		textureIndices.clear();
+		freeIndices.clear();
+
+		if (*descriptorPool) {
+			vulkan->device->destroyDescriptorPool(*descriptorPool);
+			*descriptorPool = nullptr;
+		}
+		*descriptorSet = nullptr;
+		if (Pipeline::getDescriptorSetLayoutBindless()) {
+			vulkan->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutBindless());
+			Pipeline::getDescriptorSetLayoutBindless() = nullptr;
+		}
+		enabled = false;
+	}
+
+	uint32_t Bindless::addTexture(const Image& image)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		// the copies of an image share its view object, a handle value could be given again to a later view
+		const auto it = textureIndices.find(image.view.get());
+		if (it != textureIndices.end()) {
+			textures[it->second].references++;
+			return it->second;
+		}
+
+		uint32_t index;
+		if (!freeIndices.empty()) {
+			index = freeIndices.back();
+			freeIndices.pop_back();
+		}
+		else {
+			index = static_cast<uint32_t>(textures.size());
+			if (index >= MAX_TEXTURES)
+				throw std::runtime_error("Bindless texture array is full");
+			textures.emplace_back();
+		}
+		textures[index] = { image.view, 1 };
+		textureIndices[image.view.get()] = index;
+
+		// a freed index still holds the descriptor of the texture it had
+		vk::DescriptorImageInfo dii{ *image.sampler, *image.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+		vk::WriteDescriptorSet write{ *descriptorSet, 0, index, 1, vk::DescriptorType::eCombinedImageSampler, &dii, nullptr, nullptr };
+		VulkanContext::get()->device->updateDescriptorSets(write, nullptr);
+
+		return index;
+	}
+
+	void Bindless::removeTexture(uint32_t index)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		Texture& texture = textures.at(index);
+		if (!texture.references || --texture.references)
+			return;
+		textureIndices.erase(texture.view.get());
+		texture.view = nullptr;
+		freeIndices.push_back(index);
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "../Core/Base.h"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vk
+{
+	class DescriptorPool;
+	class DescriptorSet;
+	class ImageView;
+}
+
+namespace vm
+{
+	class Image;
+
+	// All the material textures in one partially bound descriptor array and the material table, in a single set that
+	// is bound once per command buffer. A draw only pushes the index of its material.
+	// Needs descriptor indexing, without it the per primitive descriptor sets are used.
+	class Bindless
+	{
+	public:
+		static constexpr uint32_t MAX_TEXTURES = 4096;
+
+		void Init();
+		void destroy();
+		bool supported() const { return enabled; }
+
+		// Index of the texture in the array, it is added the first time it is seen and counted every time
+		uint32_t addTexture(const Image& image);
+		// Gives back an index of addTexture, the last one frees it for another texture. The frames that may
+		// sample it must be done.
+		void removeTexture(uint32_t index);
+		const Ref<vk::DescriptorSet>& getDescriptorSet() const { return descriptorSet; }
+
+	private:
+		bool enabled = false;
+		Ref<vk::DescriptorPool> descriptorPool;
+		Ref<vk::DescriptorSet> descriptorSet;
+		struct Texture
+		{
+			Ref<vk::ImageView> view; // shared by the copies of the image, kept so its address is not reused
+			uint32_t references = 0;
+		};
+		std::vector<Texture> textures{};
+		std::unordered_map<const vk::ImageView*, uint32_t> textureIndices{}; // image view, index
+		std::vector<uint32_t> freeIndices{};
+		std::mutex mutex;
+
+	public:
+		static auto get() noexcept { static auto b = new Bindless(); return b; }
+		static auto remove() noexcept { using type = decltype(get()); if (std::is_pointer<type>::value) delete get(); }
+
+		Bindless(Bindless const&) = delete;					// copy constructor
+		Bindless(Bindless&&) noexcept = delete;				// move constructor
+		Bindless& operator=(Bindless const&) = delete;		// copy assignment
+		Bindless& operator=(Bindless&&) = delete;			// move assignment
+	private:
+		Bindless();											// default constructor
+		~Bindless() = default;								// destructor
+	};
+}
@@ -0,0 +1,110 @@
+#include "vulkanPCH.h"
+#include "GeometryPool.h"
+#include "../VulkanContext/VulkanContext.h"
+
+namespace vm
+{
+	void GeometryPool::Init()
+	{
+		vertices.createBuffer(
+			MAX_VERTICES * sizeof(Vertex),
+			vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		indices.createBuffer(
+			MAX_INDICES * sizeof(uint32_t),
+			vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		vertexRanges.reset(MAX_VERTICES);
+		indexRanges.reset(MAX_INDICES);
+		vertexCount = 0;
+		indexCount = 0;
+	}
+
+	void GeometryPool::destroy()
+	{
+		vertices.destroy();
+		indices.destroy();
+		vertexRanges.reset(0);
+		indexRanges.reset(0);
+		vertexCount = 0;
+		indexCount = 0;
+	}
+
+	uint32_t GeometryPool::addVertices(const std::vector<Vertex>& data)
+	{
+		if (data.empty())
+			return 0;
+
+		const uint32_t count = static_cast<uint32_t>(data.size());
+		uint32_t first;
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			first = vertexRanges.allocate(count);
+		}
+		if (first == UINT32_MAX)
+			throw std::runtime_error("Geometry pool is out of vertices");
+		vertexCount += count;
+
+		upload(vertices, data.data(), count * sizeof(Vertex), first * sizeof(Vertex));
+		return first;
+	}
+
+	uint32_t GeometryPool::addIndices(const std::vector<uint32_t>& data)
+	{
+		if (data.empty())
+			return 0;
+
+		const uint32_t count = static_cast<uint32_t>(data.size());
+		uint32_t first;
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			first = indexRanges.allocate(count);
+		}
+		if (first == UINT32_MAX)
+			throw std::runtime_error("Geometry pool is out of indices");
+		indexCount += count;
+
+		upload(indices, data.data(), count * sizeof(uint32_t), first * sizeof(uint32_t));
+		return first;
+	}
+
+	void GeometryPool::freeVertices(uint32_t first, uint32_t count)
+	{
+		if (!count)
+			return;
+
+		std::lock_guard<std::mutex> guard(mutex);
+		vertexRanges.free(first, count);
+		vertexCount -= count;
+	}
+
+	void GeometryPool::freeIndices(uint32_t first, uint32_t count)
+	{
+		if (!count)
+			return;
+
+		std::lock_guard<std::mutex> guard(mutex);
+		indexRanges.free(first, count);
+		indexCount -= count;
+	}
+
+	void GeometryPool::bind(const vk::CommandBuffer& cmd) const
+	{
+		const vk::DeviceSize offset{ 0 };
+		cmd.bindVertexBuffers(0, 1, &*vertices.buffer, &offset);
+		cmd.bindIndexBuffer(*indices.buffer, 0, vk::IndexType::eUint32);
+	}
+
+	void GeometryPool::upload(Buffer& buffer, const void* data, size_t size, size_t offset)
+	{
+		Buffer staging;
+		staging.createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible);
+		staging.map();
+		staging.copyData(data, size);
+		staging.flush();
+		staging.unmap();
+
+		buffer.copyBuffer(*staging.buffer, size, offset);
+		staging.destroy();
+	}
+}
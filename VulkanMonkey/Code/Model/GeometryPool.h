@@ -0,0 +1,63 @@
+#pragma once
+#include "../Core/Buffer.h"
+#include "../Core/RangeAllocator.h"
+#include "../Core/Vertex.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace vk
+{
+	class CommandBuffer;
+}
+
+namespace vm
+{
+	// The vertices and the indices of every model in two device local buffers, bound once per pass. A model gets a
+	// range of each when it is loaded and gives them back when it is unloaded, the freed ranges are reused by the
+	// next loads. The meshes keep the first vertex and index of their data in the pool, so the draws offset into it.
+	class GeometryPool
+	{
+	public:
+		static constexpr uint32_t MAX_VERTICES = 2 * 1024 * 1024;
+		static constexpr uint32_t MAX_INDICES = 8 * 1024 * 1024;
+
+		void Init();
+		void destroy();
+
+		// First vertex/index of the range the data is copied to
+		uint32_t addVertices(const std::vector<Vertex>& vertices);
+		uint32_t addIndices(const std::vector<uint32_t>& indices);
+		// The gpu must be done with the ranges, the next loads may overwrite them
+		void freeVertices(uint32_t first, uint32_t count);
+		void freeIndices(uint32_t first, uint32_t count);
+
+		void bind(const vk::CommandBuffer& cmd) const;
+		// used vertices and indices, for the metrics
+		uint32_t getVertexCount() const { return vertexCount; }
+		uint32_t getIndexCount() const { return indexCount; }
+
+	private:
+		Buffer vertices;
+		Buffer indices;
+		RangeAllocator vertexRanges;
+		RangeAllocator indexRanges;
+		std::atomic<uint32_t> vertexCount{ 0 };
+		std::atomic<uint32_t> indexCount{ 0 };
+		std::mutex mutex;
+
+		void upload(Buffer& buffer, const void* data, size_t size, size_t offset);
+
+	public:
+		static auto get() noexcept { static auto gp = new GeometryPool(); return gp; }
+		static auto remove() noexcept { using type = decltype(get()); if (std::is_pointer<type>::value) delete get(); }
+
+		GeometryPool(GeometryPool const&) = delete;				// copy constructor
+		GeometryPool(GeometryPool&&) noexcept = delete;			// move constructor
+		GeometryPool& operator=(GeometryPool const&) = delete;	// copy assignment
+		GeometryPool& operator=(GeometryPool&&) = delete;		// move assignment
+	private:
+		GeometryPool() = default;								// default constructor
+		~GeometryPool() = default;								// destructor
+	};
+}
@@ -0,0 +1,373 @@
+#include "vulkanPCH.h"
+#include "Impostors.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "GeometryPool.h"
+#include "../Core/UniformRing.h"
+#include "../Renderer/FrameConstants.h"
+#include "../Renderer/RenderSnapshot.h"
+#include "../Shader/Shader.h"
+#include "../VulkanContext/VulkanContext.h"
+
+namespace vm
+{
+	// push constants of impostor.vert
+	struct ImpostorPush
+	{
+		vec4 sphere;
+		uint32_t model;
+		float blend;
+		uint32_t dummy[2];
+	};
+
+	Impostors::Impostors()
+	{
+		bakeDescriptorSet = make_ref(vk::DescriptorSet());
+	}
+
+	void Impostors::Init(std::map<std::string, Image>& renderTargets, const RenderPass& gBufferRenderPass)
+	{
+		auto vulkan = VulkanContext::get();
+
+		// the targets of the G-buffer pass, its shaders bake the views as they would draw the model
+		formats = {
+			*renderTargets["depth"].format,
+			*renderTargets["normal"].format,
+			*renderTargets["albedo"].format,
+			*renderTargets["srm"].format,
+			*renderTargets["velocity"].format,
+			*renderTargets["emissive"].format
+		};
+		renderPass.Create(formats, *vulkan->depth.format);
+
+		velocity.format = make_ref(formats[4]);
+		velocity.initialLayout = make_ref(vk::ImageLayout::eUndefined);
+		velocity.createImage(SIZE, SIZE, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		velocity.createImageView(vk::ImageAspectFlagBits::eColor);
+
+		depth.format = make_ref(*vulkan->depth.format);
+		depth.initialLayout = make_ref(vk::ImageLayout::eUndefined);
+		depth.createImage(SIZE, SIZE, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		depth.createImageView(vk::ImageAspectFlagBits::eDepth);
+
+		// an orthographic camera per cell, the unit sphere fills its view and its depth goes from 0 (back) to 1 (front)
+		const size_t alignment = static_cast<size_t>(vulkan->gpuProperties->limits.minUniformBufferOffsetAlignment);
+		viewStride = (sizeof(FrameConstants::View) + alignment - 1) / alignment * alignment;
+		const mat4 projection(
+			1.f, 0.f, 0.f, 0.f,
+			0.f, -1.f, 0.f, 0.f,
+			0.f, 0.f, .5f, 0.f,
+			0.f, 0.f, .5f, 1.f
+		);
+		std::vector<uint8_t> data(GRID * GRID * viewStride, 0);
+		for (uint32_t y = 0; y < GRID; y++) {
+			for (uint32_t x = 0; x < GRID; x++) {
+				vec3 right, up;
+				const vec3 direction = cellDirection(x, y);
+				cellBasis(direction, right, up);
+
+				FrameConstants::View view;
+				view.view = lookAt(vec3(0.f), direction, right, up);
+				view.projection = projection;
+				view.previousView = view.view;
+				view.previousProjection = projection;
+				view.jitter = vec4(0.f);
+				memcpy(&data[(y * GRID + x) * viewStride], &view, sizeof(view));
+			}
+		}
+		views.createBuffer(data.size(), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		views.map();
+		views.copyData(data.data(), data.size());
+		views.flush();
+		views.unmap();
+
+		// the frame set of the bakes, the cameras of the cells and the transforms of the frame
+		vk::DescriptorSetAllocateInfo allocateInfo;
+		allocateInfo.descriptorPool = *vulkan->descriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &Pipeline::getDescriptorSetLayoutFrame();
+		bakeDescriptorSet = make_ref(vulkan->device->allocateDescriptorSets(allocateInfo).at(0));
+
+		const Buffer& transforms = FrameConstants::get()->getTransforms();
+		vk::DescriptorBufferInfo dbiView{ *views.buffer, 0, sizeof(FrameConstants::View) };
+		vk::DescriptorBufferInfo dbiTransforms{ *transforms.buffer, transforms.ringOffset, transforms.size };
+		std::vector<vk::WriteDescriptorSet> writeSets{
+			{ *bakeDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &dbiView, nullptr },
+			{ *bakeDescriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBufferDynamic, nullptr, &dbiTransforms, nullptr }
+		};
+		vulkan->device->updateDescriptorSets(writeSets, nullptr);
+
+		createPipelines(renderTargets, gBufferRenderPass);
+	}
+
+	void Impostors::createPipelines(std::map<std::string, Image>& renderTargets, const RenderPass& gBufferRenderPass)
+	{
+		const auto colorBlendAttachments = make_ref(std::vector<vk::PipelineColorBlendAttachmentState>
+		{
+			*renderTargets["depth"].blentAttachment,
+			*renderTargets["normal"].blentAttachment,
+			*renderTargets["albedo"].blentAttachment,
+			*renderTargets["srm"].blentAttachment,
+			*renderTargets["velocity"].blentAttachment,
+			*renderTargets["emissive"].blentAttachment,
+		});
+
+		// the G-buffer shaders, the cells are the viewports of the draws and both faces are kept
+		Shader vertBake{ "shaders/Deferred/gBuffer.vert", ShaderType::Vertex, true };
+		Shader fragBake{ "shaders/Deferred/gBuffer.frag", ShaderType::Fragment, true };
+
+		pipelineBake.info.pVertShader = &vertBake;
+		pipelineBake.info.pFragShader = &fragBake;
+		pipelineBake.info.vertexInputBindingDescriptions = make_ref(Vertex::getBindingDescriptionGeneral());
+		pipelineBake.info.vertexInputAttributeDescriptions = make_ref(Vertex::getAttributeDescriptionGeneral());
+		pipelineBake.info.width = static_cast<float>(SIZE);
+		pipelineBake.info.height = static_cast<float>(SIZE);
+		pipelineBake.info.cullMode = CullMode::None;
+		pipelineBake.info.colorBlendAttachments = colorBlendAttachments;
+		pipelineBake.info.dynamicStates = make_ref(std::vector<vk::DynamicState>{ vk::DynamicState::eViewport, vk::DynamicState::eScissor });
+		pipelineBake.info.descriptorSetLayouts = make_ref(std::vector<vk::DescriptorSetLayout>
+		{
+			Pipeline::getDescriptorSetLayoutMesh(),
+			Pipeline::getDescriptorSetLayoutPrimitive(),
+			Pipeline::getDescriptorSetLayoutFrame()
+		});
+		pipelineBake.info.renderPass = renderPass;
+		pipelineBake.info.pushConstantStage = PushConstantStage::Vertex;
+		pipelineBake.info.pushConstantSize = 3 * sizeof(uint32_t);
+
+		pipelineBake.createGraphicsPipeline();
+
+		// one quad per impostor in the G-buffer pass
+		Shader vert{ "shaders/Deferred/impostor.vert", ShaderType::Vertex, true };
+		Shader frag{ "shaders/Deferred/impostor.frag", ShaderType::Fragment, true };
+
+		pipeline.info.pVertShader = &vert;
+		pipeline.info.pFragShader = &frag;
+		pipeline.info.width = renderTargets["albedo"].width_f;
+		pipeline.info.height = renderTargets["albedo"].height_f;
+		pipeline.info.cullMode = CullMode::None;
+		pipeline.info.colorBlendAttachments = colorBlendAttachments;
+		pipeline.info.descriptorSetLayouts = make_ref(std::vector<vk::DescriptorSetLayout>
+		{
+			Pipeline::getDescriptorSetLayoutImpostor(),
+			Pipeline::getDescriptorSetLayoutFrame()
+		});
+		pipeline.info.renderPass = gBufferRenderPass;
+		pipeline.info.pushConstantStage = PushConstantStage::Vertex;
+		pipeline.info.pushConstantSize = sizeof(ImpostorPush);
+
+		pipeline.createGraphicsPipeline();
+	}
+
+	void Impostors::destroyPipelines()
+	{
+		pipelineBake.destroy();
+		pipeline.destroy();
+	}
+
+	void Impostors::destroy()
+	{
+		destroyPipelines();
+		renderPass.Destroy();
+		velocity.destroy();
+		depth.destroy();
+		views.destroy();
+		*bakeDescriptorSet = nullptr;
+		draws.clear();
+
+		if (Pipeline::getDescriptorSetLayoutImpostor()) {
+			VulkanContext::get()->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutImpostor());
+			Pipeline::getDescriptorSetLayoutImpostor() = nullptr;
+		}
+	}
+
+	ImpostorAtlas* Impostors::createAtlas()
+	{
+		auto vulkan = VulkanContext::get();
+		auto atlas = new ImpostorAtlas();
+
+		// the G-buffer targets but the velocity, in the order of the render pass
+		Image* images[] = { &atlas->depth, &atlas->normal, &atlas->albedo, &atlas->srm, &atlas->emissive };
+		const vk::Format imageFormats[] = { formats[0], formats[1], formats[2], formats[3], formats[5] };
+		for (uint32_t i = 0; i < 5; i++) {
+			Image& image = *images[i];
+			image.format = make_ref(imageFormats[i]);
+			image.initialLayout = make_ref(vk::ImageLayout::eUndefined);
+			image.createImage(SIZE, SIZE, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
+			image.createImageView(vk::ImageAspectFlagBits::eColor);
+			// a texel is never mixed with the empty ones around the model or with the next cell
+			image.filter = make_ref(vk::Filter::eNearest);
+			image.samplerMipmapMode = make_ref(vk::SamplerMipmapMode::eNearest);
+			image.addressMode = make_ref(vk::SamplerAddressMode::eClampToEdge);
+			image.anisotropyEnabled = VK_FALSE;
+			image.maxAnisotropy = 1.f;
+			image.createSampler();
+		}
+
+		const std::vector<vk::ImageView> attachments{
+			*atlas->depth.view,
+			*atlas->normal.view,
+			*atlas->albedo.view,
+			*atlas->srm.view,
+			*velocity.view,
+			*atlas->emissive.view,
+			*depth.view
+		};
+		atlas->framebuffer.Create(SIZE, SIZE, attachments, renderPass);
+
+		vk::DescriptorSetAllocateInfo allocateInfo;
+		allocateInfo.descriptorPool = *vulkan->descriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &Pipeline::getDescriptorSetLayoutImpostor();
+		atlas->descriptorSet = make_ref(vulkan->device->allocateDescriptorSets(allocateInfo).at(0));
+
+		const auto imageInfo = [](const Image& image) {
+			return vk::DescriptorImageInfo{ *image.sampler, *image.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+		};
+		const std::vector<vk::DescriptorImageInfo> dsii{
+			imageInfo(atlas->albedo),
+			imageInfo(atlas->normal),
+			imageInfo(atlas->depth),
+			imageInfo(atlas->srm),
+			imageInfo(atlas->emissive)
+		};
+		std::vector<vk::WriteDescriptorSet> writeSets(dsii.size());
+		for (uint32_t i = 0; i < writeSets.size(); i++)
+			writeSets[i] = { *atlas->descriptorSet, i, 0, 1, vk::DescriptorType::eCombinedImageSampler, &dsii[i], nullptr, nullptr };
+		vulkan->device->updateDescriptorSets(writeSets, nullptr);
+
+		return atlas;
+	}
+
+	void Impostors::destroyAtlas(ImpostorAtlas* atlas)
+	{
+		atlas->framebuffer.Destroy();
+		atlas->albedo.destroy();
+		atlas->normal.destroy();
+		atlas->depth.destroy();
+		atlas->srm.destroy();
+		atlas->emissive.destroy();
+		delete atlas;
+	}
+
+	float Impostors::blend(const ModelSnapshot& model, const RenderSnapshot& frame) const
+	{
+		return frame.settings.useImpostors && model.render && model.impostor && model.impostor->baked ? model.impostorBlend : 0.f;
+	}
+
+	void Impostors::bake(vk::CommandBuffer cmd, const RenderSnapshot& frame)
+	{
+		// one model a frame, the scratch targets are shared. The meshes must be updated for the frame, the bake
+		// reads their matrices and the one of the model's second transform slot.
+		for (auto& model : frame.models) {
+			if (!model.impostor || model.impostor->baked || !model.render || model.impostorSphere.w <= 0.f)
+				continue;
+			ImpostorAtlas& atlas = *model.impostor;
+
+			vk::ClearDepthStencilValue depthStencil;
+			depthStencil.depth = 0.f;
+			depthStencil.stencil = 0;
+			// the depth of 0 marks the texels the model does not cover
+			std::vector<vk::ClearValue> clearValues(formats.size(), vk::ClearValue());
+			clearValues.push_back(depthStencil);
+
+			vk::RenderPassBeginInfo rpi;
+			rpi.renderPass = *renderPass.handle;
+			rpi.framebuffer = *atlas.framebuffer.handle;
+			rpi.renderArea.offset = vk::Offset2D{ 0, 0 };
+			rpi.renderArea.extent = vk::Extent2D{ SIZE, SIZE };
+			rpi.clearValueCount = static_cast<uint32_t>(clearValues.size());
+			rpi.pClearValues = clearValues.data();
+
+			cmd.beginRenderPass(rpi, vk::SubpassContents::eInline);
+
+			const vk::PipelineLayout& layout = *pipelineBake.layout;
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipelineBake.handle);
+			GeometryPool::get()->bind(cmd);
+			const uint32_t dynamicOffset = UniformRing::get()->frameOffset();
+			// the second slot of the model takes its bounding sphere to the unit sphere, every fragment is kept
+			const struct { uint32_t slot; float coverage; } push{ model.transformSlot + 1, 1.f };
+			cmd.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, sizeof(uint32_t), sizeof(push), &push);
+
+			for (uint32_t y = 0; y < GRID; y++) {
+				for (uint32_t x = 0; x < GRID; x++) {
+					const vk::Viewport viewport{ static_cast<float>(x * CELL), static_cast<float>(y * CELL), static_cast<float>(CELL), static_cast<float>(CELL), 0.f, 1.f };
+					const vk::Rect2D scissor{ vk::Offset2D{ static_cast<int32_t>(x * CELL), static_cast<int32_t>(y * CELL) }, vk::Extent2D{ CELL, CELL } };
+					cmd.setViewport(0, viewport);
+					cmd.setScissor(0, scissor);
+					const uint32_t viewOffset = static_cast<uint32_t>((y * GRID + x) * viewStride);
+					cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 2, *bakeDescriptorSet, { viewOffset, dynamicOffset });
+
+					const Mesh* boundMesh = nullptr;
+					for (auto& p : model.primitives) {
+						if (!p.render)
+							continue;
+						const Mesh& mesh = *p.mesh;
+						const Primitive& primitive = *p.primitive;
+						if (boundMesh != &mesh) {
+							cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, *mesh.descriptorSet, dynamicOffset);
+							boundMesh = &mesh;
+						}
+						cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 1, *primitive.descriptorSet, nullptr);
+						cmd.pushConstants<uint32_t>(layout, vk::ShaderStageFlagBits::eVertex, 0, primitive.materialIndex);
+						cmd.drawIndexed(primitive.indicesSize, 1, mesh.indexOffset + primitive.indexOffset, mesh.vertexOffset + primitive.vertexOffset, 0);
+					}
+				}
+			}
+
+			cmd.endRenderPass();
+
+			atlas.albedo.changeLayout(cmd, LayoutState::ColorRead);
+			atlas.normal.changeLayout(cmd, LayoutState::ColorRead);
+			atlas.depth.changeLayout(cmd, LayoutState::ColorRead);
+			atlas.srm.changeLayout(cmd, LayoutState::ColorRead);
+			atlas.emissive.changeLayout(cmd, LayoutState::ColorRead);
+			atlas.baked = true;
+			return;
+		}
+	}
+
+	void Impostors::collect(const RenderSnapshot& frame)
+	{
+		draws.clear();
+		for (auto& model : frame.models) {
+			const float b = blend(model, frame);
+			if (b > 0.f)
+				draws.push_back({ model.impostor, model.impostorSphere, model.transformSlot, b });
+		}
+	}
+
+	void Impostors::draw(const vk::CommandBuffer& cmd) const
+	{
+		if (draws.empty())
+			return;
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline.handle);
+		FrameConstants::get()->bind(cmd, *pipeline.layout, 1);
+		for (const auto& draw : draws) {
+			const ImpostorPush push{ draw.sphere, draw.slot, draw.blend, { 0, 0 } };
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, *draw.atlas->descriptorSet, nullptr);
+			cmd.pushConstants(*pipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(push), &push);
+			cmd.draw(6, 1, 0, 0);
+		}
+	}
+
+	vec3 Impostors::cellDirection(uint32_t x, uint32_t y)
+	{
+		// octahedral map with y up, the center of the cell is decoded
+		const float fx = (static_cast<float>(x) + .5f) / static_cast<float>(GRID) * 2.f - 1.f;
+		const float fy = (static_cast<float>(y) + .5f) / static_cast<float>(GRID) * 2.f - 1.f;
+		vec3 n(fx, 1.f - abs(fx) - abs(fy), fy);
+		const float t = maximum(-n.y, 0.f);
+		n.x += n.x >= 0.f ? -t : t;
+		n.z += n.z >= 0.f ? -t : t;
+		return normalize(n);
+	}
+
+	void Impostors::cellBasis(cvec3& direction, vec3& right, vec3& up)
+	{
+		const vec3 reference = abs(direction.y) > .999f ? vec3(0.f, 0.f, 1.f) : vec3(0.f, 1.f, 0.f);
+		right = normalize(cross(reference, direction));
+		up = cross(direction, right);
+	}
+}
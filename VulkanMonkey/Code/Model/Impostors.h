@@ -0,0 +1,101 @@
+#pragma once
+#include "../Core/Buffer.h"
+#include "../Core/Image.h"
+#include "../Core/Math.h"
+#include "../Renderer/Framebuffer.h"
+#include "../Renderer/Pipeline.h"
+#include "../Renderer/RenderPass.h"
+#include <map>
+#include <vector>
+
+namespace vk
+{
+	class CommandBuffer;
+	class DescriptorSet;
+	enum class Format;
+}
+
+namespace vm
+{
+	struct ModelSnapshot;
+	struct RenderSnapshot;
+
+	// The views of a model, a cell of every atlas per direction of the octahedral map
+	struct ImpostorAtlas
+	{
+		Image albedo, normal, depth, srm, emissive;
+		Framebuffer framebuffer;
+		Ref<vk::DescriptorSet> descriptorSet;
+		bool baked = false;
+	};
+
+	// Impostors of the distant models. After it is loaded, a model is rendered with the G-buffer shaders from the
+	// GRID x GRID directions of an octahedral map around its bounding sphere, in the albedo, normal, depth, srm and
+	// emissive atlases. When its bounding sphere covers less than GUI::impostor_screen_size of the screen height it
+	// is drawn as a single quad facing the camera, with the view of the closest direction, that writes the G-buffer
+	// like the meshes would (the depth is rebuilt from the baked one). The meshes and the quad are dithered over a
+	// band of sizes, so the switch crossfades.
+	class Impostors
+	{
+	public:
+		static constexpr uint32_t GRID = 8;			// views per side of the octahedral map
+		static constexpr uint32_t CELL = 64;		// texels per side of a view
+		static constexpr uint32_t SIZE = GRID * CELL;
+		static constexpr float FADE_BAND = .25f;	// the crossfade starts at the threshold size and ends this much below it
+
+		// a visible impostor of the frame
+		struct Draw
+		{
+			const ImpostorAtlas* atlas;
+			vec4 sphere;	// model space, the views are fitted to it
+			uint32_t slot;	// transform slot of the model
+			float blend;	// 0: only the meshes, 1: only the impostor
+		};
+
+		void Init(std::map<std::string, Image>& renderTargets, const RenderPass& gBufferRenderPass);
+		void createPipelines(std::map<std::string, Image>& renderTargets, const RenderPass& gBufferRenderPass);
+		void destroyPipelines();
+		void destroy();
+
+		// The atlases of a model being loaded, they are baked on the render thread once it is updated
+		ImpostorAtlas* createAtlas();
+		void destroyAtlas(ImpostorAtlas* atlas);
+
+		// How much of the model the impostor draws in the rendered frame, 0 until its atlas is baked
+		float blend(const ModelSnapshot& model, const RenderSnapshot& frame) const;
+		// Renders the atlases of one model that has none yet, must be outside of a render pass
+		void bake(vk::CommandBuffer cmd, const RenderSnapshot& frame);
+		// The impostors the G-buffer pass draws after the meshes
+		void collect(const RenderSnapshot& frame);
+		void draw(const vk::CommandBuffer& cmd) const;
+		const std::vector<Draw>& getDraws() const { return draws; }
+
+		// the direction a cell is rendered from, decoded as impostor.vert does, and the axes of its view
+		static vec3 cellDirection(uint32_t x, uint32_t y);
+		static void cellBasis(cvec3& direction, vec3& right, vec3& up);
+
+	private:
+		std::vector<vk::Format> formats{};
+		RenderPass renderPass;
+		Image velocity;	// the bakes have no use for them, the targets are shared
+		Image depth;
+		Buffer views;	// the camera of every cell, looking at the unit sphere
+		size_t viewStride = 0;
+		Ref<vk::DescriptorSet> bakeDescriptorSet;
+		Pipeline pipelineBake;
+		Pipeline pipeline;
+		std::vector<Draw> draws{};
+
+	public:
+		static auto get() noexcept { static auto imp = new Impostors(); return imp; }
+		static auto remove() noexcept { using type = decltype(get()); if (std::is_pointer<type>::value) delete get(); }
+
+		Impostors(Impostors const&) = delete;				// copy constructor
+		Impostors(Impostors&&) noexcept = delete;			// move constructor
+		Impostors& operator=(Impostors const&) = delete;	// copy assignment
+		Impostors& operator=(Impostors&&) = delete;			// move assignment
+	private:
+		Impostors();										// default constructor
+		~Impostors() = default;								// destructor
+	};
+}
@@ -0,0 +1,116 @@
+#include "vulkanPCH.h"
+#include "MaterialTable.h"
+#include "../MemoryHash/MemoryHash.h"
+#include "../VulkanContext/VulkanContext.h"
+#include <algorithm>
+
+namespace vm
+{
+	void MaterialTable::Init()
+	{
+		table.createBuffer(
+			MAX_MATERIALS * sizeof(Material),
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		materials.reserve(1024);
+	}
+
+	void MaterialTable::destroy()
+	{
+		table.destroy();
+		materials.clear();
+		references.clear();
+		lookup.clear();
+		freeIndices.clear();
+		pending.clear();
+		count = 0;
+		requested = 0;
+	}
+
+	uint32_t MaterialTable::add(const Material& material)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		requested++;
+
+		auto& candidates = lookup[MemoryHash(material).getHash()];
+		for (uint32_t index : candidates) {
+			if (!memcmp(&materials[index], &material, sizeof(Material))) {
+				references[index]++;
+				return index;
+			}
+		}
+
+		uint32_t index;
+		if (!freeIndices.empty()) {
+			index = freeIndices.back();
+			freeIndices.pop_back();
+			materials[index] = material;
+			references[index] = 1;
+		}
+		else {
+			if (materials.size() >= MAX_MATERIALS)
+				throw std::runtime_error("Material table is full");
+			index = static_cast<uint32_t>(materials.size());
+			materials.push_back(material);
+			references.push_back(1);
+		}
+		candidates.push_back(index);
+		pending.push_back(index);
+		count++;
+		return index;
+	}
+
+	void MaterialTable::release(uint32_t index)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (!references.at(index) || --references[index])
+			return;
+
+		// the material can not be found by its contents anymore, its index goes to the next new one
+		const size_t hash = MemoryHash(materials[index]).getHash();
+		auto& candidates = lookup[hash];
+		candidates.erase(std::remove(candidates.begin(), candidates.end(), index), candidates.end());
+		if (candidates.empty())
+			lookup.erase(hash);
+		freeIndices.push_back(index);
+		count--;
+	}
+
+	MaterialTable::Material MaterialTable::getMaterial(uint32_t index)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return materials.at(index);
+	}
+
+	void MaterialTable::upload()
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (pending.empty())
+			return;
+
+		// only the new materials are copied, in runs of consecutive indices, the ones frames in flight may read are
+		// not touched (a reused index was released once they were done)
+		std::sort(pending.begin(), pending.end());
+		pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+		for (size_t first = 0, last; first < pending.size(); first = last) {
+			for (last = first + 1; last < pending.size() && pending[last] == pending[last - 1] + 1; last++);
+
+			const size_t offset = pending[first] * sizeof(Material);
+			const size_t size = (last - first) * sizeof(Material);
+
+			Buffer staging;
+			staging.createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible);
+			staging.map();
+			staging.copyData(&materials[pending[first]], size);
+			staging.flush();
+			staging.unmap();
+
+			table.copyBuffer(*staging.buffer, size, offset);
+			staging.destroy();
+		}
+		pending.clear();
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "../Core/Buffer.h"
+#include "../Core/Math.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vm
+{
+	// The PBR parameters of every primitive of the scene in one device local storage buffer. Materials with the same
+	// contents are stored once and counted, a primitive keeps the index of its material and pushes it with its draw.
+	// The index of a released material is reused by the next new one.
+	class MaterialTable
+	{
+	public:
+		static constexpr uint32_t MAX_MATERIALS = 16384;
+
+		// std430 layout of the Material struct of gBuffer.vert
+		struct Material
+		{
+			vec4 baseColorFactor;
+			vec4 emissiveFactor;
+			vec4 factors;			// metallic, roughness, alpha cutoff, occlusion
+			uint32_t textures[5];	// bindless indices of base color, metallic roughness, normal, occlusion, emissive
+			float hasBones;
+			float dummy[2];
+		};
+
+		void Init();
+		void destroy();
+
+		// Index of the material with the same contents, it is added when it is new
+		uint32_t add(const Material& material);
+		// Gives back an index of add, the last one frees it. The frames that may read it must be done.
+		void release(uint32_t index);
+		// The contents of the material at the index
+		Material getMaterial(uint32_t index);
+		// Copies the materials added since the last upload to the table
+		void upload();
+
+		const Buffer& getBuffer() const { return table; }
+		// unique materials in use and materials added, for the metrics
+		uint32_t getCount() const { return count; }
+		uint32_t getRequested() const { return requested; }
+
+	private:
+		Buffer table;
+		std::vector<Material> materials{};
+		std::vector<uint32_t> references{};
+		std::unordered_map<size_t, std::vector<uint32_t>> lookup{}; // content hash, indices of the materials
+		std::vector<uint32_t> freeIndices{};
+		std::vector<uint32_t> pending{}; // indices added since the last upload
+		std::atomic<uint32_t> count{ 0 };
+		std::atomic<uint32_t> requested{ 0 };
+		std::mutex mutex;
+
+	public:
+		static auto get() noexcept { static auto mt = new MaterialTable(); return mt; }
+		static auto remove() noexcept { using type = decltype(get()); if (std::is_pointer<type>::value) delete get(); }
+
+		MaterialTable(MaterialTable const&) = delete;				// copy constructor
+		MaterialTable(MaterialTable&&) noexcept = delete;			// move constructor
+		MaterialTable& operator=(MaterialTable const&) = delete;	// copy assignment
+		MaterialTable& operator=(MaterialTable&&) = delete;		// move assignment
+	private:
+		MaterialTable() = default;									// default constructor
+		~MaterialTable() = default;									// destructor
+	};
+}
@@ -3,6 +3,8 @@
 #include "../Renderer/Pipeline.h"
 #include "../../include/tinygltf/stb_image.h"
 #include "../VulkanContext/VulkanContext.h"
+#include "MaterialTable.h"
+#include "Bindless.h"
 
 namespace vm
 {
@@ -28,26 +30,28 @@ namespace vm
 
 	void Mesh::createUniformBuffers()
 	{
-		uniformBuffer.createBuffer(sizeof(ubo), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		uniformBuffer.createRingBuffer(sizeof(ubo));
 		uniformBuffer.map();
 		uniformBuffer.zero();
 		uniformBuffer.flush();
 		uniformBuffer.unmap();
 
+		// the primitives share the entries of the material table, the textures are in the bindless array when it is used
 		for (auto& primitive : primitives) {
-
-			mat4 factors;
-			factors[0] = primitive.pbrMaterial.baseColorFactor != vec4(0.f) ? primitive.pbrMaterial.baseColorFactor : vec4(1.f);
-			factors[1] = vec4(primitive.pbrMaterial.emissiveFactor, 1.f);
-			factors[2] = vec4(primitive.pbrMaterial.metallicFactor, primitive.pbrMaterial.roughnessFactor, primitive.pbrMaterial.alphaCutoff, 0.f);
-			factors[3][0] = static_cast<float>(primitive.hasBones);
-
-			const size_t size = sizeof(mat4);
-			primitive.uniformBuffer.createBuffer(size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
-			primitive.uniformBuffer.map();
-			primitive.uniformBuffer.copyData(&factors);
-			primitive.uniformBuffer.flush();
-			primitive.uniformBuffer.unmap();
+			auto& pbr = primitive.pbrMaterial;
+			MaterialTable::Material material{};
+			material.baseColorFactor = pbr.baseColorFactor != vec4(0.f) ? pbr.baseColorFactor : vec4(1.f);
+			material.emissiveFactor = vec4(pbr.emissiveFactor, 1.f);
+			material.factors = vec4(pbr.metallicFactor, pbr.roughnessFactor, pbr.alphaCutoff, 0.f);
+			if (Bindless::get()->supported()) {
+				material.textures[0] = Bindless::get()->addTexture(pbr.baseColorTexture);
+				material.textures[1] = Bindless::get()->addTexture(pbr.metallicRoughnessTexture);
+				material.textures[2] = Bindless::get()->addTexture(pbr.normalTexture);
+				material.textures[3] = Bindless::get()->addTexture(pbr.occlusionTexture);
+				material.textures[4] = Bindless::get()->addTexture(pbr.emissiveTexture);
+			}
+			material.hasBones = static_cast<float>(primitive.hasBones);
+			primitive.materialIndex = MaterialTable::get()->add(material);
 		}
 	}
 
@@ -161,15 +165,23 @@ namespace vm
 
 	void Mesh::destroy()
 	{
+		// the materials and the bindless indices of their textures are given back, the model is unloaded once the gpu is idle
+		for (auto& primitive : primitives) {
+			if (primitive.materialIndex == UINT32_MAX)
+				continue;
+			if (Bindless::get()->supported()) {
+				for (uint32_t texture : MaterialTable::get()->getMaterial(primitive.materialIndex).textures)
+					Bindless::get()->removeTexture(texture);
+			}
+			MaterialTable::get()->release(primitive.materialIndex);
+			primitive.materialIndex = UINT32_MAX;
+		}
 		uniformBuffer.destroy();
 		if (Pipeline::getDescriptorSetLayoutMesh()) {
 			VulkanContext::get()->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutMesh());
 			Pipeline::getDescriptorSetLayoutMesh() = nullptr;
 		}
 
-		for (auto& primitive : primitives) {
-			primitive.uniformBuffer.destroy();
-		}
 		vertices.clear();
 		vertices.shrink_to_fit();
 		indices.clear();
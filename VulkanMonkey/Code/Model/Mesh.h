@@ -23,9 +23,10 @@ namespace vm
 		~Primitive();
 
 		Ref<vk::DescriptorSet> descriptorSet;
-		Buffer uniformBuffer;
 
-		bool render = true, cull = true;
+		bool render = true;
+		uint32_t cullIndex = 0; // index to the model's culling bounds and visibility bits
+		uint32_t materialIndex = UINT32_MAX; // index to the material table, pushed with the draw, set with the mesh uniforms
 		uint32_t vertexOffset = 0, indexOffset = 0;
 		uint32_t verticesSize = 0, indicesSize = 0;
 		PBRMaterial pbrMaterial;
@@ -3,12 +3,24 @@
 #include "Mesh.h"
 #include "../Core/Queue.h"
 #include "../Renderer/Pipeline.h"
+#include "../Culling/GPUCulling.h"
 #include <iostream>
-#include <future>
+#include "../Core/JobSystem.h"
 #include <deque>
+#include <map>
+#include <set>
 #include <GLTFSDK/GLBResourceReader.h>
 #include <GLTFSDK/Deserialize.h>
+#include <GLTFSDK/RapidJsonUtils.h>
 #include "../VulkanContext/VulkanContext.h"
+#include "Bindless.h"
+#include "MaterialTable.h"
+#include "../Renderer/FrameConstants.h"
+#include "GeometryPool.h"
+#include "../Renderer/RenderQueue.h"
+#include "../Renderer/RenderSnapshot.h"
+#include "../GUI/GUI.h"
+#include "Impostors.h"
 
 #undef max
 
@@ -16,16 +28,13 @@ namespace vm
 {
 	using namespace Microsoft;
 
-	Ref<vk::CommandBuffer> Model::commandBuffer = make_ref(vk::CommandBuffer());
 	std::vector<Model> Model::models{};
 	Pipeline* Model::pipeline = nullptr;
+	Pipeline* Model::pipelineBindless = nullptr;
+	GPUCulling* Model::gpuCulling = nullptr;
 
 	Model::Model()
 	{
-		if (commandBuffer == nullptr)
-			commandBuffer = make_ref(vk::CommandBuffer());
-
-		descriptorSet = make_ref(vk::DescriptorSet());
 	}
 
 	Model::~Model()
@@ -189,6 +198,44 @@ namespace vm
 		}
 	}
 
+	// EXT_mesh_gpu_instancing, the TRS of every instance of the node (float accessors only)
+	std::vector<mat4> Model::getInstanceData(const glTF::Node& node) const
+	{
+		const auto extension = node.extensions.find("EXT_mesh_gpu_instancing");
+		if (extension == node.extensions.end())
+			return {};
+
+		glTF::rapidjson::Document json;
+		json.Parse(extension->second.c_str());
+		if (json.HasParseError() || !json.IsObject() || !json.HasMember("attributes"))
+			return {};
+
+		const glTF::rapidjson::Value& attributes = json["attributes"];
+		const auto readAttribute = [&](const char* name) -> std::vector<float> {
+			if (!attributes.HasMember(name))
+				return {};
+			const auto& accessor = document->accessors.Get(std::to_string(attributes[name].GetUint()));
+			if (accessor.componentType != glTF::COMPONENT_FLOAT) {
+				std::cout << "EXT_mesh_gpu_instancing: " << name << " is not float, skipping it" << std::endl;
+				return {};
+			}
+			return resourceReader->ReadBinaryData<float>(*document, accessor);
+		};
+		const std::vector<float> translations = readAttribute("TRANSLATION");
+		const std::vector<float> rotations = readAttribute("ROTATION");
+		const std::vector<float> scales = readAttribute("SCALE");
+		const size_t count = std::max(std::max(translations.size() / 3, rotations.size() / 4), scales.size() / 3);
+
+		std::vector<mat4> matrices(count);
+		for (size_t i = 0; i < count; i++) {
+			const vec3 t = i * 3 < translations.size() ? vec3(&translations[i * 3]) : vec3(0.f);
+			const quat r = i * 4 < rotations.size() ? quat(&rotations[i * 4]) : quat();
+			const vec3 s = i * 3 < scales.size() ? vec3(&scales[i * 3]) : vec3(1.f);
+			matrices[i] = vm::transform(r, s, t);
+		}
+		return matrices;
+	}
+
 	void Model::getMesh(Pointer<vm::Node>& node, const std::string& meshID, const std::string& folderPath)
 	{
 		if (!node || meshID.empty()) return;
@@ -292,17 +339,242 @@ namespace vm
 		}
 	}
 
-	void Model::loadModel(const std::string& folderPath, const std::string& modelName, bool show)
+	void Model::loadInstances(uint32_t instances)
+	{
+		uint32_t meshNodes = 0;
+		for (auto& node : linearNodes)
+			meshNodes += node->mesh ? 1 : 0;
+
+		for (auto& node : linearNodes) {
+			if (!node->mesh || node->index >= document->nodes.Size())
+				continue;
+			std::vector<mat4> matrices = getInstanceData(document->nodes.Elements()[node->index]);
+			if (matrices.empty())
+				continue;
+			// the whole model is instanced, so only the instances of its single mesh node can be
+			if (meshNodes > 1) {
+				std::cout << "EXT_mesh_gpu_instancing: " << name << " has more than one mesh node, skipping the instances of " << node->name << std::endl;
+				continue;
+			}
+			// the instances are placed in the space of the node, under its matrix
+			const mat4 global = node->getMatrix();
+			const mat4 inverseGlobal = inverse(global);
+			for (auto& matrix : matrices)
+				matrix = global * matrix * inverseGlobal;
+			instanceMatrices = std::move(matrices);
+		}
+		if (!instanceMatrices.empty() || instances < 2)
+			return;
+
+		// the copies a script asks for are laid out on a grid, a model apart
+		calculateBoundingSphere();
+		const float spacing = 2.f * boundingSphere.w;
+		const uint32_t side = static_cast<uint32_t>(ceil(sqrt(static_cast<float>(instances))));
+		instanceMatrices.resize(instances);
+		for (uint32_t i = 0; i < instances; i++)
+			instanceMatrices[i] = translate(mat4::identity(), vec3(static_cast<float>(i % side), 0.f, static_cast<float>(i / side)) * spacing);
+	}
+
+	void Model::batchStaticPrimitives(uint32_t clusterVertices)
+	{
+		// the nodes the animations move, a node is static when neither it nor a parent of it is one of them
+		std::set<Node*> animated{};
+		for (auto& animation : animations)
+			for (auto& channel : animation.channels)
+				animated.insert(channel.node.get());
+		const auto isStatic = [&animated](Pointer<Node> node) {
+			for (; node; node = node->parent)
+				if (animated.count(node.get()))
+					return false;
+			return true;
+		};
+
+		// the small opaque or masked primitives of the static meshes, the blended ones keep their own depth order
+		struct Candidate
+		{
+			Node* node;
+			uint32_t primitive;
+			mat4 matrix;
+			vec3 center;
+		};
+		std::vector<Candidate> candidates{};
+		vec3 low(FLT_MAX), high(-FLT_MAX);
+		for (auto& node : linearNodes) {
+			if (!node->mesh || node->skin || !isStatic(node))
+				continue;
+			const mat4 matrix = node->getMatrix();
+			auto& primitives = node->mesh->primitives;
+			for (uint32_t i = 0; i < primitives.size(); i++) {
+				const Primitive& primitive = primitives[i];
+				if (primitive.hasBones || primitive.pbrMaterial.alphaMode == 3 || primitive.verticesSize > clusterVertices / 2)
+					continue;
+				const vec3 center(matrix * vec4(vec3(primitive.boundingSphere), 1.f));
+				candidates.push_back({ node.get(), i, matrix, center });
+				low = minimum(low, center);
+				high = maximum(high, center);
+			}
+		}
+		if (candidates.size() < 2)
+			return;
+
+		// grouped by material and by cell of a grid over the model, a cluster never spans cells so it is still culled
+		// close to where its primitives are
+		const vec3 extent = high - low;
+		const float cellSize = maximum(maximum(extent.x, extent.y), maximum(extent.z, FLT_EPSILON)) / static_cast<float>(BATCH_GRID_CELLS);
+		std::map<std::vector<size_t>, std::vector<const Candidate*>> groups{};
+		for (auto& candidate : candidates) {
+			const PBRMaterial& material = candidate.node->mesh->primitives[candidate.primitive].pbrMaterial;
+			const vec3 cell = (candidate.center - low) / cellSize;
+			std::vector<size_t> key{
+				static_cast<size_t>(cell.x), static_cast<size_t>(cell.y), static_cast<size_t>(cell.z),
+				reinterpret_cast<size_t>(material.baseColorTexture.view.get()),
+				reinterpret_cast<size_t>(material.metallicRoughnessTexture.view.get()),
+				reinterpret_cast<size_t>(material.normalTexture.view.get()),
+				reinterpret_cast<size_t>(material.occlusionTexture.view.get()),
+				reinterpret_cast<size_t>(material.emissiveTexture.view.get()),
+				material.alphaMode, material.doubleSided
+			};
+			const float factors[]{
+				material.baseColorFactor.x, material.baseColorFactor.y, material.baseColorFactor.z, material.baseColorFactor.w,
+				material.emissiveFactor.x, material.emissiveFactor.y, material.emissiveFactor.z,
+				material.metallicFactor, material.roughnessFactor, material.alphaCutoff
+			};
+			for (float factor : factors) {
+				uint32_t bits;
+				memcpy(&bits, &factor, sizeof(bits));
+				key.push_back(bits);
+			}
+			groups[key].push_back(&candidate);
+		}
+
+		// the vertices are moved to the batch pre-transformed, so the pool holds as many vertices as before
+		Pointer<vm::Node> batchNode = new vm::Node{};
+		batchNode->index = UINT32_MAX;
+		batchNode->name = "static batch";
+		batchNode->mesh = new Mesh();
+		Mesh& batch = *batchNode->mesh.get();
+		std::map<Mesh*, std::vector<bool>> batched{};
+		uint32_t merged = 0;
+
+		const auto addCluster = [&](const Candidate* const* members, size_t count) {
+			Primitive primitive;
+			primitive.pbrMaterial = members[0]->node->mesh->primitives[members[0]->primitive].pbrMaterial;
+			primitive.vertexOffset = static_cast<uint32_t>(batch.vertices.size());
+			primitive.indexOffset = static_cast<uint32_t>(batch.indices.size());
+			primitive.min = vec3(FLT_MAX);
+			primitive.max = vec3(-FLT_MAX);
+			for (size_t m = 0; m < count; m++) {
+				Mesh& mesh = *members[m]->node->mesh.get();
+				const Primitive& source = mesh.primitives[members[m]->primitive];
+				const mat4& matrix = members[m]->matrix;
+				const mat4 normalMatrix = transpose(inverse(matrix));
+				const uint32_t base = static_cast<uint32_t>(batch.vertices.size()) - primitive.vertexOffset;
+				for (uint32_t v = 0; v < source.verticesSize; v++) {
+					Vertex vertex = mesh.vertices[source.vertexOffset + v];
+					vertex.position = vec3(matrix * vec4(vertex.position, 1.f));
+					const vec3 normal(normalMatrix * vec4(vertex.normals, 0.f));
+					vertex.normals = lengthSquared(normal) > 0.f ? normalize(normal) : normal;
+					primitive.min = minimum(primitive.min, vertex.position);
+					primitive.max = maximum(primitive.max, vertex.position);
+					batch.vertices.push_back(vertex);
+				}
+				for (uint32_t i = 0; i < source.indicesSize; i++)
+					batch.indices.push_back(mesh.indices[source.indexOffset + i] + base);
+
+				auto& flags = batched[&mesh];
+				flags.resize(mesh.primitives.size());
+				flags[members[m]->primitive] = true;
+			}
+			primitive.verticesSize = static_cast<uint32_t>(batch.vertices.size()) - primitive.vertexOffset;
+			primitive.indicesSize = static_cast<uint32_t>(batch.indices.size()) - primitive.indexOffset;
+			primitive.calculateBoundingSphere();
+			batch.primitives.push_back(primitive);
+			merged += static_cast<uint32_t>(count);
+		};
+
+		for (auto& group : groups) {
+			auto& members = group.second;
+			size_t first = 0;
+			uint32_t vertices = 0;
+			for (size_t m = 0; m <= members.size(); m++) {
+				const uint32_t size = m < members.size() ? members[m]->node->mesh->primitives[members[m]->primitive].verticesSize : 0;
+				if (m == members.size() || vertices + size > clusterVertices) {
+					// a cluster of one primitive would only move it
+					if (m - first > 1)
+						addCluster(&members[first], m - first);
+					first = m;
+					vertices = 0;
+				}
+				vertices += size;
+			}
+		}
+		if (batch.primitives.empty()) {
+			delete batchNode->mesh.get();
+			delete batchNode.get();
+			return;
+		}
+
+		// the meshes keep the vertices and indices of the primitives that were not merged
+		for (auto& node : linearNodes) {
+			if (!node->mesh || !batched.count(node->mesh.get()))
+				continue;
+			Mesh& mesh = *node->mesh.get();
+			const auto& flags = batched[&mesh];
+			std::vector<Primitive> primitives{};
+			std::vector<Vertex> vertices{};
+			std::vector<uint32_t> indices{};
+			for (size_t i = 0; i < mesh.primitives.size(); i++) {
+				if (i < flags.size() && flags[i])
+					continue;
+				Primitive primitive = mesh.primitives[i];
+				vertices.insert(vertices.end(), mesh.vertices.begin() + primitive.vertexOffset, mesh.vertices.begin() + primitive.vertexOffset + primitive.verticesSize);
+				indices.insert(indices.end(), mesh.indices.begin() + primitive.indexOffset, mesh.indices.begin() + primitive.indexOffset + primitive.indicesSize);
+				primitive.vertexOffset = static_cast<uint32_t>(vertices.size()) - primitive.verticesSize;
+				primitive.indexOffset = static_cast<uint32_t>(indices.size()) - primitive.indicesSize;
+				primitives.push_back(primitive);
+			}
+			if (primitives.empty()) {
+				delete node->mesh.get();
+				node->mesh = {};
+				continue;
+			}
+			mesh.primitives = std::move(primitives);
+			mesh.vertices = std::move(vertices);
+			mesh.indices = std::move(indices);
+		}
+		linearNodes.push_back(batchNode);
+		std::cout << name << ": " << merged << " static primitives batched in " << batch.primitives.size() << std::endl;
+	}
+
+	void Model::loadModel(const std::string& folderPath, const std::string& modelName, bool show, uint32_t instances, uint32_t batchVertices, bool createImpostor)
 	{
 		loadModelGltf(folderPath, modelName, show);
-		//calculateBoundingSphere();
 		name = modelName;
+		loadInstances(instances);
+		if (batchVertices)
+			batchStaticPrimitives(batchVertices);
+		//calculateBoundingSphere();
+		uint32_t cullIndex = 0;
+		for (auto& node : linearNodes) {
+			if (node->mesh) {
+				for (auto& primitive : node->mesh->primitives)
+					primitive.cullIndex = cullIndex++;
+			}
+		}
+		cullingBounds.resize(cullIndex);
+		visibility.resize(cullIndex);
+		for (auto& cascadeVisibility : shadowVisibility)
+			cascadeVisibility.resize(cullIndex);
+		instanceBounds.resize(instanceMatrices.size());
+		instanceVisibility.resize(instanceMatrices.size());
 		fullPathName = folderPath + modelName;
 		render = show;
 		createVertexBuffer();
 		createIndexBuffer();
 		createUniformBuffers();
 		createDescriptorSets();
+		if (createImpostor && !isInstanced())
+			impostor = Impostors::get()->createAtlas();
 	}
 
 	void Model::updateAnimation(uint32_t index, float time)
@@ -346,13 +618,17 @@ namespace vm
 		}
 	}
 
-	void frustumCheckAsync(Model& model, Pointer<Mesh>& mesh, Camera& camera, uint32_t index)
+	void updateBoundsAsync(Model& model, Pointer<Mesh>& mesh, uint32_t index)
 	{
-		cmat4 trans = model.ubo.matrix * mesh->ubo.matrix;
-		vec4 bs = trans * vec4(vec3(mesh->primitives[index].boundingSphere), 1.0f);
-		bs.w = mesh->primitives[index].boundingSphere.w * abs(trans.scale().x); // scale 
-		mesh->primitives[index].cull = !camera.SphereInFrustum(bs);
-		mesh->primitives[index].transformedBS = bs;
+		Primitive& primitive = mesh->primitives[index];
+		mat4 trans = model.ubo.matrix * mesh->ubo.matrix;
+		vec4 bs = trans * vec4(vec3(primitive.boundingSphere), 1.0f);
+		bs.w = primitive.boundingSphere.w * abs(trans.scale().x); // scale 
+		primitive.transformedBS = bs;
+
+		vec3 boxCenter, boxExtents;
+		FrustumCulling::TransformAABB(trans, primitive.min, primitive.max, boxCenter, boxExtents);
+		model.cullingBounds.set(primitive.cullIndex, bs, boxCenter, boxExtents);
 	}
 
 	void updateNodeAsync(Model& model, Pointer<Node>& node, Camera& camera)
@@ -362,15 +638,12 @@ namespace vm
 
 			// async calls should be at least bigger than a number, else this will be slower
 			if (node->mesh->primitives.size() > 3) {
-				std::vector<std::future<void>> futures(node->mesh->primitives.size());
-				for (uint32_t i = 0; i < node->mesh->primitives.size(); i++)
-					futures[i] = std::async(std::launch::async, frustumCheckAsync, model, node->mesh, camera, i);
-				for (auto& f : futures)
-					f.get();
+				auto updateBounds = [&model, &node](uint32_t i) { updateBoundsAsync(model, node->mesh, i); };
+				JobSystem::get()->Wait(JobSystem::get()->parallel_for(static_cast<uint32_t>(node->mesh->primitives.size()), 1, updateBounds));
 			}
 			else {
 				for (uint32_t i = 0; i < node->mesh->primitives.size(); i++)
-					frustumCheckAsync(model, node->mesh, camera, i);
+					updateBoundsAsync(model, node->mesh, i);
 			}
 		}
 	}
@@ -379,9 +652,6 @@ namespace vm
 	{
 		if (render) {
 			ubo.previousMatrix = ubo.matrix;
-			ubo.view = camera.view;
-			ubo.previousView = camera.previousView;
-			ubo.projection = camera.projection;
 			if (script) {
 				script->update(static_cast<float>(delta));
 				ubo.matrix = script->getValue<Transform>("transform").matrix * transform;
@@ -390,11 +660,8 @@ namespace vm
 				ubo.matrix = transform;
 			}
 			ubo.matrix = vm::transform(quat(radians(rot)), scale, pos) * ubo.matrix;
-			Queue::memcpyRequest(&uniformBuffer, { { &ubo, sizeof(ubo), 0 } });
-			//uniformBuffer.map();
-			//memcpy(uniformBuffer.data, &ubo, sizeof(ubo));
-			//uniformBuffer.flush();
-			//uniformBuffer.unmap();
+			if (!isInstanced())
+				FrameConstants::get()->updateTransform(transformSlot, ubo.matrix, ubo.previousMatrix);
 
 			if (!animations.empty()) {
 				animationTimer += static_cast<float>(delta);
@@ -406,64 +673,160 @@ namespace vm
 
 			// async calls should be at least bigger than a number, else this will be slower
 			if (linearNodes.size() > 3) {
-				std::vector<std::future<void>> futureNodes(linearNodes.size());
-				for (uint32_t i = 0; i < linearNodes.size(); i++)
-					futureNodes[i] = std::async(std::launch::async, updateNodeAsync, *this, linearNodes[i], camera);
-				for (auto& f : futureNodes)
-					f.get();
+				auto updateNode = [this, &camera](uint32_t i) { updateNodeAsync(*this, linearNodes[i], camera); };
+				JobSystem::get()->Wait(JobSystem::get()->parallel_for(static_cast<uint32_t>(linearNodes.size()), 1, updateNode));
 			}
 			else {
 				for (auto& linearNode : linearNodes)
 					updateNodeAsync(*this, linearNode, camera);
 			}
+
+			// all the primitive bounds are in world space now, test them 8 at a time against the camera frustum
+			FrustumCulling::Cull(cullingBounds, camera.frustum.data(), static_cast<uint32_t>(camera.frustum.size()), visibility);
+
+			if (isInstanced())
+				updateInstances(camera);
+			else if (impostor)
+				updateImpostor(camera);
 		}
 	}
 
-	void Model::draw()
+	void Model::updateInstances(Camera& camera)
 	{
-		if (!render || !Model::pipeline)
-			return;
+		// the sphere of the primitives is placed at every instance
+		const vec4 localSphere = localBoundingSphere();
+		const vec4 center(vec3(localSphere), 1.f);
+		const float radius = localSphere.w;
+
+		// every instance casts shadows, they are all in the first slots
+		const uint32_t count = instanceCount();
+		for (uint32_t i = 0; i < count; i++) {
+			const mat4 matrix = ubo.matrix * instanceMatrices[i];
+			const vec4 sphere(vec3(matrix * center), radius * abs(matrix.scale().x));
+			instanceBounds.set(i, sphere, vec3(sphere), vec3(sphere.w));
+			FrameConstants::get()->updateTransform(transformSlot + i, matrix, ubo.previousMatrix * instanceMatrices[i]);
+		}
+		FrustumCulling::Cull(instanceBounds, camera.frustum.data(), static_cast<uint32_t>(camera.frustum.size()), instanceVisibility);
 
-		auto& cmd = Model::commandBuffer;
-		const vk::DeviceSize offset{ 0 };
-		cmd->bindPipeline(vk::PipelineBindPoint::eGraphics, *Model::pipeline->handle);
-		cmd->bindVertexBuffers(0, 1, &*vertexBuffer.buffer, &offset);
-		cmd->bindIndexBuffer(*indexBuffer.buffer, 0, vk::IndexType::eUint32);
+		// the visible ones are compacted after them, one draw per primitive covers them with its instance count
+		uint32_t visible = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			if (instanceVisibility.test(i))
+				FrameConstants::get()->updateTransform(transformSlot + count + visible++, ubo.matrix * instanceMatrices[i], ubo.previousMatrix * instanceMatrices[i]);
+		}
+		visibleInstances = visible;
+	}
 
-		//ALPHA_OPAQUE
-		for (auto& node : linearNodes) {
-			if (node->mesh) {
-				for (auto& primitive : node->mesh->primitives) {
-					if (primitive.render && !primitive.cull && primitive.pbrMaterial.alphaMode == 1) {
-						cmd->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *Model::pipeline->layout, 0, { *node->mesh->descriptorSet, *primitive.descriptorSet, *descriptorSet }, nullptr);
-						cmd->drawIndexed(primitive.indicesSize, 1, node->mesh->indexOffset + primitive.indexOffset, node->mesh->vertexOffset + primitive.vertexOffset, 0);
-					}
-				}
-			}
+	void Model::updateImpostor(Camera& camera)
+	{
+		// the views are baked around the sphere of the first update, the second slot takes it to the unit sphere
+		if (impostorSphere.w <= 0.f) {
+			if (!cullingBounds.size())
+				return;
+			impostorSphere = localBoundingSphere();
+			const float invRadius = 1.f / impostorSphere.w;
+			const mat4 bake = vm::transform(quat::identity(), vec3(invRadius), vec3(impostorSphere) * -invRadius);
+			FrameConstants::get()->updateTransform(transformSlot + 1, bake, bake);
 		}
-		// ALPHA_MASK
-		for (auto& node : linearNodes) {
-			if (node->mesh) {
-				for (auto& primitive : node->mesh->primitives) {
-					// ALPHA CUT
-					if (primitive.render && !primitive.cull && primitive.pbrMaterial.alphaMode == 2) {
-						cmd->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *Model::pipeline->layout, 0, { *node->mesh->descriptorSet, *primitive.descriptorSet, *descriptorSet }, nullptr);
-						cmd->drawIndexed(primitive.indicesSize, 1, node->mesh->indexOffset + primitive.indexOffset, node->mesh->vertexOffset + primitive.vertexOffset, 0);
-					}
-				}
+
+		// the share of the screen height the sphere covers, the impostor fades in below the threshold
+		const vec3 center(ubo.matrix * vec4(vec3(impostorSphere), 1.f));
+		const float radius = impostorSphere.w * abs(ubo.matrix.scale().x);
+		const float distance = length(center - camera.position);
+		impostorBlend = 0.f;
+		if (GUI::use_impostors && distance > radius && camera.SphereInFrustum(vec4(center, radius))) {
+			const float size = radius / (distance * tan(radians(camera.FOV) * .5f));
+			const float threshold = GUI::impostor_screen_size;
+			impostorBlend = clamp((threshold - size) / (threshold * Impostors::FADE_BAND), 0.f, 1.f);
+		}
+	}
+
+	vec4 Model::localBoundingSphere() const
+	{
+		// a sphere around the world bounds, taken back to model space
+		vec3 low(FLT_MAX), high(-FLT_MAX);
+		for (size_t i = 0; i < cullingBounds.size(); i++) {
+			const vec3 center(cullingBounds.centerX[i], cullingBounds.centerY[i], cullingBounds.centerZ[i]);
+			low = minimum(low, center - vec3(cullingBounds.radius[i]));
+			high = maximum(high, center + vec3(cullingBounds.radius[i]));
+		}
+		const vec4 center = inverse(ubo.matrix) * vec4((low + high) * .5f, 1.f);
+		return vec4(vec3(center), length(high - low) * .5f / abs(ubo.matrix.scale().x));
+	}
+
+	void Model::collectDraws(RenderQueue& queue, const ModelSnapshot& model, float coverage)
+	{
+		// fully replaced by its impostor
+		if (!model.render || coverage <= 0.f)
+			return;
+
+		// the instances are culled on their own, the bounds of the primitives only cover the model matrix
+		if (model.instanced && !model.visibleInstances)
+			return;
+		const uint32_t slot = model.instanced ? model.transformSlot + model.instanceCount : model.transformSlot;
+		const uint32_t instances = model.instanced ? model.visibleInstances : 1;
+
+		// the gpu culling draws a group of primitives with one call, recorded with the binds of its first primitive
+		const bool groups = Model::gpuCulling && !model.instanced;
+		const CullingBounds& bounds = model.cullingBounds;
+		for (uint32_t i = 0; i < model.primitives.size(); i++) {
+			const PrimitiveSnapshot& p = model.primitives[i];
+			if (groups ? p.cullGroupSize > 0 : p.render && (model.instanced || model.visibility.test(i))) {
+				const vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+				const uint32_t cullFirst = groups ? model.cullSlot + p.cullGroup : 0;
+				const uint32_t cullCount = groups ? p.cullGroupSize : 0;
+				queue.add({ p.mesh, p.primitive, slot, instances, coverage, cullFirst, cullCount, 0 }, p.primitive->pbrMaterial.alphaMode, p.primitive->materialIndex, slot, center);
 			}
 		}
-		// ALPHA_BLEND
-		for (auto& node : linearNodes) {
-			if (node->mesh) {
-				for (auto& primitive : node->mesh->primitives) {
-					// ALPHA CUT
-					if (primitive.render && !primitive.cull && primitive.pbrMaterial.alphaMode == 3) {
-						cmd->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *Model::pipeline->layout, 0, { *node->mesh->descriptorSet, *primitive.descriptorSet, *descriptorSet }, nullptr);
-						cmd->drawIndexed(primitive.indicesSize, 1, node->mesh->indexOffset + primitive.indexOffset, node->mesh->vertexOffset + primitive.vertexOffset, 0);
-					}
-				}
+	}
+
+	void Model::drawList(const vk::CommandBuffer& cmd, const PrimitiveDraw* draws, uint32_t count)
+	{
+		if (!Model::pipeline || !count)
+			return;
+
+		const Pipeline& pipeline = Model::pipelineBindless ? *Model::pipelineBindless : *Model::pipeline;
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline.handle);
+		const uint32_t dynamicOffset = UniformRing::get()->frameOffset();
+		FrameConstants::get()->bind(cmd, *pipeline.layout, 2);
+		GeometryPool::get()->bind(cmd);
+		if (Model::pipelineBindless)
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 1, *Bindless::get()->getDescriptorSet(), nullptr);
+
+		// the draws come sorted by state, only what changed from the previous draw is bound or pushed
+		uint32_t pushedSlot = UINT32_MAX;
+		float pushedCoverage = -1.f;
+		const Mesh* boundMesh = nullptr;
+		const Primitive* boundPrimitive = nullptr;
+		uint32_t pushedMaterial = UINT32_MAX;
+		for (uint32_t i = 0; i < count; i++) {
+			Mesh& mesh = *draws[i].mesh;
+			Primitive& primitive = *draws[i].primitive;
+			// the coverage is the same for all the draws of a model
+			if (pushedSlot != draws[i].slot || pushedCoverage != draws[i].coverage) {
+				const struct { uint32_t slot; float coverage; } push{ draws[i].slot, draws[i].coverage };
+				cmd.pushConstants(*pipeline.layout, vk::ShaderStageFlagBits::eVertex, sizeof(uint32_t), sizeof(push), &push);
+				pushedSlot = draws[i].slot;
+				pushedCoverage = draws[i].coverage;
 			}
+			if (boundMesh != &mesh) {
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, *mesh.descriptorSet, dynamicOffset);
+				boundMesh = &mesh;
+			}
+			// without bindless the textures are in the set of the primitive
+			if (!Model::pipelineBindless && boundPrimitive != &primitive) {
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 1, *primitive.descriptorSet, nullptr);
+				boundPrimitive = &primitive;
+			}
+			if (pushedMaterial != primitive.materialIndex) {
+				cmd.pushConstants<uint32_t>(*pipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, primitive.materialIndex);
+				pushedMaterial = primitive.materialIndex;
+			}
+			// the instanced models are left out of the gpu culling, their visible instances are already compacted
+			if (draws[i].cullCount)
+				Model::gpuCulling->drawGroup(cmd, 0, draws[i].cullFirst, draws[i].cullCount);
+			else
+				cmd.drawIndexed(primitive.indicesSize, draws[i].instances, mesh.indexOffset + primitive.indexOffset, mesh.vertexOffset + primitive.vertexOffset, 0);
 		}
 	}
 
@@ -673,19 +1036,13 @@ namespace vm
 			}
 		}
 		numberOfVertices = static_cast<uint32_t>(vertices.size());
-		auto size = sizeof(Vertex) * numberOfVertices;
-		vertexBuffer.createBuffer(size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-		// Staging buffer
-		Buffer staging;
-		staging.createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible);
-		staging.map();
-		staging.copyData(vertices.data());
-		staging.flush();
-		staging.unmap();
-
-		vertexBuffer.copyBuffer(*staging.buffer, staging.size);
-		staging.destroy();
+		firstVertex = GeometryPool::get()->addVertices(vertices);
+
+		// the draws offset into the pool, the indices stay relative to their mesh
+		for (auto& node : linearNodes) {
+			if (node->mesh)
+				node->mesh->vertexOffset += firstVertex;
+		}
 	}
 
 	void Model::createIndexBuffer()
@@ -700,33 +1057,24 @@ namespace vm
 			}
 		}
 		numberOfIndices = static_cast<uint32_t>(indices.size());
-		auto size = sizeof(uint32_t) * numberOfIndices;
-		indexBuffer.createBuffer(size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-		// Staging buffer
-		Buffer staging;
-		staging.createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible);
-		staging.map();
-		staging.copyData(indices.data());
-		staging.flush();
-		staging.unmap();
-
-		indexBuffer.copyBuffer(*staging.buffer, staging.size);
-		staging.destroy();
+		firstIndex = GeometryPool::get()->addIndices(indices);
+
+		for (auto& node : linearNodes) {
+			if (node->mesh)
+				node->mesh->indexOffset += firstIndex;
+		}
 	}
 
 	void Model::createUniformBuffers()
 	{
-		uniformBuffer.createBuffer(sizeof(ubo), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
-		uniformBuffer.map();
-		uniformBuffer.zero();
-		uniformBuffer.flush();
-		uniformBuffer.unmap();
+		transformSlot = FrameConstants::get()->acquireSlots(transformSlotCount());
 		for (auto& node : linearNodes) {
 			if (node->mesh) {
 				node->mesh->createUniformBuffers();
 			}
 		}
+		// the new materials of the model are copied to the table at once
+		MaterialTable::get()->upload();
 	}
 
 	void Model::createDescriptorSets()
@@ -738,19 +1086,14 @@ namespace vm
 		};
 		std::deque<vk::DescriptorBufferInfo> dsbi{};
 		auto const wSetBuffer = [&dsbi](const vk::DescriptorSet& dstSet, uint32_t dstBinding, Buffer& buffer) {
+			dsbi.emplace_back(*buffer.buffer, buffer.ringOffset, buffer.size);
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &dsbi.back(), nullptr };
+		};
+		auto const wSetStorage = [&dsbi](const vk::DescriptorSet& dstSet, uint32_t dstBinding, const Buffer& buffer) {
 			dsbi.emplace_back(*buffer.buffer, 0, buffer.size);
-			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &dsbi.back(), nullptr };
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &dsbi.back(), nullptr };
 		};
 
-		// model dSet
-		vk::DescriptorSetAllocateInfo allocateInfo0;
-		allocateInfo0.descriptorPool = *VulkanContext::get()->descriptorPool;
-		allocateInfo0.descriptorSetCount = 1;
-		allocateInfo0.pSetLayouts = &Pipeline::getDescriptorSetLayoutModel();
-		descriptorSet = make_ref(VulkanContext::get()->device->allocateDescriptorSets(allocateInfo0).at(0));
-
-		VulkanContext::get()->device->updateDescriptorSets(wSetBuffer(*descriptorSet, 0, uniformBuffer), nullptr);
-
 		// mesh dSets
 		for (auto& node : linearNodes) {
 
@@ -780,7 +1123,7 @@ namespace vm
 					wSetImage(*primitive.descriptorSet, 2, primitive.pbrMaterial.normalTexture),
 					wSetImage(*primitive.descriptorSet, 3, primitive.pbrMaterial.occlusionTexture),
 					wSetImage(*primitive.descriptorSet, 4, primitive.pbrMaterial.emissiveTexture),
-					wSetBuffer(*primitive.descriptorSet, 5, primitive.uniformBuffer)
+					wSetStorage(*primitive.descriptorSet, 5, MaterialTable::get()->getBuffer())
 				};
 				VulkanContext::get()->device->updateDescriptorSets(textureWriteSets, nullptr);
 			}
@@ -793,13 +1136,16 @@ namespace vm
 			delete script;
 			script = nullptr;
 		}
-		uniformBuffer.destroy();
+		if (impostor) {
+			Impostors::get()->destroyAtlas(impostor);
+			impostor = nullptr;
+		}
+		if (transformSlot != UINT32_MAX) {
+			FrameConstants::get()->releaseSlots(transformSlot, transformSlotCount());
+			transformSlot = UINT32_MAX;
+		}
 		delete document;
 		delete resourceReader;
-		if (Pipeline::getDescriptorSetLayoutModel()) {
-			VulkanContext::get()->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutModel());
-			Pipeline::getDescriptorSetLayoutModel() = nullptr;
-		}
 		for (auto& node : linearNodes) {
 			if (node->mesh) {
 				node->mesh->destroy();
@@ -816,7 +1162,9 @@ namespace vm
 		//for (auto& texture : Mesh::uniqueTextures)
 		//	texture.second.destroy();
 		//Mesh::uniqueTextures.clear();
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
+		GeometryPool::get()->freeVertices(firstVertex, numberOfVertices);
+		GeometryPool::get()->freeIndices(firstIndex, numberOfIndices);
+		numberOfVertices = 0;
+		numberOfIndices = 0;
 	}
 }
\ No newline at end of file
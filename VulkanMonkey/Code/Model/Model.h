@@ -5,6 +5,7 @@
 #include "../Camera/Camera.h"
 #include "../Model/Animation.h"
 #include "../Core/Node.h"
+#include "../Culling/FrustumCulling.h"
 #include "../../include/GLTFSDK/GLTF.h"
 #include "../../include/GLTFSDK/GLTFResourceReader.h"
 #include "../../include/GLTFSDK/Document.h"
@@ -13,12 +14,33 @@
 namespace vk
 {
 	class CommandBuffer;
-	class DescriptorSet;
 }
 
 namespace vm
 {
 	class Pipeline;
+	class GPUCulling;
+	class Mesh;
+	class Primitive;
+	class Model;
+	class RenderQueue;
+	struct ImpostorAtlas;
+	struct ModelSnapshot;
+
+	// A visible primitive of a model, the draw lists are split in ranges when they are recorded on many threads.
+	// The primitive is drawn once per instance, with the transforms from slot onwards. A gpu culled primitive draws
+	// the commands of its group instead, the primitives of its mesh recorded with the same binds.
+	struct PrimitiveDraw
+	{
+		Mesh* mesh;
+		Primitive* primitive;
+		uint32_t slot;
+		uint32_t instances;
+		float coverage; // share of the pixels drawn, the impostor of the model draws the rest
+		uint32_t cullFirst; // first command of the group in the camera view of the gpu culling
+		uint32_t cullCount; // commands of the group, 0 when the primitive is drawn directly
+		uint32_t dummy; // no padding, the draws of a frame are hashed
+	};
 
 	class Model
 	{
@@ -29,24 +51,38 @@ namespace vm
 		Microsoft::glTF::Document* document = nullptr;
 		Microsoft::glTF::GLTFResourceReader* resourceReader = nullptr;
 
+		static constexpr uint32_t BATCH_GRID_CELLS = 8; // cells per axis of the grid the static batches are split in
+
 		static std::vector<Model> models;
 		static Pipeline* pipeline;
-		static Ref<vk::CommandBuffer> commandBuffer;
-		Ref<vk::DescriptorSet> descriptorSet;
-		Buffer uniformBuffer;
+		static Pipeline* pipelineBindless; // set instead of the per primitive descriptor sets when bindless is used
+		static GPUCulling* gpuCulling;
+		// the matrices are written in the model's slot of the frame constants, the camera is shared by every model
 		struct UBOModel {
 			mat4 matrix = mat4::identity();
-			mat4 view;
-			mat4 projection;
 			mat4 previousMatrix;
-			mat4 previousView;
 		} ubo;
+		// a model drawn once owns two slots, the second one holds the matrix its impostor is baked with
+		uint32_t transformSlot = UINT32_MAX;
+		// model space matrices of the instances, empty when the model is drawn once. An instanced model owns two
+		// transform slots per instance, all the instances first (the shadow casters) and then the visible ones, compacted
+		std::vector<mat4> instanceMatrices{};
+		CullingBounds instanceBounds;
+		VisibilityBitset instanceVisibility;
+		uint32_t visibleInstances = 0;
 		vec3 scale = vec3(1.0f);
 		vec3 pos = vec3(0.0f);
 		vec3 rot = vec3(0.0f); // euler angles
 		mat4 transform = mat4::identity();
 		vec4 boundingSphere;
 		bool render = true;
+		CullingBounds cullingBounds;
+		VisibilityBitset visibility;
+		VisibilityBitset shadowVisibility[3]{};
+		// the atlases the model is drawn with when it is small on screen, baked on the render thread (see Impostors)
+		ImpostorAtlas* impostor = nullptr;
+		vec4 impostorSphere = vec4(0.f); // model space, the sphere of the first update the views are fitted to
+		float impostorBlend = 0.f; // 0: the meshes, 1: the impostor, dithered in between
 
 		std::string name;
 		std::string fullPathName;
@@ -61,12 +97,21 @@ namespace vm
 
 		Script* script = nullptr;
 
-		Buffer vertexBuffer;
-		Buffer indexBuffer;
+		// the ranges of the model's data in the geometry pool
+		uint32_t firstVertex = 0, firstIndex = 0;
 		uint32_t numberOfVertices = 0, numberOfIndices = 0;
 
-		void draw();
+		// from the snapshot of the rendered frame, the update of the next one may be writing the members
+		static void collectDraws(RenderQueue& queue, const ModelSnapshot& model, float coverage);
+		static void drawList(const vk::CommandBuffer& cmd, const PrimitiveDraw* draws, uint32_t count);
 		void update(Camera& camera, double delta);
+		void updateInstances(Camera& camera);
+		void updateImpostor(Camera& camera);
+		// model space sphere around the world bounds of the primitives
+		vec4 localBoundingSphere() const;
+		bool isInstanced() const { return !instanceMatrices.empty(); }
+		uint32_t instanceCount() const { return isInstanced() ? static_cast<uint32_t>(instanceMatrices.size()) : 1; }
+		uint32_t transformSlotCount() const { return 2 * instanceCount(); }
 		void updateAnimation(uint32_t index, float time);
 		void calculateBoundingSphere();
 		void loadNode(Pointer<vm::Node> parent, const Microsoft::glTF::Node& node, const std::string& folderPath);
@@ -74,11 +119,16 @@ namespace vm
 		void loadSkins();
 		void readGltf(const std::filesystem::path& file);
 		void loadModelGltf(const std::string& folderPath, const std::string& modelName, bool show = true);
+		void loadInstances(uint32_t instances);
+		void batchStaticPrimitives(uint32_t clusterVertices);
 		void getMesh(Pointer<vm::Node>& node, const std::string& meshID, const std::string& folderPath);
 		template <typename T> void getVertexData(std::vector<T>& vec, const std::string& accessorName, const Microsoft::glTF::MeshPrimitive& primitive) const;
 		void getIndexData(std::vector<uint32_t>& vec, const Microsoft::glTF::MeshPrimitive& primitive) const;
+		std::vector<mat4> getInstanceData(const Microsoft::glTF::Node& node) const;
 		Microsoft::glTF::Image* getImage(const std::string& textureID) const;
-		void loadModel(const std::string& folderPath, const std::string& modelName, bool show = true);
+		// batchVertices: vertex cap of the clusters the static primitives are merged in, 0 keeps them as they are
+		// createImpostor: the model gets the atlases it is drawn with from afar, instanced models never do
+		void loadModel(const std::string& folderPath, const std::string& modelName, bool show = true, uint32_t instances = 1, uint32_t batchVertices = 0, bool createImpostor = false);
 		void createVertexBuffer();
 		void createIndexBuffer();
 		void createUniformBuffers();
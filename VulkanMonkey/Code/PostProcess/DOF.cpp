@@ -28,13 +28,14 @@ namespace vm
 			vk::ImageTiling::eOptimal,
 			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
 		frameImage.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+		frameImage.layoutState = LayoutState::ColorRead;
 		frameImage.createImageView(vk::ImageAspectFlagBits::eColor);
 		frameImage.createSampler();
 	}
 
 	void DOF::copyFrameImage(const vk::CommandBuffer& cmd, Image& renderedImage) const
 	{
-		frameImage.copyColorAttachment(cmd, renderedImage);
+		frameImage.copyImage(cmd, renderedImage);
 	}
 
 	void DOF::createRenderPass(std::map<std::string, Image>& renderTargets)
@@ -28,6 +28,7 @@ namespace vm
 			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
 			vk::MemoryPropertyFlagBits::eDeviceLocal);
 		frameImage.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+		frameImage.layoutState = LayoutState::ColorRead;
 		frameImage.createImageView(vk::ImageAspectFlagBits::eColor);
 		frameImage.createSampler();
 	}
@@ -121,7 +122,7 @@ namespace vm
 
 	void FXAA::copyFrameImage(const vk::CommandBuffer& cmd, Image& renderedImage) const
 	{
-		frameImage.copyColorAttachment(cmd, renderedImage);
+		frameImage.copyImage(cmd, renderedImage);
 	}
 
 	void FXAA::destroy()
@@ -32,7 +32,7 @@ namespace vm
 			scale = lerp(.1f, 1.f, scale * scale);
 			kernel.emplace_back(sample * scale, 0.f);
 		}
-		UB_Kernel.createBuffer(sizeof(vec4) * 16, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		UB_Kernel.createRingBuffer(sizeof(vec4) * 16);
 		UB_Kernel.map();
 		UB_Kernel.copyData(kernel.data());
 		UB_Kernel.flush();
@@ -64,7 +64,7 @@ namespace vm
 		noiseTex.createSampler();
 		staging.destroy();
 		// pvm uniform
-		UB_PVM.createBuffer(3 * sizeof(mat4), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		UB_PVM.createRingBuffer(3 * sizeof(mat4));
 		UB_PVM.map();
 		UB_PVM.zero();
 		UB_PVM.flush();
@@ -98,8 +98,8 @@ namespace vm
 		};
 		std::deque<vk::DescriptorBufferInfo> dsbi{};
 		const auto wSetBuffer = [&dsbi](const vk::DescriptorSet& dstSet, uint32_t dstBinding, Buffer& buffer) {
-			dsbi.emplace_back(*buffer.buffer, 0, buffer.size);
-			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &dsbi.back(), nullptr };
+			dsbi.emplace_back(*buffer.buffer, buffer.ringOffset, buffer.size);
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &dsbi.back(), nullptr };
 		};
 
 		std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
@@ -134,7 +134,8 @@ namespace vm
 		cmd.beginRenderPass(rpi, vk::SubpassContents::eInline);
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline.handle);
 		const vk::DescriptorSet descriptorSets = { *DSet };
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, descriptorSets, nullptr);
+		const uint32_t dynamicOffset = UniformRing::get()->frameOffset();
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, descriptorSets, { dynamicOffset, dynamicOffset });
 		cmd.draw(3, 1, 0, 0);
 		cmd.endRenderPass();
 		image.changeLayout(cmd, LayoutState::ColorRead);
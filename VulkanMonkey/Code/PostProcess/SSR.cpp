@@ -21,7 +21,7 @@ namespace vm
 
 	void SSR::createSSRUniforms(std::map<std::string, Image>& renderTargets)
 	{
-		UBReflection.createBuffer(4 * sizeof(mat4), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		UBReflection.createRingBuffer(4 * sizeof(mat4));
 		UBReflection.map();
 		UBReflection.zero();
 		UBReflection.flush();
@@ -45,8 +45,8 @@ namespace vm
 		};
 		std::deque<vk::DescriptorBufferInfo> dsbi{};
 		const auto wSetBuffer = [&dsbi](const vk::DescriptorSet& dstSet, uint32_t dstBinding, Buffer& buffer) {
-			dsbi.emplace_back(*buffer.buffer, 0, buffer.size);
-			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &dsbi.back(), nullptr };
+			dsbi.emplace_back(*buffer.buffer, buffer.ringOffset, buffer.size);
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &dsbi.back(), nullptr };
 		};
 
 		std::vector<vk::WriteDescriptorSet> textureWriteSets{
@@ -96,7 +96,7 @@ namespace vm
 
 		cmd.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline.handle);
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, *DSet, nullptr);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, *DSet, UniformRing::get()->frameOffset());
 		cmd.draw(3, 1, 0, 0);
 		cmd.endRenderPass();
 	}
@@ -42,6 +42,7 @@ namespace vm
 			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
 			vk::MemoryPropertyFlagBits::eDeviceLocal);
 		frameImage.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+		frameImage.layoutState = LayoutState::ColorRead;
 		frameImage.createImageView(vk::ImageAspectFlagBits::eColor);
 		frameImage.createSampler();
 	}
@@ -63,7 +64,7 @@ namespace vm
 
 	void TAA::createUniforms(std::map<std::string, Image>& renderTargets)
 	{
-		uniform.createBuffer(sizeof(UBO), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+		uniform.createRingBuffer(sizeof(UBO));
 		uniform.map();
 		uniform.zero();
 		uniform.flush();
@@ -90,8 +91,8 @@ namespace vm
 		};
 		std::deque<vk::DescriptorBufferInfo> dsbi{};
 		const auto wSetBuffer = [&dsbi](const vk::DescriptorSet& dstSet, uint32_t dstBinding, Buffer& buffer) {
-			dsbi.emplace_back(*buffer.buffer, 0, buffer.size);
-			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &dsbi.back(), nullptr };
+			dsbi.emplace_back(*buffer.buffer, buffer.ringOffset, buffer.size);
+			return vk::WriteDescriptorSet{ dstSet, dstBinding, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &dsbi.back(), nullptr };
 		};
 
 		std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
@@ -126,7 +127,7 @@ namespace vm
 		renderTargets["taa"].changeLayout(cmd, LayoutState::ColorWrite);
 		cmd.beginRenderPass(rpi, vk::SubpassContents::eInline);
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline.handle);
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, *DSet, nullptr);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline.layout, 0, *DSet, UniformRing::get()->frameOffset());
 		cmd.draw(3, 1, 0, 0);
 		cmd.endRenderPass();
 		renderTargets["taa"].changeLayout(cmd, LayoutState::ColorRead);
@@ -144,7 +145,7 @@ namespace vm
 
 		cmd.beginRenderPass(rpi2, vk::SubpassContents::eInline);
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipelineSharpen.handle);
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineSharpen.layout, 0, *DSetSharpen, nullptr);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineSharpen.layout, 0, *DSetSharpen, UniformRing::get()->frameOffset());
 		cmd.draw(3, 1, 0, 0);
 		cmd.endRenderPass();
 	}
@@ -220,7 +221,7 @@ namespace vm
 
 	void TAA::copyFrameImage(const vk::CommandBuffer& cmd, Image& renderedImage) const
 	{
-		frameImage.copyColorAttachment(cmd, renderedImage);
+		frameImage.copyImage(cmd, renderedImage);
 	}
 
 	void TAA::saveImage(const vk::CommandBuffer& cmd, Image& source) const
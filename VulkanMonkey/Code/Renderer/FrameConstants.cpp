@@ -0,0 +1,123 @@
+#include "vulkanPCH.h"
+#include "FrameConstants.h"
+#include "Pipeline.h"
+#include "../Camera/Camera.h"
+#include "../Core/Queue.h"
+#include "../VulkanContext/VulkanContext.h"
+
+namespace vm
+{
+	FrameConstants::FrameConstants()
+	{
+		descriptorSet = make_ref(vk::DescriptorSet());
+	}
+
+	void FrameConstants::Init()
+	{
+		view.createRingBuffer(sizeof(View));
+		view.map();
+		view.zero();
+		view.flush();
+		view.unmap();
+
+		transforms.createRingBuffer(MAX_TRANSFORMS * sizeof(Transform));
+		transforms.map();
+		transforms.zero();
+		transforms.flush();
+		transforms.unmap();
+		transformData.assign(MAX_TRANSFORMS, Transform{ mat4(0.f), mat4(0.f) });
+		transformChanged.assign(MAX_TRANSFORMS, 0);
+		slots.reset(MAX_TRANSFORMS);
+
+		vk::DescriptorSetAllocateInfo allocateInfo;
+		allocateInfo.descriptorPool = *VulkanContext::get()->descriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &Pipeline::getDescriptorSetLayoutFrame();
+		descriptorSet = make_ref(VulkanContext::get()->device->allocateDescriptorSets(allocateInfo).at(0));
+
+		vk::DescriptorBufferInfo dbiView{ *view.buffer, view.ringOffset, view.size };
+		vk::DescriptorBufferInfo dbiTransforms{ *transforms.buffer, transforms.ringOffset, transforms.size };
+		std::vector<vk::WriteDescriptorSet> writeSets{
+			{ *descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &dbiView, nullptr },
+			{ *descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBufferDynamic, nullptr, &dbiTransforms, nullptr }
+		};
+		VulkanContext::get()->device->updateDescriptorSets(writeSets, nullptr);
+	}
+
+	void FrameConstants::destroy()
+	{
+		view.destroy();
+		transforms.destroy();
+		*descriptorSet = nullptr;
+		transformData.clear();
+		transformChanged.clear();
+		slots.reset(0);
+
+		if (Pipeline::getDescriptorSetLayoutFrame()) {
+			VulkanContext::get()->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutFrame());
+			Pipeline::getDescriptorSetLayoutFrame() = nullptr;
+		}
+	}
+
+	uint32_t FrameConstants::acquireSlots(uint32_t count)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		const uint32_t first = slots.allocate(count);
+		if (first == UINT32_MAX)
+			throw std::runtime_error("Frame constants are out of transform slots");
+		return first;
+	}
+
+	void FrameConstants::releaseSlots(uint32_t first, uint32_t count)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		slots.free(first, count);
+	}
+
+	void FrameConstants::updateView(const Camera& camera)
+	{
+		View data;
+		data.view = camera.view;
+		data.projection = camera.projection;
+		data.previousView = camera.previousView;
+		data.previousProjection = camera.previousProjection;
+		data.jitter = vec4(camera.projOffset.x, camera.projOffset.y, camera.projOffsetPrevious.x, camera.projOffsetPrevious.y);
+		Queue::memcpyRequest(&view, { { &data, sizeof(data), 0 } });
+	}
+
+	void FrameConstants::updateTransform(uint32_t slot, const mat4& matrix, const mat4& previousMatrix)
+	{
+		const Transform data{ matrix, previousMatrix };
+
+		// static models write nothing, a slot belongs to one model so the parallel updates touch different ones
+		if (!memcmp(&transformData[slot], &data, sizeof(data)))
+			return;
+		transformData[slot] = data;
+		transformChanged[slot] = 1;
+	}
+
+	void FrameConstants::queueTransforms()
+	{
+		// a range per run of changed slots, the snapshot copies them before the next update writes the slots again
+		std::vector<MemoryRange> ranges{};
+		for (uint32_t slot = 0; slot < transformChanged.size();) {
+			if (!transformChanged[slot]) {
+				slot++;
+				continue;
+			}
+			const uint32_t first = slot;
+			while (slot < transformChanged.size() && transformChanged[slot])
+				transformChanged[slot++] = 0;
+			ranges.push_back({ &transformData[first], (slot - first) * sizeof(Transform), first * sizeof(Transform) });
+		}
+		if (!ranges.empty())
+			Queue::memcpyRequest(&transforms, ranges);
+	}
+
+	void FrameConstants::bind(const vk::CommandBuffer& cmd, const vk::PipelineLayout& layout, uint32_t set) const
+	{
+		const uint32_t dynamicOffset = UniformRing::get()->frameOffset();
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, set, *descriptorSet, { dynamicOffset, dynamicOffset });
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "../Core/Buffer.h"
+#include "../Core/Math.h"
+#include "../Core/RangeAllocator.h"
+#include <mutex>
+#include <vector>
+
+namespace vk
+{
+	class CommandBuffer;
+	class DescriptorSet;
+	class PipelineLayout;
+}
+
+namespace vm
+{
+	class Camera;
+
+	// The constants every draw of a frame shares, in one set that is bound once per command buffer of a pass: the
+	// camera matrices of the view and the matrices of all the models. A model owns a range of slots of the transforms
+	// (two, the second for the bake of its impostor, or two per instance when instanced) and pushes the first one with its draws, so nothing per model is bound.
+	class FrameConstants
+	{
+	public:
+		static constexpr uint32_t MAX_TRANSFORMS = 4096;
+
+		// std140 layout of the View block of the shaders
+		struct View
+		{
+			mat4 view;
+			mat4 projection;
+			mat4 previousView;
+			mat4 previousProjection;
+			vec4 jitter; // xy: current, zw: previous
+		};
+
+		// std430 layout of the Transform struct of the shaders
+		struct Transform
+		{
+			mat4 matrix;
+			mat4 previousMatrix;
+		};
+
+		void Init();
+		void destroy();
+
+		// First slot of count consecutive ones, the instances of a model index from it
+		uint32_t acquireSlots(uint32_t count);
+		void releaseSlots(uint32_t first, uint32_t count);
+
+		void updateView(const Camera& camera);
+		// Keeps the matrices of the slot when they changed, the models of the same frame update it in parallel
+		void updateTransform(uint32_t slot, const mat4& matrix, const mat4& previousMatrix);
+		// Queues the slots changed since the last call as uploads, they are captured with the snapshot of the frame
+		void queueTransforms();
+
+		// Binds the set with the offsets of the recorded frame
+		void bind(const vk::CommandBuffer& cmd, const vk::PipelineLayout& layout, uint32_t set) const;
+		// for the sets that pair the transforms with other views (the impostor bakes)
+		const Buffer& getTransforms() const { return transforms; }
+
+	private:
+		Buffer view;
+		Buffer transforms;
+		Ref<vk::DescriptorSet> descriptorSet;
+		RangeAllocator slots;
+		std::mutex mutex;
+		// the latest matrices and a changed flag per slot, on the update thread, the render thread owns the ring
+		std::vector<Transform> transformData{};
+		std::vector<uint8_t> transformChanged{};
+
+	public:
+		static auto get() noexcept { static auto fc = new FrameConstants(); return fc; }
+		static auto remove() noexcept { using type = decltype(get()); if (std::is_pointer<type>::value) delete get(); }
+
+		FrameConstants(FrameConstants const&) = delete;				// copy constructor
+		FrameConstants(FrameConstants&&) noexcept = delete;			// move constructor
+		FrameConstants& operator=(FrameConstants const&) = delete;	// copy assignment
+		FrameConstants& operator=(FrameConstants&&) = delete;		// move assignment
+	private:
+		FrameConstants();											// default constructor
+		~FrameConstants() = default;								// destructor
+	};
+}
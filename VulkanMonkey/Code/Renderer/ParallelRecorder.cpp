@@ -0,0 +1,166 @@
+#include "vulkanPCH.h"
+#include "ParallelRecorder.h"
+#include "../VulkanContext/VulkanContext.h"
+#include "../Core/JobSystem.h"
+#include <algorithm>
+
+namespace vm
+{
+	void ParallelRecorder::Init(uint32_t frames)
+	{
+		auto vulkan = VulkanContext::get();
+
+		vk::CommandPoolCreateInfo cpci;
+		cpci.queueFamilyIndex = static_cast<uint32_t>(vulkan->graphicsFamilyId);
+		cpci.flags = vk::CommandPoolCreateFlagBits::eTransient;
+
+		slots.resize(frames);
+		for (auto& frameSlots : slots) {
+			frameSlots.resize(MAX_THREADS);
+			for (auto& slot : frameSlots) {
+				slot.pool = make_ref(vulkan->device->createCommandPool(cpci));
+				slot.buffers = make_ref(std::vector<vk::CommandBuffer>());
+			}
+		}
+
+		// the cached secondaries are re-recorded one by one when their key changes
+		cpci.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+		cachePools.resize(MAX_THREADS);
+		for (auto& pool : cachePools)
+			pool = make_ref(vulkan->device->createCommandPool(cpci));
+
+		cachedPasses.resize(frames);
+		for (auto& frameCached : cachedPasses) {
+			frameCached.resize(static_cast<size_t>(RecordPass::Count));
+			for (auto& cached : frameCached)
+				cached.buffers = make_ref(std::vector<vk::CommandBuffer>());
+		}
+	}
+
+	void ParallelRecorder::beginFrame(uint32_t frame)
+	{
+		for (auto& slot : slots[frame]) {
+			if (slot.used) {
+				VulkanContext::get()->device->resetCommandPool(*slot.pool, vk::CommandPoolResetFlags());
+				slot.used = 0;
+			}
+		}
+	}
+
+	vk::CommandBuffer& ParallelRecorder::next(Slot& slot)
+	{
+		if (slot.used == slot.buffers->size()) {
+			vk::CommandBufferAllocateInfo cbai;
+			cbai.commandPool = *slot.pool;
+			cbai.level = vk::CommandBufferLevel::eSecondary;
+			cbai.commandBufferCount = 1;
+			slot.buffers->push_back(VulkanContext::get()->device->allocateCommandBuffers(cbai).at(0));
+		}
+		return (*slot.buffers)[slot.used++];
+	}
+
+	// an empty range still gets a secondary, the caller may record more than draws in it (e.g. clears)
+	static uint32_t threadsFor(uint32_t threads, uint32_t count)
+	{
+		return std::max(std::min({ threads, count, ParallelRecorder::MAX_THREADS }), 1u);
+	}
+
+	static void recordRanges(const std::vector<vk::CommandBuffer>& secondaries, const vk::CommandBufferBeginInfo& beginInfo, uint32_t count, const ParallelRecorder::RecordFunc& func)
+	{
+		const uint32_t threads = static_cast<uint32_t>(secondaries.size());
+		auto recordRange = [&](uint32_t t) {
+			const uint32_t first = count * t / threads;
+			const uint32_t last = count * (t + 1) / threads;
+			auto& cmd = secondaries[t];
+			cmd.begin(beginInfo);
+			func(cmd, first, last);
+			cmd.end();
+		};
+		JobSystem::get()->Wait(JobSystem::get()->parallel_for(threads, 1, recordRange));
+	}
+
+	void ParallelRecorder::record(const vk::CommandBuffer& primary, uint32_t frame, const vk::RenderPass& renderPass, const vk::Framebuffer& framebuffer, uint32_t threads, uint32_t count, const RecordFunc& func)
+	{
+		threads = threadsFor(threads, count);
+
+		// the buffers are taken up front, so every job only touches the pool of its own slot
+		std::vector<vk::CommandBuffer> secondaries(threads);
+		for (uint32_t t = 0; t < threads; t++)
+			secondaries[t] = next(slots[frame][t]);
+
+		vk::CommandBufferInheritanceInfo inheritance;
+		inheritance.renderPass = renderPass;
+		inheritance.subpass = 0;
+		inheritance.framebuffer = framebuffer;
+
+		vk::CommandBufferBeginInfo beginInfo;
+		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+		beginInfo.pInheritanceInfo = &inheritance;
+
+		recordRanges(secondaries, beginInfo, count, func);
+
+		primary.executeCommands(secondaries);
+	}
+
+	bool ParallelRecorder::recordCached(const vk::CommandBuffer& primary, uint32_t frame, RecordPass pass, size_t key, const vk::RenderPass& renderPass, uint32_t threads, uint32_t count, const RecordFunc& func)
+	{
+		threads = threadsFor(threads, count);
+
+		auto& cached = cachedPasses[frame][static_cast<size_t>(pass)];
+		auto& buffers = *cached.buffers;
+		const bool hit = cached.valid && cached.key == key && cached.threads == threads;
+		if (!hit) {
+			// buffer t always comes from pool t, so the jobs below never share a pool
+			for (uint32_t t = static_cast<uint32_t>(buffers.size()); t < threads; t++) {
+				vk::CommandBufferAllocateInfo cbai;
+				cbai.commandPool = *cachePools[t];
+				cbai.level = vk::CommandBufferLevel::eSecondary;
+				cbai.commandBufferCount = 1;
+				buffers.push_back(VulkanContext::get()->device->allocateCommandBuffers(cbai).at(0));
+			}
+
+			// no framebuffer is inherited, the same secondaries are executed for every swapchain image
+			vk::CommandBufferInheritanceInfo inheritance;
+			inheritance.renderPass = renderPass;
+			inheritance.subpass = 0;
+
+			// only the primary of this frame executes them, the copies of the other frames may still be pending
+			vk::CommandBufferBeginInfo beginInfo;
+			beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+			beginInfo.pInheritanceInfo = &inheritance;
+
+			recordRanges(std::vector<vk::CommandBuffer>(buffers.begin(), buffers.begin() + threads), beginInfo, count, func);
+
+			cached.key = key;
+			cached.threads = threads;
+			cached.valid = true;
+		}
+
+		primary.executeCommands(threads, buffers.data());
+		return hit;
+	}
+
+	void ParallelRecorder::invalidate()
+	{
+		for (auto& frameCached : cachedPasses)
+			for (auto& cached : frameCached)
+				cached.valid = false;
+	}
+
+	void ParallelRecorder::destroy()
+	{
+		for (auto& frameSlots : slots) {
+			for (auto& slot : frameSlots) {
+				if (*slot.pool)
+					VulkanContext::get()->device->destroyCommandPool(*slot.pool);
+			}
+		}
+		slots.clear();
+		for (auto& pool : cachePools) {
+			if (*pool)
+				VulkanContext::get()->device->destroyCommandPool(*pool);
+		}
+		cachePools.clear();
+		cachedPasses.clear();
+	}
+}
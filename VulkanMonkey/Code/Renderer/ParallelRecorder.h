@@ -0,0 +1,69 @@
+#pragma once
+#include "../Core/Base.h"
+#include <vector>
+#include <functional>
+
+namespace vk
+{
+	class CommandPool;
+	class CommandBuffer;
+	class RenderPass;
+	class Framebuffer;
+}
+
+namespace vm
+{
+	// Passes whose secondaries can be kept across frames
+	enum class RecordPass : uint32_t
+	{
+		GBuffer,
+		ShadowsStatic,
+		ShadowsDynamic,
+		Count
+	};
+
+	// Records the draws of a render pass on the job system, every thread slot owns a command pool per frame
+	// and records its part of the draws into a secondary command buffer that the primary executes
+	class ParallelRecorder
+	{
+	public:
+		static constexpr uint32_t MAX_THREADS = 8;
+
+		using RecordFunc = std::function<void(const vk::CommandBuffer& cmd, uint32_t first, uint32_t last)>;
+
+		void Init(uint32_t frames);
+		// Resets the pools of the frame, the secondaries recorded for it on a previous use are done with by now
+		void beginFrame(uint32_t frame);
+		// Splits [0, count) in threads contiguous ranges and records each one in its own secondary command buffer inside
+		// the render pass that is begun on the primary with eSecondaryCommandBuffers contents, then executes them
+		void record(const vk::CommandBuffer& primary, uint32_t frame, const vk::RenderPass& renderPass, const vk::Framebuffer& framebuffer, uint32_t threads, uint32_t count, const RecordFunc& func);
+		// Same as record, but the secondaries of the pass are kept and executed again while the key (a hash of everything
+		// they record) is unchanged, returns true when they were reused. Per frame data must only reach them through buffers.
+		// Every frame in flight keeps its own copy, so a copy is only re-recorded when the gpu is done with it
+		bool recordCached(const vk::CommandBuffer& primary, uint32_t frame, RecordPass pass, size_t key, const vk::RenderPass& renderPass, uint32_t threads, uint32_t count, const RecordFunc& func);
+		// Drops the cached secondaries, when the handles they recorded (pipelines, buffers, descriptor sets) may be gone
+		void invalidate();
+		void destroy();
+
+	private:
+		struct Slot
+		{
+			Ref<vk::CommandPool> pool;
+			Ref<std::vector<vk::CommandBuffer>> buffers;
+			uint32_t used = 0;
+		};
+		std::vector<std::vector<Slot>> slots{}; // [frame][thread]
+
+		struct CachedPass
+		{
+			Ref<std::vector<vk::CommandBuffer>> buffers;
+			size_t key = 0;
+			uint32_t threads = 0;
+			bool valid = false;
+		};
+		std::vector<Ref<vk::CommandPool>> cachePools{}; // [thread]
+		std::vector<std::vector<CachedPass>> cachedPasses{}; // [frame][pass]
+
+		vk::CommandBuffer& next(Slot& slot);
+	};
+}
@@ -2,6 +2,7 @@
 #include "Pipeline.h"
 #include "../Shader/Shader.h"
 #include "../VulkanContext/VulkanContext.h"
+#include "../Model/Bindless.h"
 
 namespace vm
 {
@@ -14,6 +15,7 @@ namespace vm
 		vertexInputAttributeDescriptions = make_ref(std::vector<vk::VertexInputAttributeDescription>());
 		width = 0.f;
 		height = 0.f;
+		viewportCount = 1;
 		pushConstantStage = PushConstantStage::Vertex;
 		pushConstantSize = 0;
 		cullMode = CullMode::None;
@@ -97,11 +99,14 @@ namespace vm
 		vk::Rect2D r2d;
 		r2d.extent = vk::Extent2D{ static_cast<uint32_t>(info.width), static_cast<uint32_t>(info.height) };
 
+		const std::vector<vk::Viewport> viewports(info.viewportCount, vp);
+		const std::vector<vk::Rect2D> scissors(info.viewportCount, r2d);
+
 		vk::PipelineViewportStateCreateInfo pvsci;
-		pvsci.viewportCount = 1;
-		pvsci.pViewports = &vp;
-		pvsci.scissorCount = 1;
-		pvsci.pScissors = &r2d;
+		pvsci.viewportCount = info.viewportCount;
+		pvsci.pViewports = viewports.data();
+		pvsci.scissorCount = info.viewportCount;
+		pvsci.pScissors = scissors.data();
 		pipeinfo.pViewportState = &pvsci;
 
 		// Rasterization state
@@ -194,9 +199,15 @@ namespace vm
 		csmci.codeSize = info.pCompShader->byte_size();
 		csmci.pCode = info.pCompShader->get_spriv();
 
+		vk::PushConstantRange pcr;
+		pcr.stageFlags = vk::ShaderStageFlagBits::eCompute;
+		pcr.size = info.pushConstantSize;
+
 		vk::PipelineLayoutCreateInfo plci;
 		plci.setLayoutCount = static_cast<uint32_t>(info.descriptorSetLayouts->size());
 		plci.pSetLayouts = info.descriptorSetLayouts->data();
+		plci.pushConstantRangeCount = info.pushConstantSize ? 1 : 0;
+		plci.pPushConstantRanges = info.pushConstantSize ? &pcr : nullptr;
 
 		vk::UniqueShaderModule module = VulkanContext::get()->device->createShaderModuleUnique(csmci);
 
@@ -236,12 +247,12 @@ namespace vm
 				layoutBinding(1, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(2, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(3, vk::DescriptorType::eCombinedImageSampler),
-				layoutBinding(4, vk::DescriptorType::eUniformBuffer),
+				layoutBinding(4, vk::DescriptorType::eUniformBufferDynamic),
 				layoutBinding(5, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(6, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(7, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(8, vk::DescriptorType::eCombinedImageSampler),
-				layoutBinding(9, vk::DescriptorType::eUniformBuffer)
+				layoutBinding(9, vk::DescriptorType::eUniformBufferDynamic)
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
 			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
@@ -393,7 +404,7 @@ namespace vm
 				layoutBinding(0, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(1, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(2, vk::DescriptorType::eCombinedImageSampler),
-				layoutBinding(3, vk::DescriptorType::eUniformBuffer),
+				layoutBinding(3, vk::DescriptorType::eUniformBufferDynamic),
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
 			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
@@ -417,8 +428,8 @@ namespace vm
 				layoutBinding(0, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(1, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(2, vk::DescriptorType::eCombinedImageSampler),
-				layoutBinding(3, vk::DescriptorType::eUniformBuffer),
-				layoutBinding(4, vk::DescriptorType::eUniformBuffer),
+				layoutBinding(3, vk::DescriptorType::eUniformBufferDynamic),
+				layoutBinding(4, vk::DescriptorType::eUniformBufferDynamic),
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
 			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
@@ -464,7 +475,7 @@ namespace vm
 				layoutBinding(1, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(2, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(3, vk::DescriptorType::eCombinedImageSampler),
-				layoutBinding(4, vk::DescriptorType::eUniformBuffer),
+				layoutBinding(4, vk::DescriptorType::eUniformBufferDynamic),
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
 			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
@@ -489,7 +500,7 @@ namespace vm
 				layoutBinding(1, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(2, vk::DescriptorType::eCombinedImageSampler),
 				layoutBinding(3, vk::DescriptorType::eCombinedImageSampler),
-				layoutBinding(4, vk::DescriptorType::eUniformBuffer)
+				layoutBinding(4, vk::DescriptorType::eUniformBufferDynamic)
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
 			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
@@ -511,7 +522,7 @@ namespace vm
 			};
 			std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
 				layoutBinding(0, vk::DescriptorType::eCombinedImageSampler),
-				layoutBinding(1, vk::DescriptorType::eUniformBuffer)
+				layoutBinding(1, vk::DescriptorType::eUniformBufferDynamic)
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
 			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
@@ -532,7 +543,7 @@ namespace vm
 				return vk::DescriptorSetLayoutBinding{ binding, descriptorType, 1, stageFlags, nullptr };
 			};
 			std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-				layoutBinding(0, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex),
+				layoutBinding(0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex),
 				layoutBinding(1, vk::DescriptorType::eCombinedImageSampler,vk::ShaderStageFlagBits::eFragment),
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
@@ -554,7 +565,7 @@ namespace vm
 				return vk::DescriptorSetLayoutBinding{ binding, descriptorType, 1, vk::ShaderStageFlagBits::eVertex, nullptr };
 			};
 			std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-				layoutBinding(0, vk::DescriptorType::eUniformBuffer),
+				layoutBinding(0, vk::DescriptorType::eUniformBufferDynamic),
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
 			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
@@ -580,7 +591,7 @@ namespace vm
 				layoutBinding(2, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment),
 				layoutBinding(3, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment),
 				layoutBinding(4, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment),
-				layoutBinding(5, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex),
+				layoutBinding(5, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eVertex),
 			};
 			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
 			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
@@ -591,22 +602,48 @@ namespace vm
 		return DSLayout;
 	}
 
-	vk::DescriptorSetLayout& Pipeline::getDescriptorSetLayoutModel()
+	vk::DescriptorSetLayout& Pipeline::getDescriptorSetLayoutFrame()
 	{
 		static vk::DescriptorSetLayout DSLayout = nullptr;
 
 		if (!DSLayout)
 		{
-			vk::DescriptorSetLayoutBinding dslb;
-			dslb.binding = 0;
-			dslb.descriptorCount = 1; // number of descriptors contained
-			dslb.descriptorType = vk::DescriptorType::eUniformBuffer;
-			dslb.stageFlags = vk::ShaderStageFlagBits::eVertex;
-
-			vk::DescriptorSetLayoutCreateInfo dslci;
-			dslci.bindingCount = 1;
-			dslci.pBindings = &dslb;
-			DSLayout = VulkanContext::get()->device->createDescriptorSetLayout(dslci);
+			const auto layoutBinding = [](uint32_t binding, vk::DescriptorType descriptorType) {
+				return vk::DescriptorSetLayoutBinding{ binding, descriptorType, 1, vk::ShaderStageFlagBits::eVertex, nullptr };
+			};
+			std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+				layoutBinding(0, vk::DescriptorType::eUniformBufferDynamic),	// view
+				layoutBinding(1, vk::DescriptorType::eStorageBufferDynamic)		// model transforms
+			};
+			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
+			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			descriptorLayout.pBindings = setLayoutBindings.data();
+			DSLayout = VulkanContext::get()->device->createDescriptorSetLayout(descriptorLayout);
+		}
+
+		return DSLayout;
+	}
+
+	vk::DescriptorSetLayout& Pipeline::getDescriptorSetLayoutImpostor()
+	{
+		static vk::DescriptorSetLayout DSLayout = nullptr;
+
+		if (!DSLayout)
+		{
+			const auto layoutBinding = [](uint32_t binding) {
+				return vk::DescriptorSetLayoutBinding{ binding, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment, nullptr };
+			};
+			std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+				layoutBinding(0),	// albedo
+				layoutBinding(1),	// normal
+				layoutBinding(2),	// depth
+				layoutBinding(3),	// srm
+				layoutBinding(4)	// emissive
+			};
+			vk::DescriptorSetLayoutCreateInfo descriptorLayout;
+			descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			descriptorLayout.pBindings = setLayoutBindings.data();
+			DSLayout = VulkanContext::get()->device->createDescriptorSetLayout(descriptorLayout);
 		}
 
 		return DSLayout;
@@ -654,4 +691,82 @@ namespace vm
 
 		return DSLayout;
 	}
+
+	vk::DescriptorSetLayout& Pipeline::getDescriptorSetLayoutGPUCulling()
+	{
+		static vk::DescriptorSetLayout DSLayout = nullptr;
+
+		if (!DSLayout) {
+			auto const setLayoutBinding = [](uint32_t binding, vk::DescriptorType descriptorType) {
+				return vk::DescriptorSetLayoutBinding{ binding, descriptorType, 1, vk::ShaderStageFlagBits::eCompute, nullptr };
+			};
+
+			std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+				setLayoutBinding(0, vk::DescriptorType::eUniformBuffer),		// views
+				setLayoutBinding(1, vk::DescriptorType::eStorageBuffer),		// bounds
+				setLayoutBinding(2, vk::DescriptorType::eStorageBuffer),		// draw inputs
+				setLayoutBinding(3, vk::DescriptorType::eStorageBuffer),		// draw commands
+				setLayoutBinding(4, vk::DescriptorType::eStorageBuffer),		// draw counts
+				setLayoutBinding(5, vk::DescriptorType::eCombinedImageSampler)	// depth pyramid
+			};
+
+			vk::DescriptorSetLayoutCreateInfo dlci;
+			dlci.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			dlci.pBindings = setLayoutBindings.data();
+			DSLayout = VulkanContext::get()->device->createDescriptorSetLayout(dlci);
+		}
+
+		return DSLayout;
+	}
+
+	vk::DescriptorSetLayout& Pipeline::getDescriptorSetLayoutDepthPyramid()
+	{
+		static vk::DescriptorSetLayout DSLayout = nullptr;
+
+		if (!DSLayout) {
+			auto const setLayoutBinding = [](uint32_t binding, vk::DescriptorType descriptorType) {
+				return vk::DescriptorSetLayoutBinding{ binding, descriptorType, 1, vk::ShaderStageFlagBits::eCompute, nullptr };
+			};
+
+			std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+				setLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler),	// in
+				setLayoutBinding(1, vk::DescriptorType::eStorageImage)			// out
+			};
+
+			vk::DescriptorSetLayoutCreateInfo dlci;
+			dlci.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			dlci.pBindings = setLayoutBindings.data();
+			DSLayout = VulkanContext::get()->device->createDescriptorSetLayout(dlci);
+		}
+
+		return DSLayout;
+	}
+	vk::DescriptorSetLayout& Pipeline::getDescriptorSetLayoutBindless()
+	{
+		static vk::DescriptorSetLayout DSLayout = nullptr;
+
+		if (!DSLayout) {
+			std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+				{ 0, vk::DescriptorType::eCombinedImageSampler, Bindless::MAX_TEXTURES, vk::ShaderStageFlagBits::eFragment, nullptr },	// textures
+				{ 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex, nullptr }								// materials
+			};
+			// the texture array is filled as models are loaded, the slots no frame reads can be written while it is bound
+			std::vector<vk::DescriptorBindingFlagsEXT> bindingFlags{
+				vk::DescriptorBindingFlagBitsEXT::ePartiallyBound | vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind | vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending,
+				vk::DescriptorBindingFlagsEXT()
+			};
+			vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo;
+			bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+			bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+			vk::DescriptorSetLayoutCreateInfo dlci;
+			dlci.pNext = &bindingFlagsInfo;
+			dlci.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT;
+			dlci.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			dlci.pBindings = setLayoutBindings.data();
+			DSLayout = VulkanContext::get()->device->createDescriptorSetLayout(dlci);
+		}
+
+		return DSLayout;
+	}
 }
\ No newline at end of file
@@ -42,6 +42,7 @@ namespace vm
 		Ref<std::vector<vk::VertexInputAttributeDescription>> vertexInputAttributeDescriptions;
 		float width;
 		float height;
+		uint32_t viewportCount; // more than one needs the viewports and scissors as dynamic states
 		CullMode cullMode;
 		Ref<std::vector<vk::PipelineColorBlendAttachmentState>> colorBlendAttachments;
 		Ref<std::vector<vk::DynamicState>> dynamicStates;
@@ -81,8 +82,12 @@ namespace vm
 		static vk::DescriptorSetLayout& getDescriptorSetLayoutShadows();
 		static vk::DescriptorSetLayout& getDescriptorSetLayoutMesh();
 		static vk::DescriptorSetLayout& getDescriptorSetLayoutPrimitive();
-		static vk::DescriptorSetLayout& getDescriptorSetLayoutModel();
+		static vk::DescriptorSetLayout& getDescriptorSetLayoutFrame();
+		static vk::DescriptorSetLayout& getDescriptorSetLayoutImpostor();
 		static vk::DescriptorSetLayout& getDescriptorSetLayoutSkybox();
 		static vk::DescriptorSetLayout& getDescriptorSetLayoutCompute();
+		static vk::DescriptorSetLayout& getDescriptorSetLayoutGPUCulling();
+		static vk::DescriptorSetLayout& getDescriptorSetLayoutDepthPyramid();
+		static vk::DescriptorSetLayout& getDescriptorSetLayoutBindless();
 	};
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "vulkanPCH.h"
+#include "RenderGraph.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace vm
+{
+	struct StateInfo
+	{
+		vk::ImageLayout layout;
+		vk::PipelineStageFlags stages;
+		vk::AccessFlags access;
+	};
+
+	static StateInfo stateInfo(LayoutState state)
+	{
+		switch (state) {
+		case LayoutState::ColorRead:
+			// the depth pyramid samples the depth target in a compute shader
+			return { vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead };
+		case LayoutState::ColorWrite:
+			return { vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite };
+		case LayoutState::DepthRead:
+			return { vk::ImageLayout::eDepthStencilReadOnlyOptimal, vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead };
+		case LayoutState::DepthWrite:
+			return { vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests, vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite };
+		case LayoutState::TransferRead:
+			return { vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead };
+		case LayoutState::TransferWrite:
+			return { vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite };
+		}
+		throw std::runtime_error("RenderGraph: unknown layout state");
+	}
+
+	static vk::ImageAspectFlags aspectMask(const Image& image)
+	{
+		switch (*image.format) {
+		case vk::Format::eD32Sfloat:
+		case vk::Format::eD16Unorm:
+			return vk::ImageAspectFlagBits::eDepth;
+		case vk::Format::eD32SfloatS8Uint:
+		case vk::Format::eD24UnormS8Uint:
+			return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+		default:
+			return vk::ImageAspectFlagBits::eColor;
+		}
+	}
+
+	RenderGraph::Pass& RenderGraph::Pass::read(Image& image, LayoutState state)
+	{
+		accesses.push_back({ &image, state, false, true });
+		return *this;
+	}
+
+	RenderGraph::Pass& RenderGraph::Pass::bind(Image& image, LayoutState state)
+	{
+		accesses.push_back({ &image, state, false, false });
+		return *this;
+	}
+
+	RenderGraph::Pass& RenderGraph::Pass::write(Image& image, LayoutState state)
+	{
+		accesses.push_back({ &image, state, true, true });
+		return *this;
+	}
+
+	RenderGraph::Pass& RenderGraph::Pass::keep()
+	{
+		sideEffects = true;
+		return *this;
+	}
+
+	RenderGraph::Pass& RenderGraph::addPass(Execute execute)
+	{
+		passes.emplace_back();
+		passes.back().execute = std::move(execute);
+		return passes.back();
+	}
+
+	void RenderGraph::release(Image& image, LayoutState state)
+	{
+		releases.emplace_back(&image, state);
+	}
+
+	void RenderGraph::barrier(const vk::CommandBuffer& cmd, const std::vector<Pass::Access>& accesses)
+	{
+		std::vector<vk::ImageMemoryBarrier> barriers{};
+		vk::PipelineStageFlags srcStages{}, dstStages{};
+		for (auto& access : accesses) {
+			Image& image = *access.image;
+			// an image the graph has not seen yet may have been written by anything
+			bool& dirty = written.try_emplace(&image, true).first->second;
+			if (image.layoutState != access.state || dirty || access.write) {
+				const StateInfo src = stateInfo(image.layoutState);
+				const StateInfo dst = stateInfo(access.state);
+
+				// only writes have to be made visible, after reads the pass just has to wait for them to finish
+				vk::ImageMemoryBarrier imageBarrier;
+				imageBarrier.srcAccessMask = dirty ? src.access : vk::AccessFlags();
+				imageBarrier.dstAccessMask = dst.access;
+				imageBarrier.oldLayout = src.layout;
+				imageBarrier.newLayout = dst.layout;
+				imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.image = *image.image;
+				imageBarrier.subresourceRange = { aspectMask(image), 0, image.mipLevels, 0, image.arrayLayers };
+				barriers.push_back(imageBarrier);
+
+				srcStages |= src.stages;
+				dstStages |= dst.stages;
+				image.layoutState = access.state;
+			}
+			dirty = access.write;
+		}
+
+		if (!barriers.empty())
+			cmd.pipelineBarrier(srcStages, dstStages, vk::DependencyFlagBits::eByRegion, nullptr, nullptr, barriers);
+	}
+
+	void RenderGraph::execute(const vk::CommandBuffer& cmd)
+	{
+		const uint32_t count = static_cast<uint32_t>(passes.size());
+
+		// culling, from the last pass back to the first a pass is live if it has side effects or writes an image
+		// that a later live pass reads before it is written again
+		std::vector<bool> live(count, false);
+		std::unordered_set<const Image*> needed{};
+		for (uint32_t i = count; i-- > 0;) {
+			const Pass& pass = passes[i];
+			bool used = pass.sideEffects;
+			for (auto& access : pass.accesses)
+				used |= access.write && needed.count(access.image);
+			if (!used)
+				continue;
+			live[i] = true;
+			for (auto& access : pass.accesses) {
+				if (access.write)
+					needed.erase(access.image);
+			}
+			for (auto& access : pass.accesses) {
+				if (!access.write && access.used)
+					needed.insert(access.image);
+			}
+		}
+
+		// dependencies of the live passes in the declared order, a read waits on the last write of the image and
+		// a write on the last write and the reads after it
+		struct Track
+		{
+			int writer = -1;
+			std::vector<uint32_t> readers{};
+		};
+		std::unordered_map<const Image*, Track> tracks{};
+		std::vector<std::vector<uint32_t>> dependents(count);
+		std::vector<uint32_t> waits(count, 0);
+		const auto addEdge = [&](int from, uint32_t to) {
+			if (from < 0 || static_cast<uint32_t>(from) == to)
+				return;
+			auto& list = dependents[from];
+			if (std::find(list.begin(), list.end(), to) == list.end()) {
+				list.push_back(to);
+				waits[to]++;
+			}
+		};
+		for (uint32_t i = 0; i < count; i++) {
+			if (!live[i])
+				continue;
+			for (auto& access : passes[i].accesses) {
+				const Track& track = tracks[access.image];
+				addEdge(track.writer, i);
+				if (access.write) {
+					for (uint32_t reader : track.readers)
+						addEdge(static_cast<int>(reader), i);
+				}
+			}
+			for (auto& access : passes[i].accesses) {
+				Track& track = tracks[access.image];
+				if (access.write) {
+					track.writer = static_cast<int>(i);
+					track.readers.clear();
+				}
+				else {
+					track.readers.push_back(i);
+				}
+			}
+		}
+
+		// the ready passes in declared order, the first one that does not wait on the pass just recorded goes next,
+		// so the barrier of that pass's outputs is recorded after other work instead of stalling right behind it
+		std::vector<uint32_t> ready{};
+		for (uint32_t i = 0; i < count; i++) {
+			if (live[i] && !waits[i])
+				ready.push_back(i);
+		}
+		int last = -1;
+		while (!ready.empty()) {
+			size_t pick = 0;
+			if (last >= 0) {
+				const auto& after = dependents[last];
+				for (size_t r = 0; r < ready.size(); r++) {
+					if (std::find(after.begin(), after.end(), ready[r]) == after.end()) {
+						pick = r;
+						break;
+					}
+				}
+			}
+			const uint32_t i = ready[pick];
+			ready.erase(ready.begin() + pick);
+
+			barrier(cmd, passes[i].accesses);
+			passes[i].execute(cmd);
+
+			for (uint32_t next : dependents[i]) {
+				if (!--waits[next])
+					ready.insert(std::lower_bound(ready.begin(), ready.end(), next), next);
+			}
+			last = static_cast<int>(i);
+		}
+
+		// the released images are handed back in the state the other command buffers expect, they write them
+		if (!releases.empty()) {
+			std::vector<Pass::Access> accesses{};
+			for (auto& release : releases)
+				accesses.push_back({ release.first, release.second, false, false });
+			barrier(cmd, accesses);
+			for (auto& release : releases)
+				written[release.first] = true;
+		}
+
+		passes.clear();
+		releases.clear();
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "../Core/Image.h"
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace vk
+{
+	class CommandBuffer;
+}
+
+namespace vm
+{
+	// The passes of a frame, each declaring the images it reads and writes and the state it needs them in. Before
+	// recording, the passes nothing depends on are culled and the rest are ordered so that a pass is recorded away
+	// from the one it waits on when another one is ready. Every pass is preceded by a single barrier with all the
+	// layout transitions and dependencies of its images, read after read in the same state needs none.
+	//
+	// The state of an image is kept in Image::layoutState and carries over to the next frame, so an image is only
+	// transitioned when a pass needs it in another state.
+	class RenderGraph
+	{
+	public:
+		using Execute = std::function<void(const vk::CommandBuffer& cmd)>;
+
+		class Pass
+		{
+		public:
+			// the pass samples or copies the image, it runs after the pass that wrote it and keeps that pass alive
+			Pass& read(Image& image, LayoutState state = LayoutState::ColorRead);
+			// the pass only needs the image in the state its descriptors expect, it does not use what the image holds
+			// (an effect switched off by a uniform), so whatever writes the image can be culled
+			Pass& bind(Image& image, LayoutState state = LayoutState::ColorRead);
+			Pass& write(Image& image, LayoutState state = LayoutState::ColorWrite);
+			// the pass has effects outside the graph (the swapchain, a history kept for the next frame), never culled
+			Pass& keep();
+
+		private:
+			friend class RenderGraph;
+
+			struct Access
+			{
+				Image* image;
+				LayoutState state;
+				bool write;
+				bool used;	// false for bind
+			};
+
+			Execute execute;
+			std::vector<Access> accesses{};
+			bool sideEffects = false;
+		};
+
+		// the passes are declared in an order they could be recorded in
+		Pass& addPass(Execute execute);
+		// the image is left in the state after the last pass, for the command buffers outside the graph
+		void release(Image& image, LayoutState state);
+		// culls, orders and records the passes added since the last execute
+		void execute(const vk::CommandBuffer& cmd);
+
+	private:
+		std::deque<Pass> passes{};
+		std::vector<std::pair<Image*, LayoutState>> releases{};
+		// if the last access of an image was a write, carried to the next frame along with its layout state
+		std::unordered_map<const Image*, bool> written{};
+
+		void barrier(const vk::CommandBuffer& cmd, const std::vector<Pass::Access>& accesses);
+	};
+}
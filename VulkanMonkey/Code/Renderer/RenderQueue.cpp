@@ -0,0 +1,104 @@
+#include "vulkanPCH.h"
+#include "RenderQueue.h"
+#include "FrameConstants.h"
+#include "../Core/JobSystem.h"
+#include "../Model/MaterialTable.h"
+#include <algorithm>
+
+namespace vm
+{
+	static_assert(MaterialTable::MAX_MATERIALS <= (1u << 14), "the material field of the sort key is 14 bits");
+	static_assert(FrameConstants::MAX_TRANSFORMS <= (1u << 12), "the model field of the sort key is 12 bits");
+
+	void RenderQueue::begin(cvec3& eye, cvec3& front)
+	{
+		this->eye = eye;
+		this->front = front;
+		items.clear();
+		unsorted.clear();
+		draws.clear();
+	}
+
+	void RenderQueue::add(const PrimitiveDraw& draw, uint16_t alphaMode, uint32_t material, uint32_t modelSlot, cvec3& center)
+	{
+		const float depth = dot(center - eye, front);
+		items.push_back({ makeKey(alphaMode, material, modelSlot, depth), static_cast<uint32_t>(unsorted.size()) });
+		unsorted.push_back(draw);
+	}
+
+	uint64_t RenderQueue::makeKey(uint16_t alphaMode, uint32_t material, uint32_t modelSlot, float depth)
+	{
+		// logarithmic buckets, the near draws that overdraw the most are told apart the best
+		const float bucket = log2(1.f + std::max(depth, 0.f)) * 2048.f;
+		const uint64_t depthBits = static_cast<uint64_t>(std::min(bucket, 65535.f));
+
+		const uint64_t alphaBits = static_cast<uint64_t>(alphaMode - 1) & 0x3; // ALPHA_OPAQUE 1, ALPHA_MASK 2, ALPHA_BLEND 3
+		const uint64_t materialBits = material & 0x3FFF;
+		const uint64_t modelBits = modelSlot & 0xFFF;
+
+		// blended draws are composed back to front, the rest front to back inside a material
+		if (alphaBits == 2)
+			return alphaBits << 62 | (0xFFFF - depthBits) << 46 | materialBits << 32 | modelBits << 20;
+		return alphaBits << 62 | materialBits << 48 | depthBits << 32 | modelBits << 20;
+	}
+
+	void RenderQueue::sort()
+	{
+		const uint32_t count = static_cast<uint32_t>(items.size());
+		scratch.resize(count);
+
+		const uint32_t chunks = std::max(1u, std::min(count / CHUNK_SIZE, JobSystem::get()->getWorkerCount() + 1));
+		const uint32_t chunkSize = (count + chunks - 1) / chunks;
+		histograms.resize(chunks);
+
+		const auto run = [chunks](const std::function<void(uint32_t)>& func) {
+			if (chunks == 1)
+				func(0);
+			else
+				JobSystem::get()->Wait(JobSystem::get()->parallel_for(chunks, 1, func));
+		};
+
+		Item* src = items.data();
+		Item* dst = scratch.data();
+		for (uint32_t shift = 0; shift < 64; shift += 8) {
+			run([&](uint32_t c) {
+				auto& histogram = histograms[c];
+				histogram.fill(0);
+				const uint32_t end = std::min(count, (c + 1) * chunkSize);
+				for (uint32_t i = c * chunkSize; i < end; i++)
+					histogram[(src[i].key >> shift) & 0xFF]++;
+			});
+
+			// a byte that is the same for every key leaves the order as it is
+			bool skip = false;
+			uint32_t offset = 0;
+			for (uint32_t digit = 0; digit < 256 && !skip; digit++) {
+				uint32_t total = 0;
+				for (uint32_t c = 0; c < chunks; c++) {
+					const uint32_t n = histograms[c][digit];
+					histograms[c][digit] = offset + total;
+					total += n;
+				}
+				skip = total == count;
+				offset += total;
+			}
+			if (skip)
+				continue;
+
+			// every chunk scatters in its own slots of the buckets, which keeps the sort stable
+			run([&](uint32_t c) {
+				auto& histogram = histograms[c];
+				const uint32_t end = std::min(count, (c + 1) * chunkSize);
+				for (uint32_t i = c * chunkSize; i < end; i++)
+					dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+			});
+			std::swap(src, dst);
+		}
+		if (src != items.data())
+			items.swap(scratch);
+
+		draws.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+			draws[i] = unsorted[items[i].draw];
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "../Core/Math.h"
+#include "../Model/Model.h"
+#include <array>
+#include <vector>
+
+namespace vm
+{
+	// The visible draws of the G-buffer pass, each with a 64 bit sort key. Sorted, the draws with the same state are
+	// next to each other and the recording skips the binds and pushes that did not change.
+	//
+	// opaque, mask:	alpha mode (2) | material (14) | depth front to back (16) | model slot (12) | 0 (20)
+	// blend:			alpha mode (2) | depth back to front (16) | material (14) | model slot (12) | 0 (20)
+	//
+	// A single pipeline records every draw of the pass, so the pipeline is not part of the key.
+	class RenderQueue
+	{
+	public:
+		// the camera the depth of the draws is measured from
+		void begin(cvec3& eye, cvec3& front);
+		void add(const PrimitiveDraw& draw, uint16_t alphaMode, uint32_t material, uint32_t modelSlot, cvec3& center);
+		// LSD radix sort of the keys, the histograms and the scatter of each byte are split across the workers
+		void sort();
+
+		const std::vector<PrimitiveDraw>& getDraws() const { return draws; }
+		uint32_t size() const { return static_cast<uint32_t>(draws.size()); }
+
+		static uint64_t makeKey(uint16_t alphaMode, uint32_t material, uint32_t modelSlot, float depth);
+
+	private:
+		struct Item
+		{
+			uint64_t key;
+			uint32_t draw;
+		};
+
+		static constexpr uint32_t CHUNK_SIZE = 4096; // keys per job, fewer keys are sorted on the calling thread
+
+		vec3 eye;
+		vec3 front;
+		std::vector<Item> items{};
+		std::vector<Item> scratch{};
+		std::vector<PrimitiveDraw> unsorted{};
+		std::vector<PrimitiveDraw> draws{};
+		std::vector<std::array<uint32_t, 256>> histograms{};
+	};
+}
@@ -0,0 +1,34 @@
+#include "vulkanPCH.h"
+#include "RenderSnapshot.h"
+
+namespace vm
+{
+	void RenderSnapshot::captureUploads()
+	{
+		uploads = Queue::takeMemcpyRequests();
+
+		size_t size = 0;
+		for (auto& upload : uploads)
+			for (auto& range : upload.memory_ranges)
+				size += range.size;
+		uploadData.resize(size);
+
+		// the update thread overwrites the sources with the next frame, while these are still to be uploaded
+		size_t offset = 0;
+		for (auto& upload : uploads) {
+			for (auto& range : upload.memory_ranges) {
+				memcpy(uploadData.data() + offset, range.data, range.size);
+				range.data = uploadData.data() + offset;
+				offset += range.size;
+			}
+		}
+	}
+
+	void RenderSnapshot::executeUploads()
+	{
+		// the uploads are plain copies in the cpu copy of the uniform ring, not worth spreading over the workers
+		for (auto& upload : uploads)
+			upload.exec_mem_copy();
+		uploads.clear();
+	}
+}
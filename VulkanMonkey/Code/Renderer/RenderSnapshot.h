@@ -0,0 +1,100 @@
+#pragma once
+#include "../Core/Math.h"
+#include "../Core/Queue.h"
+#include "../Camera/Camera.h"
+#include "../Culling/FrustumCulling.h"
+#include <array>
+#include <vector>
+
+namespace vm
+{
+	class Mesh;
+	class Primitive;
+	struct ImpostorAtlas;
+
+	// A primitive as the render thread draws it. The mesh and the primitive are owned by the model and only their
+	// gpu resources and load time data are read through them, unloading a model waits for the render thread.
+	struct PrimitiveSnapshot
+	{
+		Mesh* mesh;
+		Primitive* primitive;
+		bool render;
+		// the range of the group the camera view draws the primitive with and its own command in it, relative to
+		// the cull slot of the model, the size is only set on the first primitive of a group (see GPUCulling::prepare)
+		uint32_t cullGroup = 0, cullGroupSize = 0, cullCommand = 0;
+	};
+
+	// The per frame state of a model the render thread needs, copied out after the update
+	struct ModelSnapshot
+	{
+		bool render = true;
+		bool instanced = false;
+		uint32_t instanceCount = 1;
+		uint32_t transformSlot = 0;
+		ImpostorAtlas* impostor = nullptr;
+		// in cull index order, the primitives of a mesh are consecutive
+		std::vector<PrimitiveSnapshot> primitives{};
+		uint32_t cullSlot = 0; // slot of the first primitive in the gpu culling buffers, set on the render thread
+		VisibilityBitset visibility;
+		VisibilityBitset shadowVisibility[3]{};
+		CullingBounds cullingBounds;
+		uint32_t visibleInstances = 0;
+		vec4 impostorSphere = vec4(0.f);
+		float impostorBlend = 0.f;
+	};
+
+	// The GUI settings the frame is recorded with
+	struct RenderSettings
+	{
+		bool useGPUCulling = false;
+		bool useImpostors = false;
+		bool useBindless = false;
+		bool cacheSecondaries = false;
+		uint32_t recordingThreads = 1;
+
+		bool showSSAO = false;
+		bool showSSR = false;
+		bool useAntiAliasing = false;
+		bool useTAA = false;
+		bool useFXAA = false;
+		bool showBloom = false;
+		bool useDOF = false;
+		bool showMotionBlur = false;
+
+		bool shadowCast = false;
+		bool shadowSinglePass = false;
+		std::array<float, 3> depthBias{};
+	};
+
+	// Immutable state of a frame, produced by the update thread and consumed by the render thread.
+	// Two of them are kept, the update thread fills one while the render thread records and submits the other.
+	struct RenderSnapshot
+	{
+		RenderSettings settings;
+		std::vector<ModelSnapshot> models{};
+
+		// camera
+		std::vector<Camera::Plane> frustum{};
+		mat4 viewProjection;
+		vec3 cameraPosition;
+		vec3 cameraFront;
+
+		// shadows
+		bool shadowsRefresh[3]{};
+		uint32_t shadowsRefreshMask = 0;
+		uint32_t shadowsStaticMask = 0;
+		bool hasDynamicCasters = false;
+		std::vector<char> casterStates{};
+		Camera::Plane casterPlanes[3][5]{};
+		float casterMinRadius[3]{};
+
+		// uniform and vertex uploads, their memory ranges point in the data of the snapshot
+		std::vector<CopyRequest> uploads{};
+		std::vector<uint8_t> uploadData{};
+
+		// moves the queued memcpy requests in the snapshot, copying the source data as it is now
+		void captureUploads();
+		// writes the uploads in the cpu copy of the uniform ring, before the region of the frame is brought up to date
+		void executeUploads();
+	};
+}
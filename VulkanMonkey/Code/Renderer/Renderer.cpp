@@ -1,7 +1,13 @@
 #include "vulkanPCH.h"
 #include "Renderer.h"
 #include "../Core/Queue.h"
+#include "../Core/JobSystem.h"
 #include "../Model/Mesh.h"
+#include "../Model/Bindless.h"
+#include "../Model/MaterialTable.h"
+#include "../Model/GeometryPool.h"
+#include "../Model/Impostors.h"
+#include "FrameConstants.h"
 #include "../VulkanContext/VulkanContext.h"
 #include "../Camera/Camera.h"
 #include "../Context/Context.h"
@@ -22,6 +28,8 @@ namespace vm
 
 		// INIT VULKAN CONTEXT
 		vulkan.Init(ctx);
+		MaterialTable::get()->Init();
+		Bindless::get()->Init();
 		// INIT RENDERING
 		AddRenderTarget("viewport", vulkan.surface.formatKHR->format, vk::ImageUsageFlagBits::eTransferSrc);
 		AddRenderTarget("depth", vk::Format::eR32Sfloat, vk::ImageUsageFlags());
@@ -40,6 +48,7 @@ namespace vm
 
 		taa.Init();
 		bloom.Init();
+		occlusionCulling.Init(320, 192);
 		fxaa.Init();
 		motionBlur.Init();
 		dof.Init();
@@ -81,25 +90,40 @@ namespace vm
 		gui.createPipeline();
 
 		ComputePool::get()->Init(5);
+		JobSystem::get()->Init();
+		recorder.Init(static_cast<uint32_t>(VulkanContext::get()->frames.size()));
+		UniformRing::get()->Init(static_cast<uint32_t>(VulkanContext::get()->frames.size()), 8 * 1024 * 1024); // 8 MB of uniforms per frame
+		FrameConstants::get()->Init();
+		GeometryPool::get()->Init();
+		gpuCulling.Init(renderTargets);
+		Impostors::get()->Init(renderTargets, deferred.renderPass);
 
 		metrics.resize(20);
 		//LOAD RESOURCES
 		LoadResources();
 		// CREATE UNIFORMS AND DESCRIPTOR SETS
 		CreateUniforms();
+
+		renderThread = std::thread(&Renderer::RenderLoop, this);
 	}
 
 	Renderer::~Renderer()
 	{
+		if (renderThread.joinable()) {
+			WaitRender();
+			{
+				std::lock_guard<std::mutex> guard(renderMutex);
+				renderExit = true;
+			}
+			renderCondition.notify_one();
+			renderThread.join();
+		}
+
 		VulkanContext::get()->device->waitIdle();
 
 		Destroy();
 
 		if (Model::models.empty()) {
-			if (Pipeline::getDescriptorSetLayoutModel()) {
-				VulkanContext::get()->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutModel());
-				Pipeline::getDescriptorSetLayoutModel() = nullptr;
-			}
 			if (Pipeline::getDescriptorSetLayoutMesh()) {
 				VulkanContext::get()->device->destroyDescriptorSetLayout(Pipeline::getDescriptorSetLayoutMesh());
 				Pipeline::getDescriptorSetLayoutMesh() = nullptr;
@@ -121,6 +145,12 @@ namespace vm
 
 		ComputePool::get()->destroy();
 		ComputePool::remove();
+		recorder.destroy();
+		JobSystem::get()->destroy();
+		JobSystem::remove();
+		gpuCulling.destroy();
+		Impostors::get()->destroy();
+		Impostors::remove();
 		shadows.destroy();
 		deferred.destroy();
 		ssao.destroy();
@@ -134,34 +164,60 @@ namespace vm
 		skyBoxNight.destroy();
 		gui.destroy();
 		lightUniforms.destroy();
+		FrameConstants::get()->destroy();
+		FrameConstants::remove();
+		GeometryPool::get()->destroy();
+		GeometryPool::remove();
+		UniformRing::get()->destroy();
+		UniformRing::remove();
+		Bindless::get()->destroy();
+		Bindless::remove();
+		MaterialTable::get()->destroy();
+		MaterialTable::remove();
 		for (auto& metric : metrics)
 			metric.destroy();
 		ctx->GetVKContext()->Destroy();
 		ctx->GetVKContext()->remove();
 	}
 
-	void Renderer::CheckQueue() const
+	void Renderer::CheckQueue()
 	{
+		// a model loads for seconds on its own thread, the frames keep overlapping until it is ready
+		bool loaded = false;
+		for (auto& future : Queue::loadModelFutures)
+			loaded |= future.wait_for(std::chrono::seconds(0)) != std::future_status::timeout;
+
+		// the models and their gui lists are resized below and the device waits idle before a load or an unload, the
+		// render thread must not be recording or submitting
+		if (loaded || !Queue::loadModel.empty() || !Queue::unloadModel.empty()
+#ifdef USE_SCRIPTS
+			|| !Queue::addScript.empty() || !Queue::removeScript.empty() || !Queue::compileScript.empty()
+#endif
+			)
+			WaitRender();
+
 		for (auto it = Queue::loadModel.begin(); it != Queue::loadModel.end();) {
 			VulkanContext::get()->device->waitIdle();
-			Queue::loadModelFutures.push_back(std::async(std::launch::async, [](const std::string& folderPath, const std::string& modelName, bool show = true) {
+			Queue::loadModelFutures.push_back(std::async(std::launch::async, [](const std::string& folderPath, const std::string& modelName, uint32_t instances, uint32_t batchVertices, bool createImpostor, bool show = true) {
 				Model model;
-				model.loadModel(folderPath, modelName, show);
+				model.loadModel(folderPath, modelName, show, instances, batchVertices, createImpostor);
 				for (auto& _model : Model::models)
 					if (_model.name == model.name)
 						model.name = "_" + model.name;
 				return std::any(std::move(model));
-				}, std::get<0>(*it), std::get<1>(*it), true));
+				}, std::get<0>(*it), std::get<1>(*it), std::get<2>(*it), GUI::static_batching ? static_cast<uint32_t>(GUI::static_batch_vertices) : 0u, GUI::use_impostors, true));
 			it = Queue::loadModel.erase(it);
 		}
 
-		for (auto it = Queue::loadModelFutures.begin(); it != Queue::loadModelFutures.end();) {
+		// a load that finished after the check above waits for the next frame
+		for (auto it = Queue::loadModelFutures.begin(); loaded && it != Queue::loadModelFutures.end();) {
 			if (it->wait_for(std::chrono::seconds(0)) != std::future_status::timeout) {
 				Model::models.push_back(std::any_cast<Model>(it->get()));
 				GUI::modelList.push_back(Model::models.back().name);
 				GUI::model_scale.push_back({ 1.f, 1.f, 1.f });
 				GUI::model_pos.push_back({ 0.f, 0.f, 0.f });
 				GUI::model_rot.push_back({ 0.f, 0.f, 0.f });
+				recorder.invalidate();
 				it = Queue::loadModelFutures.erase(it);
 			}
 			else {
@@ -178,6 +234,7 @@ namespace vm
 			GUI::model_pos.erase(GUI::model_pos.begin() + *it);
 			GUI::model_rot.erase(GUI::model_rot.begin() + *it);
 			GUI::modelItemSelected = -1;
+			recorder.invalidate();
 			it = Queue::unloadModel.erase(it);
 		}
 #ifdef USE_SCRIPTS
@@ -212,6 +269,17 @@ namespace vm
 		static Timer timer;
 		timer.Start();
 
+		// job statistics of the previous frame
+		GUI::jobTasksCount = static_cast<int>(JobSystem::get()->getTaskCount());
+		GUI::jobTimeCount = static_cast<float>(JobSystem::get()->getTaskTime());
+		JobSystem::get()->resetStats();
+
+		// upload statistics of the previous frame
+		const auto uploadStats = Queue::takeUploadStats();
+		GUI::uploadedKBCount = static_cast<float>(uploadStats.first) / 1024.f;
+		GUI::skippedKBCount = static_cast<float>(uploadStats.second) / 1024.f;
+		GUI::flushedKBCount = static_cast<float>(UniformRing::get()->getFlushedBytes()) / 1024.f;
+
 		// check for commands in queue
 		CheckQueue();
 
@@ -224,9 +292,14 @@ namespace vm
 		CameraSystem* cameraSystem = ctx->GetSystem<CameraSystem>();
 		Camera& camera_main = cameraSystem->GetCamera(0);
 
-		// Model updates + 8(the rest updates)
-		std::vector<std::future<void>> futureUpdates;
-		futureUpdates.reserve(Model::models.size() + 8);
+		JobSystem* jobs = JobSystem::get();
+
+		// Model updates (one parallel_for) + 7(the rest updates), the gui is updated in Draw, at the sync with the render thread
+		std::vector<Job> updates;
+		updates.reserve(8);
+
+		// VIEW (the camera matrices every draw shares)
+		FrameConstants::get()->updateView(camera_main);
 
 		// MODELS
 		if (GUI::modelItemSelected > -1) {
@@ -234,56 +307,175 @@ namespace vm
 			Model::models[GUI::modelItemSelected].pos = vec3(GUI::model_pos[GUI::modelItemSelected].data());
 			Model::models[GUI::modelItemSelected].rot = vec3(GUI::model_rot[GUI::modelItemSelected].data());
 		}
-		for (auto& model : Model::models)
-		{
-			const auto updateModel = [&]() { model.update(camera_main, delta); };
-			futureUpdates.push_back(std::async(std::launch::async, updateModel));
-		}
-
-		// GUI
-		auto updateGUI = [&]() { gui.update(); };
-		futureUpdates.push_back(std::async(std::launch::async, updateGUI));
+		auto updateModel = [&](uint32_t i) { Model::models[i].update(camera_main, delta); };
+		updates.push_back(jobs->parallel_for(static_cast<uint32_t>(Model::models.size()), 1, updateModel));
 
 		// LIGHTS
 		auto updateLights = [&]() { lightUniforms.update(camera_main); };
-		futureUpdates.push_back(std::async(std::launch::async, updateLights));
+		updates.push_back(jobs->Execute(updateLights));
 
 		// SSAO
 		auto updateSSAO = [&]() { ssao.update(camera_main); };
-		futureUpdates.push_back(std::async(std::launch::async, updateSSAO));
+		updates.push_back(jobs->Execute(updateSSAO));
 
 		// SSR
 		auto updateSSR = [&]() { ssr.update(camera_main); };
-		futureUpdates.push_back(std::async(std::launch::async, updateSSR));
+		updates.push_back(jobs->Execute(updateSSR));
 
 		// TAA
 		auto updateTAA = [&]() { taa.update(camera_main); };
-		futureUpdates.push_back(std::async(std::launch::async, updateTAA));
+		updates.push_back(jobs->Execute(updateTAA));
 
 		// MOTION BLUR
 		auto updateMotionBlur = [&]() { motionBlur.update(camera_main); };
-		futureUpdates.push_back(std::async(std::launch::async, updateMotionBlur));
+		updates.push_back(jobs->Execute(updateMotionBlur));
 
 		// SHADOWS
 		auto updateShadows = [&]() { shadows.update(camera_main); };
-		futureUpdates.push_back(std::async(std::launch::async, updateShadows));
+		updates.push_back(jobs->Execute(updateShadows));
 
 		// COMPOSITION UNIFORMS
 		auto updateDeferred = [&]() { deferred.update(camera_main.invViewProjection); };
-		futureUpdates.push_back(std::async(std::launch::async, updateDeferred));
-
-		for (auto& f : futureUpdates)
-			f.get();
+		updates.push_back(jobs->Execute(updateDeferred));
+
+		jobs->Wait(updates);
+
+		// SHADOW CACHE (needs the model matrices of this frame)
+		shadows.updateCasterStates(Model::models);
+
+		// SHADOW CASTERS CULLING (the gpu culling does it on the render thread, from the snapshot)
+		if (GUI::shadow_cast && !GUI::use_GPU_culling) {
+			for (uint32_t i = 0; i < 3; i++) {
+				if (!shadows.refresh[i])
+					continue;
+				auto cullCasters = [&](uint32_t m) {
+					auto& model = Model::models[m];
+					if (model.render) {
+						FrustumCulling::Cull(model.cullingBounds, shadows.casterPlanes[i], 5, model.shadowVisibility[i]);
+						if (shadows.casterMinRadius[i] > 0.f)
+							FrustumCulling::CullSmall(model.cullingBounds, shadows.casterMinRadius[i], model.shadowVisibility[i]);
+					}
+				};
+				jobs->Wait(jobs->parallel_for(static_cast<uint32_t>(Model::models.size()), 1, cullCasters));
+			}
+		}
 
-		static Timer timerFenceWait;
-		timerFenceWait.Start();
-		VulkanContext::get()->waitFences((*VulkanContext::get()->fences)[previousImageIndex]);
-		FrameTimer::Instance().timestamps[0] = timerFenceWait.Count();
-		Queue::exec_memcpyRequests();
+		// OCCLUSION CULLING (needs every model frustum culled first)
+		if (GUI::use_occlusion_culling)
+			GUI::occluded_primitives = static_cast<int>(occlusionCulling.Cull(camera_main, Model::models, static_cast<uint32_t>(GUI::occluder_triangle_budget)));
 
 		GUI::updatesTimeCount = static_cast<float>(timer.Count());
 	}
 
+	void Renderer::CaptureSnapshot(RenderSnapshot& frame, Camera& camera)
+	{
+		// the gui is only changed between the frames, the render thread records with this copy of it
+		auto& settings = frame.settings;
+		settings.useGPUCulling = GUI::use_GPU_culling;
+		settings.useImpostors = GUI::use_impostors;
+		settings.useBindless = GUI::use_bindless && Bindless::get()->supported();
+		settings.cacheSecondaries = GUI::cache_secondaries;
+		settings.recordingThreads = static_cast<uint32_t>(GUI::recording_threads);
+		settings.showSSAO = GUI::show_ssao;
+		settings.showSSR = GUI::show_ssr;
+		settings.useAntiAliasing = GUI::use_AntiAliasing;
+		settings.useTAA = GUI::use_TAA;
+		settings.useFXAA = GUI::use_FXAA;
+		settings.showBloom = GUI::show_Bloom;
+		settings.useDOF = GUI::use_DOF;
+		settings.showMotionBlur = GUI::show_motionBlur;
+		settings.shadowCast = GUI::shadow_cast;
+		settings.shadowSinglePass = GUI::shadow_single_pass;
+		settings.depthBias = GUI::depthBias;
+
+		frame.models.resize(Model::models.size());
+		for (size_t m = 0; m < Model::models.size(); m++) {
+			auto& model = Model::models[m];
+			auto& snapshot = frame.models[m];
+			snapshot.render = model.render;
+			snapshot.instanced = model.isInstanced();
+			snapshot.instanceCount = model.instanceCount();
+			snapshot.transformSlot = model.transformSlot;
+			snapshot.impostor = model.impostor;
+			snapshot.primitives.clear();
+			for (auto& node : model.linearNodes) {
+				if (node->mesh) {
+					for (auto& primitive : node->mesh->primitives)
+						snapshot.primitives.push_back({ node->mesh.get(), &primitive, primitive.render });
+				}
+			}
+			snapshot.visibility = model.visibility;
+			for (uint32_t i = 0; i < 3; i++)
+				snapshot.shadowVisibility[i] = model.shadowVisibility[i];
+			snapshot.cullingBounds = model.cullingBounds;
+			snapshot.visibleInstances = model.visibleInstances;
+			snapshot.impostorSphere = model.impostorSphere;
+			snapshot.impostorBlend = model.impostorBlend;
+		}
+
+		frame.frustum = camera.frustum;
+		frame.viewProjection = camera.projection * camera.view;
+		frame.cameraPosition = camera.position;
+		frame.cameraFront = camera.front;
+
+		frame.shadowsRefreshMask = 0;
+		frame.shadowsStaticMask = 0;
+		for (uint32_t i = 0; i < 3; i++) {
+			frame.shadowsRefresh[i] = GUI::shadow_cast && shadows.refresh[i];
+			if (frame.shadowsRefresh[i]) {
+				frame.shadowsRefreshMask |= 1u << i;
+				if (shadows.staticDirty[i])
+					frame.shadowsStaticMask |= 1u << i;
+			}
+			for (uint32_t p = 0; p < 5; p++)
+				frame.casterPlanes[i][p] = shadows.casterPlanes[i][p];
+			frame.casterMinRadius[i] = shadows.casterMinRadius[i];
+		}
+		frame.hasDynamicCasters = shadows.hasDynamicCasters;
+		frame.casterStates = shadows.casterStates;
+
+		// the shadow cache bookkeeping is done as the frame is published, the render thread only reads the snapshot
+		for (uint32_t i = 0; i < 3; i++) {
+			if (frame.shadowsStaticMask & (1u << i))
+				shadows.staticDirty[i] = false;
+			if (frame.shadowsRefresh[i])
+				shadows.dynamicInLayer[i] = frame.hasDynamicCasters;
+		}
+
+		// the transforms of the models updated in this frame
+		FrameConstants::get()->queueTransforms();
+		frame.captureUploads();
+	}
+
+	void Renderer::WaitRender()
+	{
+		std::unique_lock<std::mutex> lock(renderMutex);
+		renderCondition.wait(lock, [this]() { return !renderBusy; });
+	}
+
+	void Renderer::RenderLoop()
+	{
+		while (true) {
+			RenderSnapshot* frame;
+			{
+				std::unique_lock<std::mutex> lock(renderMutex);
+				renderCondition.wait(lock, [this]() { return pendingSnapshot || renderExit; });
+				if (renderExit)
+					return;
+				frame = pendingSnapshot;
+				pendingSnapshot = nullptr;
+			}
+
+			Render(*frame);
+
+			{
+				std::lock_guard<std::mutex> guard(renderMutex);
+				renderBusy = false;
+			}
+			renderCondition.notify_all();
+		}
+	}
+
 	void Renderer::RecordComputeCmds(const uint32_t sizeX, const uint32_t sizeY, const uint32_t sizeZ)
 	{
 		//auto beginInfo = vk::CommandBufferBeginInfo()
@@ -297,180 +489,446 @@ namespace vm
 		//cmd.bindPipeline(vk::PipelineBindPoint::eCompute, ctx.compute.pipeline.pipeline);
 		//cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, ctx.compute.pipeline.compinfo.layout, 0, ctx.compute.DSCompute, nullptr);
 		//cmd.dispatch(sizeX, sizeY, sizeZ);
-		//ctx.metrics[13].end(&GUI::metrics[13]);
+		//ctx.metrics[13].end(&renderMetrics[13]);
 		//
 		//cmd.end();
 	}
 
-	void Renderer::RecordDeferredCmds(const uint32_t& imageIndex)
+	// handles and flags are gathered as words and hashed together, as the key of a cached pass
+	template<class T>
+	static size_t handleWord(const T& handle)
+	{
+		return reinterpret_cast<size_t>(static_cast<typename T::CType>(handle));
+	}
+
+	static size_t hashWords(const std::vector<size_t>& words)
+	{
+		return MemoryHash(words.data(), words.size() * sizeof(size_t)).getHash();
+	}
+
+	void Renderer::RecordDeferredCmds(const uint32_t& imageIndex, const RenderSnapshot& frame)
 	{
 		vk::CommandBufferBeginInfo beginInfo;
 		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
 
-		const auto& cmd = (*VulkanContext::get()->dynamicCmdBuffers)[imageIndex];
+		const uint32_t frameIndex = VulkanContext::get()->frameIndex;
+		const auto& cmd = *VulkanContext::get()->frames[frameIndex].dynamicCmdBuffer;
 
 		cmd.begin(beginInfo);
 		// TODO: add more queries (times the swapchain images), so they are not overlapped from previous frame
 		metrics[0].start(&cmd);
 
 		// SKYBOX
-		SkyBox& skybox = GUI::shadow_cast ? skyBoxDay : skyBoxNight;
+		SkyBox& skybox = frame.settings.shadowCast ? skyBoxDay : skyBoxNight;
+
+		// every pass declares the targets it samples and renders to, the graph transitions them and culls the
+		// passes whose targets nothing samples (ssao and ssr are only sampled by the composition when enabled)
+		auto& viewport = renderTargets["viewport"];
+		auto& depth = renderTargets["depth"];
+		auto& normal = renderTargets["normal"];
+		auto& albedo = renderTargets["albedo"];
+		auto& srm = renderTargets["srm"];
+		auto& velocity = renderTargets["velocity"];
+		auto& emissive = renderTargets["emissive"];
+		auto& ssaoBlur = renderTargets["ssaoBlur"];
+		auto& ssrTarget = renderTargets["ssr"];
 
 		// MODELS
-		metrics[2].start(&cmd);
-		deferred.batchStart(cmd, imageIndex, *renderTargets["viewport"].extent);
-		for (auto& model : Model::models)
-			model.draw();
-		deferred.batchEnd();
-		metrics[2].end(&GUI::metrics[2]);
-
-		renderTargets["albedo"].changeLayout(cmd, LayoutState::ColorRead);
-		renderTargets["depth"].changeLayout(cmd, LayoutState::ColorRead);
-		renderTargets["normal"].changeLayout(cmd, LayoutState::ColorRead);
-		renderTargets["srm"].changeLayout(cmd, LayoutState::ColorRead);
-		renderTargets["emissive"].changeLayout(cmd, LayoutState::ColorRead);
-		renderTargets["ssr"].changeLayout(cmd, LayoutState::ColorRead);
-		renderTargets["ssaoBlur"].changeLayout(cmd, LayoutState::ColorRead);
-		renderTargets["velocity"].changeLayout(cmd, LayoutState::ColorRead);
-		renderTargets["taa"].changeLayout(cmd, LayoutState::ColorRead);
-		for (auto& image : shadows.textures)
-			image.changeLayout(cmd, LayoutState::DepthRead);
+		renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+			metrics[2].start(&cmd);
+			if (frame.settings.useGPUCulling) {
+				gpuCulling.cull(cmd, 0, true);
+				Model::gpuCulling = &gpuCulling;
+			}
+			// IMPOSTORS, a model loaded since the last frame gets its atlases before the pass that may draw them
+			auto& impostors = *Impostors::get();
+			if (frame.settings.useImpostors)
+				impostors.bake(cmd, frame);
+			impostors.collect(frame);
+
+			// the visible draws sorted by state and depth, all the opaque first and the blended last
+			// the meshes of a model fading to its impostor keep the pixels the impostor does not draw
+			renderQueue.begin(frame.cameraPosition, frame.cameraFront);
+			for (auto& model : frame.models)
+				Model::collectDraws(renderQueue, model, 1.f - impostors.blend(model, frame));
+			renderQueue.sort();
+			const auto& draws = renderQueue.getDraws();
+			const uint32_t count = renderQueue.size();
+			// the impostors are one more item after the draws
+			const uint32_t items = impostors.getDraws().empty() ? count : count + 1;
+
+			const uint32_t threads = frame.settings.recordingThreads;
+			if (threads > 1 || frame.settings.cacheSecondaries) {
+				// the sorted draws are split in ranges across the threads, the last range records the impostors
+				const auto drawRange = [&draws, &impostors, count](const vk::CommandBuffer& secondary, uint32_t first, uint32_t last) {
+					if (first < count)
+						Model::drawList(secondary, &draws[first], minimum(last, count) - first);
+					if (last > count)
+						impostors.draw(secondary);
+				};
+				deferred.batchStart(cmd, imageIndex, *viewport.extent, vk::SubpassContents::eSecondaryCommandBuffers, frame.settings.useBindless);
+				if (frame.settings.cacheSecondaries) {
+					// the camera and the models only reach the secondaries through their uniform buffers
+					std::vector<size_t> words{ handleWord(Model::pipelineBindless ? *deferred.pipelineBindless.handle : *deferred.pipeline.handle), frame.settings.useGPUCulling };
+					if (frame.settings.useGPUCulling) {
+						words.push_back(handleWord(*gpuCulling.commandBuffer.buffer));
+						words.push_back(gpuCulling.compacted());
+					}
+					words.push_back(MemoryHash(draws.data(), draws.size() * sizeof(PrimitiveDraw)).getHash());
+					words.push_back(MemoryHash(impostors.getDraws().data(), impostors.getDraws().size() * sizeof(Impostors::Draw)).getHash());
+					recorder.recordCached(cmd, frameIndex, RecordPass::GBuffer, hashWords(words), *deferred.renderPass.handle, threads, items, drawRange);
+				}
+				else {
+					recorder.record(cmd, frameIndex, *deferred.renderPass.handle, *deferred.framebuffers[imageIndex].handle, threads, items, drawRange);
+				}
+			}
+			else {
+				deferred.batchStart(cmd, imageIndex, *viewport.extent, vk::SubpassContents::eInline, frame.settings.useBindless);
+				Model::drawList(cmd, draws.data(), count);
+				impostors.draw(cmd);
+			}
+			Deferred::batchEnd(cmd);
+			Model::gpuCulling = nullptr;
+			metrics[2].end(&renderMetrics[2]);
+		}).write(depth).write(normal).write(albedo).write(srm).write(velocity).write(emissive);
+
+		// DEPTH PYRAMID (occlusion of the next frame gpu culling)
+		if (frame.settings.useGPUCulling) {
+			renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+				gpuCulling.buildDepthPyramid(cmd);
+			}).read(depth).keep();
+		}
 
 		// SCREEN SPACE AMBIENT OCCLUSION
-		if (GUI::show_ssao) {
+		renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
 			metrics[3].start(&cmd);
-			renderTargets["ssaoBlur"].changeLayout(cmd, LayoutState::ColorWrite);
 			ssao.draw(cmd, imageIndex, renderTargets["ssao"]);
-			renderTargets["ssaoBlur"].changeLayout(cmd, LayoutState::ColorRead);
-			metrics[3].end(&GUI::metrics[3]);
-		}
+			metrics[3].end(&renderMetrics[3]);
+		}).read(depth).read(normal).write(ssaoBlur);
 
 		// SCREEN SPACE REFLECTIONS
-		if (GUI::show_ssr) {
+		renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
 			metrics[4].start(&cmd);
-			renderTargets["ssr"].changeLayout(cmd, LayoutState::ColorWrite);
-			ssr.draw(cmd, imageIndex, *renderTargets["ssr"].extent);
-			renderTargets["ssr"].changeLayout(cmd, LayoutState::ColorRead);
-			metrics[4].end(&GUI::metrics[4]);
-		}
+			ssr.draw(cmd, imageIndex, *ssrTarget.extent);
+			metrics[4].end(&renderMetrics[4]);
+		}).read(albedo).read(depth).read(normal).read(srm).write(ssrTarget);
 
 		// COMPOSITION
-		metrics[5].start(&cmd);
-		deferred.draw(cmd, imageIndex, shadows, skybox, *renderTargets["viewport"].extent);
-		metrics[5].end(&GUI::metrics[5]);
-
-		if (GUI::use_AntiAliasing) {
+		auto& composition = renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+			metrics[5].start(&cmd);
+			deferred.draw(cmd, imageIndex, shadows, skybox, *viewport.extent);
+			metrics[5].end(&renderMetrics[5]);
+		});
+		composition.read(depth).read(normal).read(albedo).read(srm).read(emissive).read(shadows.atlas, LayoutState::DepthRead);
+		if (frame.settings.showSSAO)
+			composition.read(ssaoBlur);
+		else
+			composition.bind(ssaoBlur);
+		if (frame.settings.showSSR)
+			composition.read(ssrTarget);
+		else
+			composition.bind(ssrTarget);
+		composition.write(viewport);
+
+		// the effects on the composed frame copy it and render over it, the copy and the effect are two passes
+		// so the transitions of the copy are batched before and after it
+		const auto addCopy = [&](Image& frameImage, uint32_t metric) {
+			renderGraph.addPass([&frameImage, &viewport, metric, this](const vk::CommandBuffer& cmd) {
+				metrics[metric].start(&cmd);
+				frameImage.copyImage(cmd, viewport);
+			}).read(viewport, LayoutState::TransferRead).write(frameImage, LayoutState::TransferWrite);
+		};
+
+		if (frame.settings.useAntiAliasing) {
 			// TAA
-			if (GUI::use_TAA) {
-				metrics[6].start(&cmd);
-				taa.copyFrameImage(cmd, renderTargets["viewport"]);
-				taa.draw(cmd, imageIndex, renderTargets);
-				metrics[6].end(&GUI::metrics[6]);
+			if (frame.settings.useTAA) {
+				addCopy(taa.frameImage, 6);
+				renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+					taa.draw(cmd, imageIndex, renderTargets);
+					metrics[6].end(&renderMetrics[6]);
+				}).read(taa.frameImage).read(depth).read(velocity).write(viewport);
 			}
 			// FXAA
-			else if (GUI::use_FXAA) {
-				metrics[6].start(&cmd);
-				fxaa.copyFrameImage(cmd, renderTargets["viewport"]);
-				fxaa.draw(cmd, imageIndex, *renderTargets["viewport"].extent);
-				metrics[6].end(&GUI::metrics[6]);
+			else if (frame.settings.useFXAA) {
+				addCopy(fxaa.frameImage, 6);
+				renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+					fxaa.draw(cmd, imageIndex, *viewport.extent);
+					metrics[6].end(&renderMetrics[6]);
+				}).read(fxaa.frameImage).write(viewport);
 			}
 		}
 
 		// BLOOM
-		if (GUI::show_Bloom) {
-			metrics[7].start(&cmd);
-			bloom.copyFrameImage(cmd, renderTargets["viewport"]);
-			bloom.draw(cmd, imageIndex, renderTargets);
-			metrics[7].end(&GUI::metrics[7]);
+		if (frame.settings.showBloom) {
+			addCopy(bloom.frameImage, 7);
+			renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+				bloom.draw(cmd, imageIndex, renderTargets);
+				metrics[7].end(&renderMetrics[7]);
+			}).read(bloom.frameImage).write(viewport);
 		}
 
 		// Depth of Field
-		if (GUI::use_DOF) {
-			metrics[8].start(&cmd);
-			dof.copyFrameImage(cmd, renderTargets["viewport"]);
-			dof.draw(cmd, imageIndex, renderTargets);
-			metrics[8].end(&GUI::metrics[8]);
+		if (frame.settings.useDOF) {
+			addCopy(dof.frameImage, 8);
+			renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+				dof.draw(cmd, imageIndex, renderTargets);
+				metrics[8].end(&renderMetrics[8]);
+			}).read(dof.frameImage).read(depth).write(viewport);
 		}
 
 		// MOTION BLUR
-		if (GUI::show_motionBlur) {
-			metrics[9].start(&cmd);
-			motionBlur.copyFrameImage(cmd, renderTargets["viewport"]);
-			motionBlur.draw(cmd, imageIndex, *renderTargets["viewport"].extent);
-			metrics[9].end(&GUI::metrics[9]);
+		if (frame.settings.showMotionBlur) {
+			addCopy(motionBlur.frameImage, 9);
+			renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+				motionBlur.draw(cmd, imageIndex, *viewport.extent);
+				metrics[9].end(&renderMetrics[9]);
+			}).read(motionBlur.frameImage).read(depth).read(velocity).write(viewport);
 		}
 
-		renderTargets["albedo"].changeLayout(cmd, LayoutState::ColorWrite);
-		renderTargets["depth"].changeLayout(cmd, LayoutState::ColorWrite);
-		renderTargets["normal"].changeLayout(cmd, LayoutState::ColorWrite);
-		renderTargets["srm"].changeLayout(cmd, LayoutState::ColorWrite);
-		renderTargets["emissive"].changeLayout(cmd, LayoutState::ColorWrite);
-		renderTargets["ssr"].changeLayout(cmd, LayoutState::ColorWrite);
-		renderTargets["ssaoBlur"].changeLayout(cmd, LayoutState::ColorWrite);
-		renderTargets["velocity"].changeLayout(cmd, LayoutState::ColorWrite);
-		renderTargets["taa"].changeLayout(cmd, LayoutState::ColorWrite);
-		for (auto& image : shadows.textures)
-			image.changeLayout(cmd, LayoutState::DepthWrite);
-
 		// GUI
-		metrics[10].start(&cmd);
-		gui.scaleToRenderArea(cmd, renderTargets["viewport"], imageIndex);
-		gui.draw(cmd, imageIndex);
-		metrics[10].end(&GUI::metrics[10]);
+		renderGraph.addPass([&](const vk::CommandBuffer& cmd) {
+			metrics[10].start(&cmd);
+			gui.scaleToRenderArea(cmd, viewport, imageIndex);
+			gui.draw(cmd, imageIndex);
+			metrics[10].end(&renderMetrics[10]);
+		}).read(viewport, LayoutState::TransferRead).keep();
 
-		metrics[0].end(&GUI::metrics[0]);
+		// the shadow passes of the next frame render to the atlas
+		renderGraph.release(shadows.atlas, LayoutState::DepthWrite);
+		renderGraph.execute(cmd);
+
+		metrics[0].end(&renderMetrics[0]);
 
 		cmd.end();
 	}
 
-	void Renderer::RecordShadowsCmds(const uint32_t& imageIndex)
+	void Renderer::RecordShadowsCmds(const uint32_t& imageIndex, const RenderSnapshot& frame)
 	{
 		// Render Pass (shadows mapping) (outputs the depth image with the light POV)
 
-		const vk::DeviceSize offset = vk::DeviceSize();
-		std::array<vk::ClearValue, 1> clearValuesShadows{};
-		clearValuesShadows[0].depthStencil = vk::ClearDepthStencilValue{ 0.0f, 0 };
+		const uint32_t frameIndex = VulkanContext::get()->frameIndex;
+		const uint32_t dynamicOffset = UniformRing::get()->frameOffset();
 
 		vk::CommandBufferBeginInfo beginInfoShadows;
 		beginInfoShadows.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
 
 		vk::RenderPassBeginInfo renderPassInfoShadows;
 		renderPassInfoShadows.renderPass = *shadows.renderPass.handle;
-		renderPassInfoShadows.renderArea = vk::Rect2D{ { 0, 0 },{ Shadows::imageSize, Shadows::imageSize } };
-		renderPassInfoShadows.clearValueCount = static_cast<uint32_t>(clearValuesShadows.size());
-		renderPassInfoShadows.pClearValues = clearValuesShadows.data();
-
-		for (uint32_t i = 0; i < shadows.textures.size(); i++) {
-			auto& cmd = (*VulkanContext::get()->shadowCmdBuffers)[static_cast<uint32_t>(shadows.textures.size()) * imageIndex + i];
-			cmd.begin(beginInfoShadows);
-			metrics[11 + static_cast<size_t>(i)].start(&cmd);
-			cmd.setDepthBias(GUI::depthBias[0], GUI::depthBias[1], GUI::depthBias[2]);
-
-			// depth[i] image ===========================================================
-			renderPassInfoShadows.framebuffer = *shadows.framebuffers[shadows.textures.size() * imageIndex + i].handle;
-			cmd.beginRenderPass(renderPassInfoShadows, vk::SubpassContents::eInline);
-			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *shadows.pipeline.handle);
-			for (auto& model : Model::models) {
-				if (model.render) {
-					cmd.bindVertexBuffers(0, *model.vertexBuffer.buffer, offset);
-					cmd.bindIndexBuffer(*model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
-
-					for (auto& node : model.linearNodes) {
-						if (node->mesh) {
-							cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *shadows.pipeline.layout, 0, { (*shadows.descriptorSets)[i], *node->mesh->descriptorSet, *model.descriptorSet }, nullptr);
-							for (auto& primitive : node->mesh->primitives) {
-								if (primitive.render)
-									cmd.drawIndexed(primitive.indicesSize, 1, node->mesh->indexOffset + primitive.indexOffset, node->mesh->vertexOffset + primitive.vertexOffset, 0);
-							}
+		renderPassInfoShadows.renderArea = vk::Rect2D{ { 0, 0 },{ shadows.atlasWidth, shadows.atlasHeight } };
+
+		// draws the casters of cascade i with the given state (1: static, 2: dynamic) of the models in [first, last)
+		auto drawCasters = [&](const vk::CommandBuffer& cmd, uint32_t i, char state, uint32_t first, uint32_t last)
+		{
+			shadows.setCascadeViewport(cmd, i);
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *shadows.pipeline.layout, 0, (*shadows.descriptorSets)[i], dynamicOffset);
+			FrameConstants::get()->bind(cmd, *shadows.pipeline.layout, 2);
+			GeometryPool::get()->bind(cmd);
+			for (uint32_t m = first; m < last; m++) {
+				auto& model = frame.models[m];
+				if (frame.casterStates[m] != state)
+					continue;
+
+				cmd.pushConstants<uint32_t>(*shadows.pipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, model.transformSlot);
+				// every instance of an instanced model casts, the primitive bounds only cover the model matrix
+				const bool instanced = model.instanced;
+
+				const auto& primitives = model.primitives;
+				for (uint32_t p = 0, next = 0; p < primitives.size(); p = next) {
+					Mesh* mesh = primitives[p].mesh;
+					for (next = p + 1; next < primitives.size() && primitives[next].mesh == mesh; next++);
+					cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *shadows.pipeline.layout, 1, *mesh->descriptorSet, dynamicOffset);
+					// the culling pass compacts the visible primitives of the mesh, one indirect call draws them
+					if (frame.settings.useGPUCulling && !instanced) {
+						gpuCulling.drawGroup(cmd, i + 1, model.cullSlot + p, next - p);
+						continue;
+					}
+					for (uint32_t idx = p; idx < next; idx++) {
+						const Primitive& primitive = *primitives[idx].primitive;
+						if (primitives[idx].render && (instanced || model.shadowVisibility[i].test(idx)))
+							cmd.drawIndexed(primitive.indicesSize, model.instanceCount, mesh->indexOffset + primitive.indexOffset, mesh->vertexOffset + primitive.vertexOffset, 0);
+					}
+				}
+			}
+		};
+
+		// draws the casters with the given state of all the cascades in the mask, instanced across them in single pass
+		auto drawCastersSinglePass = [&](const vk::CommandBuffer& cmd, uint32_t cascadeMask, char state, uint32_t first, uint32_t last)
+		{
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *shadows.pipelineSinglePass.layout, 0, *shadows.descriptorSetSinglePass, dynamicOffset);
+			FrameConstants::get()->bind(cmd, *shadows.pipelineSinglePass.layout, 2);
+			GeometryPool::get()->bind(cmd);
+			uint32_t pushedMask = 0;
+			for (uint32_t m = first; m < last; m++) {
+				auto& model = frame.models[m];
+				if (frame.casterStates[m] != state)
+					continue;
+
+				// the instances of the model are the innermost, each cascade draws them all
+				const bool instanced = model.instanced;
+				const uint32_t transforms[2]{ model.transformSlot, model.instanceCount };
+				cmd.pushConstants(*shadows.pipelineSinglePass.layout, vk::ShaderStageFlagBits::eVertex, sizeof(uint32_t), sizeof(transforms), transforms);
+
+				Mesh* boundMesh = nullptr;
+				for (uint32_t idx = 0; idx < model.primitives.size(); idx++) {
+					const auto& snapshot = model.primitives[idx];
+					if (!snapshot.render)
+						continue;
+					// the primitive is drawn once in every cascade it is visible in
+					uint32_t mask = 0, instances = 0;
+					for (uint32_t i = 0; i < 3; i++) {
+						if (cascadeMask & (1u << i) && (instanced || model.shadowVisibility[i].test(idx))) {
+							mask |= 1u << i;
+							instances++;
 						}
 					}
+					if (!instances)
+						continue;
+					if (snapshot.mesh != boundMesh) {
+						cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *shadows.pipelineSinglePass.layout, 1, *snapshot.mesh->descriptorSet, dynamicOffset);
+						boundMesh = snapshot.mesh;
+					}
+					if (mask != pushedMask) {
+						cmd.pushConstants(*shadows.pipelineSinglePass.layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(mask), &mask);
+						pushedMask = mask;
+					}
+					const Primitive& primitive = *snapshot.primitive;
+					cmd.drawIndexed(primitive.indicesSize, instances * transforms[1], snapshot.mesh->indexOffset + primitive.indexOffset, snapshot.mesh->vertexOffset + primitive.vertexOffset, 0);
 				}
 			}
+		};
+
+		// the gpu culling writes the draw commands of each cascade separately, so it keeps a pass per cascade
+		const bool singlePass = frame.settings.shadowSinglePass && shadows.singlePassSupported && !frame.settings.useGPUCulling;
+		const uint32_t modelCount = static_cast<uint32_t>(frame.models.size());
+
+		// draws the items [first, last) of the cascades in the mask, an item is a model in single pass, else a (cascade, model) pair
+		auto drawCascades = [&](const vk::CommandBuffer& cmd, uint32_t cascadeMask, char state, uint32_t first, uint32_t last)
+		{
+			if (singlePass) {
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *shadows.pipelineSinglePass.handle);
+				cmd.setDepthBias(frame.settings.depthBias[0], frame.settings.depthBias[1], frame.settings.depthBias[2]);
+				shadows.setCascadeViewports(cmd);
+				drawCastersSinglePass(cmd, cascadeMask, state, first, last);
+			}
+			else {
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *shadows.pipeline.handle);
+				cmd.setDepthBias(frame.settings.depthBias[0], frame.settings.depthBias[1], frame.settings.depthBias[2]);
+				uint32_t item = 0;
+				for (uint32_t i = 0; i < 3; i++) {
+					if (!(cascadeMask & (1u << i)))
+						continue;
+					const uint32_t begin = std::max(first, item), end = std::min(last, item + modelCount);
+					if (begin < end)
+						drawCasters(cmd, i, state, begin - item, end - item);
+					item += modelCount;
+				}
+			}
+		};
+		auto itemCount = [&](uint32_t cascadeMask)
+		{
+			if (singlePass)
+				return modelCount;
+			uint32_t cascades = 0;
+			for (uint32_t i = 0; i < 3; i++)
+				cascades += (cascadeMask >> i) & 1u;
+			return cascades * modelCount;
+		};
+
+		// everything the secondaries of a pass record, the casters of the pass and their visibility in its cascades
+		auto passKey = [&](uint32_t cascadeMask, char state)
+		{
+			std::vector<size_t> words{ cascadeMask, static_cast<size_t>(state), singlePass, frame.settings.useGPUCulling };
+			words.push_back(handleWord(singlePass ? *shadows.pipelineSinglePass.handle : *shadows.pipeline.handle));
+			words.push_back(MemoryHash(frame.settings.depthBias).getHash());
+			words.push_back(MemoryHash(shadows.atlasRects).getHash());
+			if (frame.settings.useGPUCulling) {
+				words.push_back(handleWord(*gpuCulling.commandBuffer.buffer));
+				words.push_back(gpuCulling.slotCount);
+				words.push_back(gpuCulling.compacted());
+			}
+			for (uint32_t m = 0; m < modelCount; m++) {
+				if (frame.casterStates[m] != state)
+					continue;
+				words.push_back(m);
+				if (frame.settings.useGPUCulling)
+					continue;
+				for (uint32_t i = 0; i < 3; i++) {
+					const auto& bytes = frame.models[m].shadowVisibility[i].bytes;
+					if (cascadeMask & (1u << i))
+						words.push_back(MemoryHash(bytes.data(), bytes.size()).getHash());
+				}
+			}
+			return hashWords(words);
+		};
+
+		// records a pass of the cascades in the mask inline or split across the recording threads, the prologue is
+		// recorded first (in the first secondary when recording in parallel, as the primary can only execute them)
+		const uint32_t threads = frame.settings.recordingThreads;
+		auto recordPass = [&](const vk::CommandBuffer& cmd, const Framebuffer& framebuffer, RecordPass pass, uint32_t cascadeMask, char state, const std::function<void(const vk::CommandBuffer&)>& prologue)
+		{
+			renderPassInfoShadows.framebuffer = *framebuffer.handle;
+			const uint32_t count = itemCount(cascadeMask);
+			if (threads > 1 || frame.settings.cacheSecondaries) {
+				cmd.beginRenderPass(renderPassInfoShadows, vk::SubpassContents::eSecondaryCommandBuffers);
+				const auto drawRange = [&](const vk::CommandBuffer& secondary, uint32_t first, uint32_t last) {
+					if (first == 0 && prologue)
+						prologue(secondary);
+					drawCascades(secondary, cascadeMask, state, first, last);
+				};
+				if (frame.settings.cacheSecondaries)
+					recorder.recordCached(cmd, frameIndex, pass, passKey(cascadeMask, state), *shadows.renderPass.handle, threads, count, drawRange);
+				else
+					recorder.record(cmd, frameIndex, *shadows.renderPass.handle, *framebuffer.handle, threads, count, drawRange);
+			}
+			else {
+				cmd.beginRenderPass(renderPassInfoShadows, vk::SubpassContents::eInline);
+				if (prologue)
+					prologue(cmd);
+				drawCascades(cmd, cascadeMask, state, 0, count);
+			}
 			cmd.endRenderPass();
-			metrics[11 + static_cast<size_t>(i)].end(&GUI::metrics[11 + static_cast<size_t>(i)]);
-			// ==========================================================================
-			cmd.end();
+		};
+
+		const uint32_t refreshMask = frame.shadowsRefreshMask;
+		const uint32_t staticMask = frame.shadowsStaticMask;
+
+		auto& cmd = *VulkanContext::get()->frames[frameIndex].shadowCmdBuffer;
+		cmd.begin(beginInfoShadows);
+		metrics[11].start(&cmd);
+		// the cpu culling of the casters is done in the update, in the snapshot visibility
+		if (frame.settings.useGPUCulling) {
+			for (uint32_t i = 0; i < 3; i++) {
+				if (frame.shadowsRefresh[i])
+					gpuCulling.cull(cmd, i + 1, false);
+			}
 		}
+
+		// static atlas, only the out of date cascades are cleared and redrawn ==========
+		if (staticMask) {
+			auto clearStatic = [&](const vk::CommandBuffer& clearCmd) {
+				for (uint32_t i = 0; i < 3; i++) {
+					if (!(staticMask & (1u << i)))
+						continue;
+					const auto& rect = shadows.atlasRects[i];
+					vk::ClearAttachment clearAttachment;
+					clearAttachment.aspectMask = vk::ImageAspectFlagBits::eDepth;
+					clearAttachment.clearValue.depthStencil = vk::ClearDepthStencilValue{ 0.0f, 0 };
+					vk::ClearRect clearRect;
+					clearRect.rect = vk::Rect2D{ { static_cast<int32_t>(rect.x), static_cast<int32_t>(rect.y) },{ rect.size, rect.size } };
+					clearRect.layerCount = 1;
+					clearCmd.clearAttachments(clearAttachment, clearRect);
+				}
+			};
+			recordPass(cmd, shadows.staticFramebuffer, RecordPass::ShadowsStatic, staticMask, 1, clearStatic);
+		}
+
+		// atlas, the static cascades with the dynamic casters on top ====================
+		shadows.copyStaticLayer(cmd, refreshMask);
+		if (frame.hasDynamicCasters)
+			recordPass(cmd, shadows.framebuffer, RecordPass::ShadowsDynamic, refreshMask, 2, nullptr);
+		metrics[11].end(&renderMetrics[11]);
+		// ==============================================================================
+		cmd.end();
 	}
 
 	void Renderer::Destroy()
@@ -480,10 +938,61 @@ namespace vm
 	}
 
 	void Renderer::Draw()
+	{
+		// sync with the render thread, the previous snapshot is done being recorded and submitted
+		WaitRender();
+		GUI::metrics = renderMetrics;
+		FrameTimer::Instance().timestamps[0] = renderFenceWait;
+
+		// the gui is built only here, while nothing reads its draw data and its state
+		gui.update();
+
+		RenderSnapshot& frame = snapshots[snapshotIndex];
+		snapshotIndex = (snapshotIndex + 1) % 2;
+		CaptureSnapshot(frame, ctx->GetSystem<CameraSystem>()->GetCamera(0));
+
+		if (!GUI::use_render_thread) {
+			Render(frame);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(renderMutex);
+			pendingSnapshot = &frame;
+			renderBusy = true;
+		}
+		renderCondition.notify_all();
+	}
+
+	void Renderer::Render(RenderSnapshot& frame)
 	{
 		auto& vCtx = *VulkanContext::get();
+		const uint32_t frameCount = static_cast<uint32_t>(vCtx.frames.size());
+		const uint32_t frameIndex = vCtx.frameIndex;
+		auto& frameResources = vCtx.frames[frameIndex];
 
-		static const vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eFragmentShader };
+		// the command buffers and the uniform region of the ring frame are free once its last submit (frames in flight ago) is done
+		static Timer timerFenceWait;
+		timerFenceWait.Start();
+		vCtx.waitFrame(frameIndex);
+		renderFenceWait = timerFenceWait.Count();
+		vCtx.device->resetCommandPool(*frameResources.commandPool, vk::CommandPoolResetFlags());
+		recorder.beginFrame(frameIndex);
+
+		// the uploads land in the cpu copy of the uniform ring, then the blocks changed since this region
+		// was last used are copied in it, the descriptors of the frame are bound with its offset
+		frame.executeUploads();
+		UniformRing::get()->beginFrame(frameIndex);
+
+		// GPU CULLING slots and inputs, written in the copy of this frame now that its fence is signaled, the buffers
+		// only grow here so the recorded handles are the ones used
+		if (frame.settings.useGPUCulling) {
+			gpuCulling.prepare(frame, frameIndex);
+			gpuCulling.update(frame);
+		}
+		else {
+			gpuCulling.depthPyramidValid = false;
+		}
 
 		//FIRE_EVENT(Event::OnRender);
 
@@ -498,51 +1007,35 @@ namespace vm
 		}
 
 		// aquire the image
-		auto aquireSignalSemaphore = (*vCtx.semaphores)[0];
-		const uint32_t imageIndex = vCtx.swapchain.Aquire(aquireSignalSemaphore, nullptr);
-		this->previousImageIndex = imageIndex;
-
-		//static Timer timer;
-		//timer.Start();
-		//vCtx.waitFences(vCtx.fences[imageIndex]);
-		//FrameTimer::Instance().timestamps[0] = timer.Count();
-
-		const auto& cmd = (*vCtx.dynamicCmdBuffers)[imageIndex];
+		const uint32_t imageIndex = vCtx.swapchain.Aquire(*frameResources.acquireSemaphore, nullptr);
+
+		// record the command buffers, while the gpu still works on the previous frame
+		// the cached shadow maps are kept as they are when no cascade is refreshed
+		const bool shadowsSubmitted = frame.shadowsRefreshMask != 0;
+		if (shadowsSubmitted)
+			RecordShadowsCmds(imageIndex, frame);
+		else
+			renderMetrics[11] = 0.f;
+		RecordDeferredCmds(imageIndex, frame);
+
+		// one submit for the frame, the shadow maps are written before the deferred passes read them in submission order
+		std::vector<vk::CommandBuffer> cmdBuffers{};
+		if (shadowsSubmitted)
+			cmdBuffers.push_back(*frameResources.shadowCmdBuffer);
+		cmdBuffers.push_back(*frameResources.dynamicCmdBuffer);
+		const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
 
 		vCtx.waitAndLockSubmits();
 
-		if (GUI::shadow_cast) {
-
-			// record the shadow command buffers
-			RecordShadowsCmds(imageIndex);
-
-			// submit the shadow command buffers
-			const auto& shadowWaitSemaphore = aquireSignalSemaphore;
-			const auto& shadowSignalSemaphore = (*vCtx.semaphores)[imageIndex * 3 + 1];
-			const auto& scb = vCtx.shadowCmdBuffers;
-			const auto size = shadows.textures.size();
-			const auto i = size * imageIndex;
-			const std::vector<vk::CommandBuffer> activeShadowCmdBuffers(scb->begin() + i, scb->begin() + i + size);
-			vCtx.submit(activeShadowCmdBuffers, waitStages[0], shadowWaitSemaphore, shadowSignalSemaphore, nullptr);
-
-			aquireSignalSemaphore = shadowSignalSemaphore;
-		}
-
-		// record the command buffers
-		RecordDeferredCmds(imageIndex);
-
-		// submit the command buffers
-		const auto& deferredWaitStage = GUI::shadow_cast ? waitStages[1] : waitStages[0];
-		const auto& deferredWaitSemaphore = aquireSignalSemaphore;
-		const auto& deferredSignalSemaphore = (*vCtx.semaphores)[imageIndex * 3 + 2];
-		const auto& deferredSignalFence = (*vCtx.fences)[imageIndex];
-		vCtx.submit(cmd, deferredWaitStage, deferredWaitSemaphore, deferredSignalSemaphore, deferredSignalFence);
+		vCtx.device->resetFences(*frameResources.fence);
+		vCtx.submit(cmdBuffers, waitStage, *frameResources.acquireSemaphore, *frameResources.renderSemaphore, *frameResources.fence);
 
 		// Presentation
-		const auto& presentWaitSemaphore = deferredSignalSemaphore;
-		vCtx.swapchain.Present(imageIndex, presentWaitSemaphore, nullptr);
+		vCtx.swapchain.Present(imageIndex, *frameResources.renderSemaphore, nullptr);
 
 		vCtx.unlockSubmits();
+
+		vCtx.frameIndex = (frameIndex + 1) % frameCount;
 	}
 
 	void Renderer::AddRenderTarget(const std::string& name, vk::Format format, const vk::ImageUsageFlags& additionalFlags)
@@ -646,8 +1139,10 @@ namespace vm
 
 	void Renderer::ResizeViewport(uint32_t width, uint32_t height)
 	{
+		WaitRender();
 		auto& vulkan = *VulkanContext::get();
 		vulkan.graphicsQueue->waitIdle();
+		recorder.invalidate();
 
 		//- Free resources ----------------------
 		// render targets
@@ -669,7 +1164,9 @@ namespace vm
 		for (auto& framebuffer : deferred.compositionFramebuffers)
 			framebuffer.Destroy();
 		deferred.pipeline.destroy();
+		deferred.pipelineBindless.destroy();
 		deferred.pipelineComposition.destroy();
+		Impostors::get()->destroyPipelines();
 
 		// SSR
 		for (auto& framebuffer : ssr.framebuffers)
@@ -761,6 +1258,7 @@ namespace vm
 		deferred.createFrameBuffers(renderTargets);
 		deferred.createPipelines(renderTargets);
 		deferred.updateDescriptorSets(renderTargets, lightUniforms);
+		Impostors::get()->createPipelines(renderTargets, deferred.renderPass);
 
 		ssr.createRenderPass(renderTargets);
 		ssr.createFrameBuffers(renderTargets);
@@ -802,6 +1300,9 @@ namespace vm
 		ssao.createPipelines(renderTargets);
 		ssao.updateDescriptorSets(renderTargets);
 
+		gpuCulling.destroyDepthPyramid();
+		gpuCulling.createDepthPyramid(renderTargets);
+
 		gui.createRenderPass();
 		gui.createFrameBuffers();
 		gui.createPipeline();
@@ -814,14 +1315,19 @@ namespace vm
 
 	void Renderer::RecreatePipelines()
 	{
+		WaitRender();
 		VulkanContext::get()->graphicsQueue->waitIdle();
+		recorder.invalidate();
 
 		shadows.pipeline.destroy();
+		shadows.pipelineSinglePass.destroy();
 		ssao.pipeline.destroy();
 		ssao.pipelineBlur.destroy();
 		ssr.pipeline.destroy();
 		deferred.pipeline.destroy();
+		deferred.pipelineBindless.destroy();
 		deferred.pipelineComposition.destroy();
+		Impostors::get()->destroyPipelines();
 		fxaa.pipeline.destroy();
 		taa.pipeline.destroy();
 		taa.pipelineSharpen.destroy();
@@ -837,6 +1343,7 @@ namespace vm
 		ssao.createPipelines(renderTargets);
 		ssr.createPipeline(renderTargets);
 		deferred.createPipelines(renderTargets);
+		Impostors::get()->createPipelines(renderTargets, deferred.renderPass);
 		fxaa.createPipeline(renderTargets);
 		taa.createPipelines(renderTargets);
 		bloom.createPipelines(renderTargets);
@@ -851,8 +1358,9 @@ namespace vm
 		const std::string curPath = std::filesystem::current_path().string() + "\\";
 		const std::string path(mono_string_to_utf8(folderPath));
 		const std::string name(mono_string_to_utf8(modelName));
-		for (; instances > 0; instances--)
-			Queue::loadModel.emplace_back(curPath + path, name);
+		// loaded once, the copies are instances of it
+		if (instances > 0)
+			Queue::loadModel.emplace_back(curPath + path, name, instances);
 	}
 
 	static bool KeyDown(uint32_t key)
@@ -20,6 +20,15 @@
 #include "../PostProcess/SSAO.h"
 #include "../PostProcess/SSR.h"
 #include "../PostProcess/TAA.h"
+#include "../Culling/OcclusionCulling.h"
+#include "../Culling/GPUCulling.h"
+#include "ParallelRecorder.h"
+#include "RenderGraph.h"
+#include "RenderQueue.h"
+#include "RenderSnapshot.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace vk
 {
@@ -43,9 +52,27 @@ namespace vm
 		SkyBox skyBoxNight;
 		GUI gui;
 		LightUniforms lightUniforms;
+		OcclusionCulling occlusionCulling;
+		GPUCulling gpuCulling;
+		ParallelRecorder recorder;
+		RenderQueue renderQueue;
+		RenderGraph renderGraph;
 
 		std::vector<GPUTimer> metrics{};
 
+		// The render thread records and submits a snapshot while the update thread builds the next one. Draw() is the
+		// only point where the two meet, the GUI and the scene are touched there only after the render thread is idle.
+		RenderSnapshot snapshots[2]{};
+		uint32_t snapshotIndex = 0;
+		std::thread renderThread;
+		std::mutex renderMutex;
+		std::condition_variable renderCondition;
+		RenderSnapshot* pendingSnapshot = nullptr;
+		bool renderBusy = false;
+		bool renderExit = false;
+		std::array<float, 20> renderMetrics{}; // gpu timings as the render thread reads them, copied to the GUI at sync
+		double renderFenceWait = 0.0;
+
 #ifdef USE_SCRIPTS
 		std::vector<Script*> scripts{};
 #endif
@@ -65,15 +92,18 @@ namespace vm
 		inline SDL_Window* GetWindow() { return window; }
 		inline Context* GetContext() { return ctx; }
 
-		uint32_t previousImageIndex = 0;
 		std::map<std::string, Image> renderTargets{};
 
 	private:
 		Context* ctx;
 		SDL_Window* window;
-		void CheckQueue() const;
+		void CheckQueue();
+		void CaptureSnapshot(RenderSnapshot& frame, Camera& camera);
+		void Render(RenderSnapshot& frame);
+		void RenderLoop();
+		void WaitRender();
 		static void RecordComputeCmds(uint32_t sizeX, uint32_t sizeY, uint32_t sizeZ);
-		void RecordDeferredCmds(const uint32_t& imageIndex);
-		void RecordShadowsCmds(const uint32_t& imageIndex);
+		void RecordDeferredCmds(const uint32_t& imageIndex, const RenderSnapshot& frame);
+		void RecordShadowsCmds(const uint32_t& imageIndex, const RenderSnapshot& frame);
 	};
 }
\ No newline at end of file
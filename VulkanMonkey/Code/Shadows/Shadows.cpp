@@ -5,21 +5,189 @@
 #include "../Core/Vertex.h"
 #include "../Shader/Shader.h"
 #include "../Core/Queue.h"
+#include "../Culling/FrustumCulling.h"
+#include "../Model/Model.h"
 #include "../VulkanContext/VulkanContext.h"
 
 namespace vm
 {
-	uint32_t Shadows::imageSize = 4096;
+	uint32_t Shadows::cascadeSizes[3]{ 4096, 2048, 2048 };
+	float Shadows::splitLambda = .95f;
+	float Shadows::casterMinTexels = 2.f;
 
 	Shadows::Shadows()
 	{
 		descriptorSets = make_ref(std::vector<vk::DescriptorSet>());
+		descriptorSetSinglePass = make_ref(vk::DescriptorSet());
 	}
 
 	Shadows::~Shadows()
 	{
 	}
 
+	void Shadows::updateCasterVolume(uint32_t cascade, cvec3& lightPos, cvec3& lightFront, float maxDistance, float orthoSide)
+	{
+		// right, left, bottom, top
+		for (uint32_t i = 0; i < 4; i++)
+			casterPlanes[cascade][i] = cascadePlanes[cascade][i];
+
+		// the far side of the orthographic volume, dot(front, p - lightPos) <= maxDistance
+		casterPlanes[cascade][4].normal = -lightFront;
+		casterPlanes[cascade][4].d = dot(lightFront, lightPos) + maxDistance;
+
+		// a caster is worth drawing only if it covers a few texels of the far cascade
+		const float texelSize = 2.f * orthoSide / static_cast<float>(cascadeSizes[cascade]);
+		casterMinRadius[cascade] = cascade == 2 ? .5f * casterMinTexels * texelSize : 0.f;
+	}
+
+	bool Shadows::isStaticCaster(const Model& model)
+	{
+		// scripted or animated models may move at any frame, the rest are static while their matrix holds
+		return !model.script && model.animations.empty() && model.ubo.matrix == model.ubo.previousMatrix;
+	}
+
+	void Shadows::updateCasterStates(const std::vector<Model>& models)
+	{
+		if (!GUI::shadow_cast)
+			return;
+
+		if (casterStates.size() != models.size()) {
+			casterStates.assign(models.size(), 0);
+			for (auto& dirty : staticDirty)
+				dirty = true;
+		}
+
+		hasDynamicCasters = false;
+		for (size_t i = 0; i < models.size(); i++) {
+			const char state = !models[i].render ? 0 : isStaticCaster(models[i]) ? 1 : 2;
+			if (state != casterStates[i] && (state == 1 || casterStates[i] == 1)) {
+				for (auto& dirty : staticDirty)
+					dirty = true;
+			}
+			hasDynamicCasters |= state == 2;
+			casterStates[i] = state;
+		}
+
+		// a shadow map that already holds exactly its static layer is kept as is
+		for (uint32_t i = 0; i < 3; i++) {
+			if (refresh[i] && !staticDirty[i] && !dynamicInLayer[i] && !hasDynamicCasters)
+				refresh[i] = false;
+		}
+	}
+
+	void Shadows::copyStaticLayer(const vk::CommandBuffer& cmd, uint32_t refreshMask) const
+	{
+		std::vector<vk::ImageCopy> regions{};
+		for (uint32_t i = 0; i < 3; i++) {
+			if (!(refreshMask & (1u << i)))
+				continue;
+			vk::ImageCopy region;
+			region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eDepth;
+			region.srcSubresource.layerCount = 1;
+			region.srcOffset = vk::Offset3D{ static_cast<int32_t>(atlasRects[i].x), static_cast<int32_t>(atlasRects[i].y), 0 };
+			region.dstSubresource = region.srcSubresource;
+			region.dstOffset = region.srcOffset;
+			region.extent = vk::Extent3D{ atlasRects[i].size, atlasRects[i].size, 1 };
+			regions.push_back(region);
+		}
+		if (regions.empty())
+			return;
+
+		staticAtlas.transitionImageLayout(
+			cmd,
+			vk::ImageLayout::eDepthStencilAttachmentOptimal,
+			vk::ImageLayout::eTransferSrcOptimal,
+			vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::PipelineStageFlagBits::eTransfer,
+			vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::AccessFlagBits::eTransferRead,
+			vk::ImageAspectFlagBits::eDepth);
+		// the cascades that are not refreshed keep their content
+		atlas.transitionImageLayout(
+			cmd,
+			vk::ImageLayout::eDepthStencilAttachmentOptimal,
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::PipelineStageFlagBits::eTransfer,
+			vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::AccessFlagBits::eTransferWrite,
+			vk::ImageAspectFlagBits::eDepth);
+
+		cmd.copyImage(*staticAtlas.image, vk::ImageLayout::eTransferSrcOptimal, *atlas.image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+		staticAtlas.transitionImageLayout(
+			cmd,
+			vk::ImageLayout::eTransferSrcOptimal,
+			vk::ImageLayout::eDepthStencilAttachmentOptimal,
+			vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eEarlyFragmentTests,
+			vk::AccessFlagBits::eTransferRead,
+			vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::ImageAspectFlagBits::eDepth);
+		atlas.transitionImageLayout(
+			cmd,
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::ImageLayout::eDepthStencilAttachmentOptimal,
+			vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eEarlyFragmentTests,
+			vk::AccessFlagBits::eTransferWrite,
+			vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::ImageAspectFlagBits::eDepth);
+	}
+
+	void Shadows::setCascadeViewport(const vk::CommandBuffer& cmd, uint32_t cascade) const
+	{
+		const ShadowsAtlasRect& rect = atlasRects[cascade];
+
+		vk::Viewport viewport;
+		viewport.x = static_cast<float>(rect.x);
+		viewport.y = static_cast<float>(rect.y);
+		viewport.width = static_cast<float>(rect.size);
+		viewport.height = static_cast<float>(rect.size);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		vk::Rect2D scissor;
+		scissor.offset = vk::Offset2D{ static_cast<int32_t>(rect.x), static_cast<int32_t>(rect.y) };
+		scissor.extent = vk::Extent2D{ rect.size, rect.size };
+
+		cmd.setViewport(0, viewport);
+		cmd.setScissor(0, scissor);
+	}
+
+	void Shadows::setCascadeViewports(const vk::CommandBuffer& cmd) const
+	{
+		std::array<vk::Viewport, 3> viewports{};
+		std::array<vk::Rect2D, 3> scissors{};
+		for (uint32_t i = 0; i < 3; i++) {
+			const ShadowsAtlasRect& rect = atlasRects[i];
+			viewports[i] = vk::Viewport{ static_cast<float>(rect.x), static_cast<float>(rect.y), static_cast<float>(rect.size), static_cast<float>(rect.size), 0.0f, 1.0f };
+			scissors[i] = vk::Rect2D{ { static_cast<int32_t>(rect.x), static_cast<int32_t>(rect.y) },{ rect.size, rect.size } };
+		}
+
+		cmd.setViewport(0, viewports);
+		cmd.setScissor(0, scissors);
+	}
+
+	void Shadows::packAtlas()
+	{
+		// Columns of cascades, from the largest (cascade 0) to the smallest, each cascade is stacked
+		// under the previous one while it fits in the atlas height
+		atlasHeight = cascadeSizes[0];
+		uint32_t x = 0, y = 0, columnWidth = 0;
+		for (uint32_t i = 0; i < 3; i++) {
+			if (y + cascadeSizes[i] > atlasHeight) {
+				x += columnWidth;
+				y = 0;
+				columnWidth = 0;
+			}
+			atlasRects[i] = { x, y, cascadeSizes[i] };
+			y += cascadeSizes[i];
+			columnWidth = maximum(columnWidth, cascadeSizes[i]);
+		}
+		atlasWidth = x + columnWidth;
+	}
+
 	void Shadows::createDescriptorSets()
 	{
 		vk::DescriptorSetAllocateInfo allocateInfo;
@@ -27,7 +195,7 @@ namespace vm
 		allocateInfo.descriptorSetCount = 1;
 		allocateInfo.pSetLayouts = &Pipeline::getDescriptorSetLayoutShadows();
 
-		descriptorSets->resize(textures.size()); // size of wanted number of cascaded shadows
+		descriptorSets->resize(uniformBuffers.size()); // size of wanted number of cascaded shadows
 		for (uint32_t i = 0; i < descriptorSets->size(); i++) {
 			(*descriptorSets)[i] = VulkanContext::get()->device->allocateDescriptorSets(allocateInfo).at(0);
 
@@ -35,20 +203,20 @@ namespace vm
 			// MVP
 			vk::DescriptorBufferInfo dbi;
 			dbi.buffer = *uniformBuffers[i].buffer;
-			dbi.offset = 0;
+			dbi.offset = uniformBuffers[i].ringOffset;
 			dbi.range = sizeof(ShadowsUBO);
 
 			textureWriteSets[0].dstSet = (*descriptorSets)[i];
 			textureWriteSets[0].dstBinding = 0;
 			textureWriteSets[0].dstArrayElement = 0;
 			textureWriteSets[0].descriptorCount = 1;
-			textureWriteSets[0].descriptorType = vk::DescriptorType::eUniformBuffer;
+			textureWriteSets[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 			textureWriteSets[0].pBufferInfo = &dbi;
 
 			// sampler
 			vk::DescriptorImageInfo dii;
-			dii.sampler = *textures[i].sampler;
-			dii.imageView = *textures[i].view;
+			dii.sampler = *atlas.sampler;
+			dii.imageView = *atlas.view;
 			dii.imageLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
 
 			textureWriteSets[1].dstSet = (*descriptorSets)[i];
@@ -60,18 +228,49 @@ namespace vm
 
 			VulkanContext::get()->device->updateDescriptorSets(textureWriteSets, nullptr);
 		}
+
+		// all the cascade matrices, for the single pass
+		*descriptorSetSinglePass = VulkanContext::get()->device->allocateDescriptorSets(allocateInfo).at(0);
+
+		vk::DescriptorBufferInfo dbi;
+		dbi.buffer = *cascadesBuffer.buffer;
+		dbi.offset = cascadesBuffer.ringOffset;
+		dbi.range = sizeof(cascadesViewProjection);
+
+		vk::DescriptorImageInfo dii;
+		dii.sampler = *atlas.sampler;
+		dii.imageView = *atlas.view;
+		dii.imageLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+
+		std::vector<vk::WriteDescriptorSet> writeSets(2);
+		writeSets[0].dstSet = *descriptorSetSinglePass;
+		writeSets[0].dstBinding = 0;
+		writeSets[0].dstArrayElement = 0;
+		writeSets[0].descriptorCount = 1;
+		writeSets[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+		writeSets[0].pBufferInfo = &dbi;
+
+		writeSets[1].dstSet = *descriptorSetSinglePass;
+		writeSets[1].dstBinding = 1;
+		writeSets[1].dstArrayElement = 0;
+		writeSets[1].descriptorCount = 1;
+		writeSets[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+		writeSets[1].pImageInfo = &dii;
+
+		VulkanContext::get()->device->updateDescriptorSets(writeSets, nullptr);
 	}
 
 	void Shadows::createRenderPass()
 	{
+		// the cascades are cleared or copied from the static atlas separately, the rest of the atlas is kept
 		vk::AttachmentDescription attachment;
 		attachment.format = *VulkanContext::get()->depth.format;
 		attachment.samples = vk::SampleCountFlagBits::e1;
-		attachment.loadOp = vk::AttachmentLoadOp::eClear;
+		attachment.loadOp = vk::AttachmentLoadOp::eLoad;
 		attachment.storeOp = vk::AttachmentStoreOp::eStore;
 		attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
 		attachment.stencilStoreOp = vk::AttachmentStoreOp::eStore;
-		attachment.initialLayout = vk::ImageLayout::eUndefined;
+		attachment.initialLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 		attachment.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 
 		vk::AttachmentReference depthAttachmentRef;
@@ -92,32 +291,39 @@ namespace vm
 
 	void Shadows::createFrameBuffers()
 	{
-		textures.resize(3);
-		for (auto& texture : textures)
-		{
-			texture.format = VulkanContext::get()->depth.format;
-			texture.initialLayout = make_ref(vk::ImageLayout::eUndefined);
-			texture.addressMode = make_ref(vk::SamplerAddressMode::eClampToEdge);
-			texture.maxAnisotropy = 1.f;
-			texture.borderColor = make_ref(vk::BorderColor::eFloatOpaqueWhite);
-			texture.samplerCompareEnable = VK_TRUE;
-			texture.compareOp = make_ref(vk::CompareOp::eGreaterOrEqual);
-			texture.samplerMipmapMode = make_ref(vk::SamplerMipmapMode::eLinear);
-
-			texture.createImage(Shadows::imageSize, Shadows::imageSize, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
-			texture.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-			texture.createImageView(vk::ImageAspectFlagBits::eDepth);
-			texture.createSampler();
-		}
+		packAtlas();
 
-		framebuffers.resize(VulkanContext::get()->swapchain.images.size() * textures.size());
-		for (uint32_t i = 0; i < framebuffers.size(); ++i)
-		{
-			uint32_t width = Shadows::imageSize;
-			uint32_t height = Shadows::imageSize;
-			vk::ImageView view = *textures[i % textures.size()].view;
-			framebuffers[i].Create(width, height, view, renderPass);
-		}
+		atlas.format = VulkanContext::get()->depth.format;
+		atlas.initialLayout = make_ref(vk::ImageLayout::eUndefined);
+		atlas.addressMode = make_ref(vk::SamplerAddressMode::eClampToEdge);
+		atlas.maxAnisotropy = 1.f;
+		atlas.borderColor = make_ref(vk::BorderColor::eFloatOpaqueWhite);
+		atlas.samplerCompareEnable = VK_TRUE;
+		atlas.compareOp = make_ref(vk::CompareOp::eGreaterOrEqual);
+		atlas.samplerMipmapMode = make_ref(vk::SamplerMipmapMode::eLinear);
+
+		atlas.createImage(atlasWidth, atlasHeight, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		atlas.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+		atlas.createImageView(vk::ImageAspectFlagBits::eDepth);
+		atlas.createSampler();
+
+		framebuffer.Create(atlasWidth, atlasHeight, *atlas.view, renderPass);
+
+		createStaticFrameBuffer();
+	}
+
+	void Shadows::createStaticFrameBuffer()
+	{
+		staticAtlas.format = VulkanContext::get()->depth.format;
+		staticAtlas.initialLayout = make_ref(vk::ImageLayout::eUndefined);
+		staticAtlas.createImage(atlasWidth, atlasHeight, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		staticAtlas.transitionImageLayout(vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+		staticAtlas.createImageView(vk::ImageAspectFlagBits::eDepth);
+
+		staticFramebuffer.Create(atlasWidth, atlasHeight, *staticAtlas.view, renderPass);
+
+		for (auto& dirty : staticDirty)
+			dirty = true;
 	}
 
 	void Shadows::createPipeline()
@@ -127,28 +333,51 @@ namespace vm
 		pipeline.info.pVertShader = &vert;
 		pipeline.info.vertexInputBindingDescriptions = make_ref(Vertex::getBindingDescriptionGeneral());
 		pipeline.info.vertexInputAttributeDescriptions = make_ref(Vertex::getAttributeDescriptionGeneral());
-		pipeline.info.width = static_cast<float>(Shadows::imageSize);
-		pipeline.info.height = static_cast<float>(Shadows::imageSize);
+		pipeline.info.width = static_cast<float>(atlasWidth);
+		pipeline.info.height = static_cast<float>(atlasHeight);
 		pipeline.info.cullMode = CullMode::Front;
-		pipeline.info.colorBlendAttachments = make_ref(std::vector<vk::PipelineColorBlendAttachmentState>{ *textures[0].blentAttachment });
-		pipeline.info.dynamicStates = make_ref(std::vector<vk::DynamicState>{ vk::DynamicState::eDepthBias });
+		pipeline.info.colorBlendAttachments = make_ref(std::vector<vk::PipelineColorBlendAttachmentState>{ *atlas.blentAttachment });
+		pipeline.info.dynamicStates = make_ref(std::vector<vk::DynamicState>{ vk::DynamicState::eDepthBias, vk::DynamicState::eViewport, vk::DynamicState::eScissor });
 		pipeline.info.descriptorSetLayouts = make_ref(
 			std::vector<vk::DescriptorSetLayout>
 		{
 			Pipeline::getDescriptorSetLayoutShadows(),
 			Pipeline::getDescriptorSetLayoutMesh(),
-			Pipeline::getDescriptorSetLayoutModel()
+			Pipeline::getDescriptorSetLayoutFrame()
 		});
 		pipeline.info.renderPass = renderPass;
+		// the slot of the caster's matrices in the frame constants
+		pipeline.info.pushConstantStage = PushConstantStage::Vertex;
+		pipeline.info.pushConstantSize = sizeof(uint32_t);
 
 		pipeline.createGraphicsPipeline();
+
+		singlePassSupported = VulkanContext::get()->supportsViewportIndexLayer && VulkanContext::get()->gpuFeatures->multiViewport;
+		if (!singlePassSupported)
+			return;
+
+		Shader vertSinglePass{ "shaders/Shadows/shaderShadowsInstanced.vert", ShaderType::Vertex, true };
+
+		pipelineSinglePass.info = pipeline.info;
+		pipelineSinglePass.info.pVertShader = &vertSinglePass;
+		pipelineSinglePass.info.viewportCount = 3;
+		// the cascade mask, the slot of the caster's matrices and its instance count
+		pipelineSinglePass.info.pushConstantSize = 3 * sizeof(uint32_t);
+
+		pipelineSinglePass.createGraphicsPipeline();
 	}
 
 	void Shadows::createUniformBuffers()
 	{
-		uniformBuffers.resize(textures.size());
+		cascadesBuffer.createRingBuffer(sizeof(cascadesViewProjection));
+		cascadesBuffer.map();
+		cascadesBuffer.zero();
+		cascadesBuffer.flush();
+		cascadesBuffer.unmap();
+
+		uniformBuffers.resize(3);
 		for (auto& buffer : uniformBuffers) {
-			buffer.createBuffer(sizeof(ShadowsUBO), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible);
+			buffer.createRingBuffer(sizeof(ShadowsUBO));
 			buffer.map();
 			buffer.zero();
 			buffer.flush();
@@ -166,87 +395,104 @@ namespace vm
 			Pipeline::getDescriptorSetLayoutShadows() = nullptr;
 		}
 
-		for (auto& texture : textures)
-			texture.destroy();
-
-		for (auto& fb : framebuffers)
-			VulkanContext::get()->device->destroyFramebuffer(*fb.handle);
+		atlas.destroy();
+		staticAtlas.destroy();
+		framebuffer.Destroy();
+		staticFramebuffer.Destroy();
 
 		for (auto& buffer : uniformBuffers)
 			buffer.destroy();
 
+		cascadesBuffer.destroy();
 		pipeline.destroy();
+		pipelineSinglePass.destroy();
 	}
 
-	void Shadows::update(Camera& camera)
+	void Shadows::updateSplits(const Camera& camera)
 	{
-		if (GUI::shadow_cast) {
-			// far/cos(x) = the side size
-			const float sideSizeOfPyramid = camera.nearPlane / cos(radians(camera.FOV * .5f)); // near plane is actually the far plane (they are reversed)
-			const vec3 p = &GUI::sun_position[0];
-
-			vec3 pointOnPyramid = camera.front * (sideSizeOfPyramid * .01f);
-			vec3 pos = p + camera.position + pointOnPyramid; // sun position will be moved, so its angle to the lookat position is the same always
-			vec3 front = normalize(camera.position + pointOnPyramid - pos);
-			vec3 right = normalize(cross(front, camera.WorldUp()));
-			vec3 up = normalize(cross(right, front));
-			float orthoSide = sideSizeOfPyramid * .01f; // small area
-			shadows_UBO[0] = {
-				ortho(-orthoSide, orthoSide, -orthoSide, orthoSide, camera.nearPlane, camera.farPlane),
-				lookAt(pos, front, right, up),
-				1.0f,
-				sideSizeOfPyramid * .02f,
-				sideSizeOfPyramid * .1f,
-				sideSizeOfPyramid
-			};
-
-			Queue::memcpyRequest(&uniformBuffers[0], { { &shadows_UBO[0], sizeof(ShadowsUBO), 0 } });
-			//uniformBuffers[0].map();
-			//memcpy(uniformBuffers[0].data, &shadows_UBO[0], sizeof(ShadowsUBO));
-			//uniformBuffers[0].flush();
-			//uniformBuffers[0].unmap();
-
-			pointOnPyramid = camera.front * (sideSizeOfPyramid * .05f);
-			pos = p + camera.position + pointOnPyramid;
-			front = normalize(camera.position + pointOnPyramid - pos);
-			right = normalize(cross(front, camera.WorldUp()));
-			up = normalize(cross(right, front));
-			orthoSide = sideSizeOfPyramid * .05f; // medium area
-			shadows_UBO[1] = {
-				ortho(-orthoSide, orthoSide, -orthoSide, orthoSide, camera.nearPlane, camera.farPlane),
-				lookAt(pos, front, right, up),
-				1.0f,
-				sideSizeOfPyramid * .02f,
-				sideSizeOfPyramid * .1f,
-				sideSizeOfPyramid
-			};
-
-			Queue::memcpyRequest(&uniformBuffers[1], { { &shadows_UBO[1], sizeof(ShadowsUBO), 0} });
-			//uniformBuffers[1].map();
-			//memcpy(uniformBuffers[1].data, &shadows_UBO[1], sizeof(ShadowsUBO));
-			//uniformBuffers[1].flush();
-			//uniformBuffers[1].unmap();
+		// practical split scheme, near plane is actually the far plane (they are reversed)
+		const float zNear = camera.farPlane;
+		const float zFar = camera.nearPlane;
+		for (uint32_t i = 0; i < 3; i++) {
+			const float f = static_cast<float>(i + 1) / 3.f;
+			const float logSplit = zNear * pow(zFar / zNear, f);
+			const float uniformSplit = zNear + (zFar - zNear) * f;
+			cascadeSplits[i] = splitLambda * logSplit + (1.f - splitLambda) * uniformSplit;
+		}
+	}
 
-			pointOnPyramid = camera.front * (sideSizeOfPyramid * .5f);
-			pos = p + camera.position + pointOnPyramid;
-			front = normalize(camera.position + pointOnPyramid - pos);
-			right = normalize(cross(front, camera.WorldUp()));
-			up = normalize(cross(right, front));
-			orthoSide = sideSizeOfPyramid * .5f; // large area
-			shadows_UBO[2] = {
-				ortho(-orthoSide, orthoSide, -orthoSide, orthoSide, camera.nearPlane, camera.farPlane),
-				lookAt(pos, front, right, up),
-				1.0f,
-				sideSizeOfPyramid * .02f,
-				sideSizeOfPyramid * .1f,
-				sideSizeOfPyramid
-			};
+	void Shadows::updateCascade(uint32_t cascade, Camera& camera, float sliceStart, float sliceEnd)
+	{
+		const vec3 p = &GUI::sun_position[0];
+		const vec3 front = normalize(-p); // sun position will be moved, so its angle to the lookat position is the same always
+		const vec3 right = normalize(cross(front, camera.WorldUp()));
+		const vec3 up = normalize(cross(right, front));
+
+		// The cascades are selected by distance, so a slice starts at the depth of its start distance at the
+		// frustum corners. The slice is fitted in a bounding sphere, its size does not change when the camera turns.
+		const float aspect = camera.renderArea.viewport.width / camera.renderArea.viewport.height;
+		const float tanHalfFovy = tan(radians(camera.FOV * .5f));
+		const float cornerTan2 = tanHalfFovy * tanHalfFovy * (1.f + aspect * aspect);
+		const float d0 = sliceStart / sqrt(1.f + cornerTan2);
+		const float d1 = sliceEnd;
+		const float center = minimum(.5f * (d0 + d1) * (1.f + cornerTan2), d1);
+		const float orthoSide = sqrt((d1 - center) * (d1 - center) + d1 * d1 * cornerTan2);
+
+		// Snap the lookat position to whole texels across the light and to a coarse step along it, so a moving
+		// camera keeps the cascade matrices (and the cached static layer) until it crosses a texel.
+		const vec3 lookAtPos = camera.position + camera.front * center;
+		const float texelSize = 2.f * orthoSide / static_cast<float>(cascadeSizes[cascade]);
+		const vec3 snapped =
+			right * (std::floor(dot(lookAtPos, right) / texelSize) * texelSize) +
+			up * (std::floor(dot(lookAtPos, up) / texelSize) * texelSize) +
+			front * (std::floor(dot(lookAtPos, front) / orthoSide) * orthoSide);
+		const vec3 pos = p + snapped;
+
+		const ShadowsAtlasRect& rect = atlasRects[cascade];
+		const ShadowsUBO ubo = {
+			ortho(-orthoSide, orthoSide, -orthoSide, orthoSide, camera.nearPlane, camera.farPlane),
+			lookAt(pos, front, right, up),
+			1.0f,
+			cascadeSplits[0],
+			cascadeSplits[1],
+			cascadeSplits[2],
+			vec4(
+				static_cast<float>(rect.x) / static_cast<float>(atlasWidth),
+				static_cast<float>(rect.y) / static_cast<float>(atlasHeight),
+				static_cast<float>(rect.size) / static_cast<float>(atlasWidth),
+				static_cast<float>(rect.size) / static_cast<float>(atlasHeight))
+		};
+		if (ubo.projection != shadows_UBO[cascade].projection || ubo.view != shadows_UBO[cascade].view)
+			staticDirty[cascade] = true;
+		shadows_UBO[cascade] = ubo;
+
+		FrustumCulling::ExtractPlanes(shadows_UBO[cascade].projection * shadows_UBO[cascade].view, cascadePlanes[cascade]);
+		updateCasterVolume(cascade, pos, front, camera.nearPlane, orthoSide);
+		Queue::memcpyRequest(&uniformBuffers[cascade], { { &shadows_UBO[cascade], sizeof(ShadowsUBO), 0 } });
+
+		cascadesViewProjection[cascade] = shadows_UBO[cascade].projection * shadows_UBO[cascade].view;
+		Queue::memcpyRequest(&cascadesBuffer, { { &cascadesViewProjection[cascade], sizeof(mat4), sizeof(mat4) * cascade } });
+	}
 
-			Queue::memcpyRequest(&uniformBuffers[2], { { &shadows_UBO[2], sizeof(ShadowsUBO), 0 } });
-			//uniformBuffers[2].map();
-			//memcpy(uniformBuffers[2].data, &shadows_UBO[2], sizeof(ShadowsUBO));
-			//uniformBuffers[2].flush();
-			//uniformBuffers[2].unmap();
+	void Shadows::update(Camera& camera)
+	{
+		if (GUI::shadow_cast) {
+			// the depth bias is baked in the static layers
+			if (!GUI::shadow_cache || GUI::depthBias != cachedDepthBias) {
+				for (auto& dirty : staticDirty)
+					dirty = true;
+				cachedDepthBias = GUI::depthBias;
+			}
+
+			// Cascade 0 is drawn every frame, the medium and large areas take turns. A cascade keeps its previous
+			// matrices until its turn, so the shadow map and the matrices it is sampled with always match.
+			frameCounter++;
+			updateSplits(camera);
+			for (uint32_t i = 0; i < 3; i++) {
+				refresh[i] = i == 0 || frameCounter % 2 == i - 1 || staticDirty[i];
+				if (refresh[i])
+					updateCascade(i, camera, i == 0 ? camera.farPlane : cascadeSplits[i - 1], cascadeSplits[i]);
+			}
 		}
 		else
 		{
@@ -269,6 +515,10 @@ namespace vm
 			//memcpy(uniformBuffers[2].data, &shadows_UBO[0], sizeof(ShadowsUBO));
 			//uniformBuffers[2].flush();
 			//uniformBuffers[2].unmap();
+
+			// the shadow maps are not kept while the sun is off
+			for (auto& dirty : staticDirty)
+				dirty = true;
 		}
 	}
-}
+}
\ No newline at end of file
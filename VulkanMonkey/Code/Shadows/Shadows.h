@@ -10,10 +10,13 @@
 namespace vk
 {
 	class DescriptorSet;
+	class CommandBuffer;
 }
 
 namespace vm
 {
+	class Model;
+
 	struct ShadowsUBO
 	{
 		mat4 projection, view;
@@ -21,6 +24,12 @@ namespace vm
 		float maxCascadeDist0;
 		float maxCascadeDist1;
 		float maxCascadeDist2;
+		vec4 atlasRect; // offset and scale of the cascade in the atlas uv space
+	};
+
+	struct ShadowsAtlasRect
+	{
+		uint32_t x, y, size;
 	};
 
 	class Shadows
@@ -29,19 +38,63 @@ namespace vm
 		Shadows();
 		~Shadows();
 		ShadowsUBO shadows_UBO[3]{};
-		static uint32_t imageSize;
+		Camera::Plane cascadePlanes[3][6]{}; // right, left, bottom, top, far, near
+		// Caster culling volumes, the cascade sides and its far side from the light. Casters between the light and
+		// the cascade still throw shadows into it, so the volume is extruded toward the light (no near plane).
+		Camera::Plane casterPlanes[3][5]{};
+		float casterMinRadius[3]{}; // casters smaller than this are skipped (only in the far cascade)
+		// All the cascades live in one depth atlas, each with its own resolution, and render in one render pass
+		static uint32_t cascadeSizes[3];
+		static float splitLambda; // blend of the logarithmic (1) and uniform (0) cascade splits
+		static float casterMinTexels;
+		ShadowsAtlasRect atlasRects[3]{};
+		uint32_t atlasWidth = 0, atlasHeight = 0;
+		float cascadeSplits[3]{};
 		RenderPass renderPass;
-		std::vector<Image> textures{};
+		Image atlas;
 		Ref<std::vector<vk::DescriptorSet>> descriptorSets;
-		std::vector<Framebuffer> framebuffers{};
+		Framebuffer framebuffer;
 		std::vector<Buffer> uniformBuffers{};
 		Pipeline pipeline;
 
+		// Single pass, every draw is instanced across the cascades it is visible in and each instance picks its
+		// cascade viewport (gl_ViewportIndex). Needs VK_EXT_shader_viewport_index_layer and multiViewport.
+		mat4 cascadesViewProjection[3]{};
+		Buffer cascadesBuffer;
+		Ref<vk::DescriptorSet> descriptorSetSinglePass;
+		Pipeline pipelineSinglePass;
+		bool singlePassSupported = false;
+
+		// Shadow cache. The static casters of a cascade are drawn in its region of the static atlas only when the
+		// (texel snapped) cascade matrices or the static casters change. A refreshed cascade copies its static region
+		// and draws the dynamic casters on top. Cascade 0 is refreshed every frame, the far cascades take turns.
+		Image staticAtlas;
+		Framebuffer staticFramebuffer;
+		std::vector<char> casterStates{}; // per model, 0: hidden, 1: static, 2: dynamic
+		bool refresh[3]{ true, true, true }; // the cascade is drawn this frame
+		bool staticDirty[3]{ true, true, true }; // the static layer of the cascade has to be redrawn
+		bool dynamicInLayer[3]{}; // the shadow map holds dynamic casters on top of the static layer
+		bool hasDynamicCasters = false;
+		std::array<float, 3> cachedDepthBias{};
+		uint32_t frameCounter = 0;
+
 		void update(Camera& camera);
+		void updateSplits(const Camera& camera);
+		void updateCascade(uint32_t cascade, Camera& camera, float sliceStart, float sliceEnd);
+		void updateCasterVolume(uint32_t cascade, cvec3& lightPos, cvec3& lightFront, float maxDistance, float orthoSide);
+		// Marks the static layers dirty when a model starts or stops being a static caster, then drops the
+		// refreshes that would redraw the same shadow map. Runs after the models are updated.
+		void updateCasterStates(const std::vector<Model>& models);
+		static bool isStaticCaster(const Model& model);
+		void copyStaticLayer(const vk::CommandBuffer& cmd, uint32_t refreshMask) const;
+		void setCascadeViewport(const vk::CommandBuffer& cmd, uint32_t cascade) const;
+		void setCascadeViewports(const vk::CommandBuffer& cmd) const;
+		void packAtlas();
 		void createUniformBuffers();
 		void createDescriptorSets();
 		void createRenderPass();
 		void createFrameBuffers();
+		void createStaticFrameBuffer();
 		void createPipeline();
 		void destroy();
 	};
@@ -2,11 +2,13 @@
 #include "VulkanContext.h"
 #include "../Context/Context.h"
 #include "../Renderer/Renderer.h"
+#include "../Core/MemoryAllocator.h"
 #include <iostream>
 
 namespace vm
 {
 	constexpr uint32_t SWAPCHAIN_IMAGES = 3;
+	constexpr uint32_t FRAMES_IN_FLIGHT = 2; // 2 or 3, how many frames the cpu can submit ahead of the gpu
 
 	VulkanContext::VulkanContext()
 	{
@@ -24,10 +26,6 @@ namespace vm
 		descriptorPool = make_ref(vk::DescriptorPool());
 		dispatchLoaderDynamic = make_ref(vk::DispatchLoaderDynamic());
 		queueFamilyProperties = make_ref(std::vector<vk::QueueFamilyProperties>());
-		dynamicCmdBuffers = make_ref(std::vector<vk::CommandBuffer>());
-		shadowCmdBuffers = make_ref(std::vector<vk::CommandBuffer>());
-		fences = make_ref(std::vector<vk::Fence>());
-		semaphores = make_ref(std::vector<vk::Semaphore>());
 
 		window = nullptr;
 		graphicsFamilyId = 0;
@@ -246,9 +244,46 @@ namespace vm
 		auto extensionProperties = gpu->enumerateDeviceExtensionProperties();
 
 		std::vector<const char*> deviceExtensions{};
+		bool descriptorIndexingExtension = false, maintenance3Extension = false;
 		for (auto& i : extensionProperties) {
 			if (std::string(i.extensionName) == VK_KHR_SWAPCHAIN_EXTENSION_NAME)
 				deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+			if (std::string(i.extensionName) == VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) {
+				deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				supportsDrawIndirectCount = true;
+			}
+			if (std::string(i.extensionName) == VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME) {
+				deviceExtensions.push_back(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME);
+				supportsViewportIndexLayer = true;
+			}
+			if (std::string(i.extensionName) == VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
+				descriptorIndexingExtension = true;
+			if (std::string(i.extensionName) == VK_KHR_MAINTENANCE3_EXTENSION_NAME)
+				maintenance3Extension = true;
+		}
+
+		// only the descriptor indexing features the bindless materials rely on are enabled
+		vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexing;
+		if (descriptorIndexingExtension) {
+			vk::PhysicalDeviceDescriptorIndexingFeaturesEXT supported;
+			vk::PhysicalDeviceFeatures2 features2;
+			features2.pNext = &supported;
+			gpu->getFeatures2(&features2);
+
+			supportsDescriptorIndexing =
+				supported.runtimeDescriptorArray &&
+				supported.descriptorBindingPartiallyBound &&
+				supported.descriptorBindingSampledImageUpdateAfterBind &&
+				supported.descriptorBindingUpdateUnusedWhilePending;
+			if (supportsDescriptorIndexing) {
+				deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+				if (maintenance3Extension)
+					deviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+				descriptorIndexing.runtimeDescriptorArray = VK_TRUE;
+				descriptorIndexing.descriptorBindingPartiallyBound = VK_TRUE;
+				descriptorIndexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+				descriptorIndexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			}
 		}
 		float priorities[]{ 1.0f }; // range : [0.0, 1.0]
 
@@ -282,8 +317,12 @@ namespace vm
 		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
 		deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
 		deviceCreateInfo.pEnabledFeatures = &*gpuFeatures;
+		deviceCreateInfo.pNext = supportsDescriptorIndexing ? &descriptorIndexing : nullptr;
 
 		device = make_ref(gpu->createDevice(deviceCreateInfo));
+
+		// device level extension functions (drawIndexedIndirectCountKHR)
+		dispatchLoaderDynamic->init(*instance, *device);
 	}
 
 	void VulkanContext::GetGraphicsQueue()
@@ -325,7 +364,7 @@ namespace vm
 
 	void VulkanContext::CreateDescriptorPool(uint32_t maxDescriptorSets)
 	{
-		std::vector<vk::DescriptorPoolSize> descPoolsize(4);
+		std::vector<vk::DescriptorPoolSize> descPoolsize(7);
 		descPoolsize[0].type = vk::DescriptorType::eUniformBuffer;
 		descPoolsize[0].descriptorCount = maxDescriptorSets;
 		descPoolsize[1].type = vk::DescriptorType::eStorageBuffer;
@@ -334,6 +373,12 @@ namespace vm
 		descPoolsize[2].descriptorCount = maxDescriptorSets;
 		descPoolsize[3].type = vk::DescriptorType::eCombinedImageSampler;
 		descPoolsize[3].descriptorCount = maxDescriptorSets;
+		descPoolsize[4].type = vk::DescriptorType::eStorageImage;
+		descPoolsize[4].descriptorCount = maxDescriptorSets;
+		descPoolsize[5].type = vk::DescriptorType::eUniformBufferDynamic;
+		descPoolsize[5].descriptorCount = maxDescriptorSets;
+		descPoolsize[6].type = vk::DescriptorType::eStorageBufferDynamic;
+		descPoolsize[6].descriptorCount = maxDescriptorSets;
 
 		vk::DescriptorPoolCreateInfo createInfo;
 		createInfo.poolSizeCount = static_cast<uint32_t>(descPoolsize.size());
@@ -343,40 +388,33 @@ namespace vm
 		descriptorPool = make_ref(device->createDescriptorPool(createInfo));
 	}
 
-	void VulkanContext::CreateCmdBuffers(uint32_t bufferCount)
+	void VulkanContext::CreateFrames(uint32_t frameCount)
 	{
-		vk::CommandBufferAllocateInfo cbai;
-		cbai.commandPool = *commandPool;
-		cbai.level = vk::CommandBufferLevel::ePrimary;
-		cbai.commandBufferCount = bufferCount;
-		dynamicCmdBuffers = make_ref(device->allocateCommandBuffers(cbai));
-
-		cbai.commandBufferCount = bufferCount * 3;
-		shadowCmdBuffers = make_ref(device->allocateCommandBuffers(cbai));
-	}
+		// the pool of a frame is reset as a whole when the frame comes around again
+		vk::CommandPoolCreateInfo cpci;
+		cpci.queueFamilyIndex = graphicsFamilyId;
+		cpci.flags = vk::CommandPoolCreateFlagBits::eTransient;
 
-	void VulkanContext::CreateFences(uint32_t fenceCount)
-	{
-		std::vector<vk::Fence> _fences(fenceCount);
 		const vk::FenceCreateInfo fi{ vk::FenceCreateFlagBits::eSignaled };
-
-		for (uint32_t i = 0; i < fenceCount; i++) {
-			_fences[i] = device->createFence(fi);
-		}
-
-		fences = make_ref(_fences);
-	}
-
-	void VulkanContext::CreateSemaphores(uint32_t semaphoresCount)
-	{
-		std::vector<vk::Semaphore> _semaphores(semaphoresCount);
 		const vk::SemaphoreCreateInfo si;
 
-		for (uint32_t i = 0; i < semaphoresCount; i++) {
-			_semaphores[i] = device->createSemaphore(si);
+		frames.resize(frameCount);
+		for (auto& frame : frames) {
+			frame.commandPool = make_ref(device->createCommandPool(cpci));
+
+			vk::CommandBufferAllocateInfo cbai;
+			cbai.commandPool = *frame.commandPool;
+			cbai.level = vk::CommandBufferLevel::ePrimary;
+			cbai.commandBufferCount = 2;
+			const auto cmdBuffers = device->allocateCommandBuffers(cbai);
+			frame.shadowCmdBuffer = make_ref(cmdBuffers[0]);
+			frame.dynamicCmdBuffer = make_ref(cmdBuffers[1]);
+
+			frame.acquireSemaphore = make_ref(device->createSemaphore(si));
+			frame.renderSemaphore = make_ref(device->createSemaphore(si));
+			frame.fence = make_ref(device->createFence(fi));
 		}
-
-		semaphores = make_ref(_semaphores);
+		frameIndex = 0;
 	}
 
 	void VulkanContext::CreateDepth()
@@ -415,13 +453,12 @@ namespace vm
 		GetGpu();
 		GetSurfaceProperties(ctx);
 		CreateDevice();
+		MemoryAllocator::get()->Init();
 		GetQueues();
 		CreateCommandPools();
 		CreateSwapchain(ctx, SWAPCHAIN_IMAGES);
 		CreateDescriptorPool(15000); // max number of all descriptor sets to allocate
-		CreateCmdBuffers(SWAPCHAIN_IMAGES);
-		CreateSemaphores(SWAPCHAIN_IMAGES * 3);
-		CreateFences(SWAPCHAIN_IMAGES);
+		CreateFrames(FRAMES_IN_FLIGHT);
 		CreateDepth();
 	}
 
@@ -429,18 +466,13 @@ namespace vm
 	{
 		device->waitIdle();
 
-		for (auto& fence : *fences) {
-			if (fence) {
-				device->destroyFence(fence);
-				fence = nullptr;
-			}
-		}
-		for (auto& semaphore : *semaphores) {
-			if (semaphore) {
-				device->destroySemaphore(semaphore);
-				semaphore = nullptr;
-			}
+		for (auto& frame : frames) {
+			device->destroyFence(*frame.fence);
+			device->destroySemaphore(*frame.acquireSemaphore);
+			device->destroySemaphore(*frame.renderSemaphore);
+			device->destroyCommandPool(*frame.commandPool);
 		}
+		frames.clear();
 
 		depth.destroy();
 
@@ -456,6 +488,9 @@ namespace vm
 
 		swapchain.Destroy();
 
+		MemoryAllocator::get()->destroy();
+		MemoryAllocator::remove();
+
 		if (*device) {
 			device->destroy();
 		}
@@ -498,6 +533,12 @@ namespace vm
 		device->resetFences(fences);
 	}
 
+	void VulkanContext::waitFrame(uint32_t index) const
+	{
+		if (device->waitForFences(*frames[index].fence, VK_TRUE, UINT64_MAX) != vk::Result::eSuccess)
+			throw std::runtime_error("wait fences error!");
+	}
+
 	void VulkanContext::submitAndWaitFence(
 		const vk::ArrayProxy<const vk::CommandBuffer> commandBuffers,
 		const vk::ArrayProxy<const vk::PipelineStageFlags> waitStages,
@@ -64,6 +64,17 @@ namespace vm
 {
 	class Context;
 
+	// One of the frames in flight, its command buffers and sync objects are reused once its fence is signaled
+	struct FrameResources
+	{
+		Ref<vk::CommandPool> commandPool;
+		Ref<vk::CommandBuffer> shadowCmdBuffer;
+		Ref<vk::CommandBuffer> dynamicCmdBuffer;
+		Ref<vk::Semaphore> acquireSemaphore;	// the swapchain image is ready
+		Ref<vk::Semaphore> renderSemaphore;		// the frame is rendered, waited by the presentation
+		Ref<vk::Fence> fence;					// the gpu is done with the frame
+	};
+
 	class VulkanContext
 	{
 	public:
@@ -92,9 +103,7 @@ namespace vm
 		void CreateSwapchain(Context* ctx, uint32_t requestImageCount);
 		void CreateCommandPools();
 		void CreateDescriptorPool(uint32_t maxDescriptorSets);
-		void CreateCmdBuffers(uint32_t bufferCount = 1);
-		void CreateFences(uint32_t fenceCount);
-		void CreateSemaphores(uint32_t semaphoresCount);
+		void CreateFrames(uint32_t frameCount);
 		void CreateDepth();
 		void Init(Context* ctx);
 		void Destroy();
@@ -111,16 +120,17 @@ namespace vm
 		Ref<vk::DescriptorPool> descriptorPool;
 		Ref<vk::DispatchLoaderDynamic> dispatchLoaderDynamic;
 		Ref<std::vector<vk::QueueFamilyProperties>> queueFamilyProperties;
-		Ref<std::vector<vk::CommandBuffer>> dynamicCmdBuffers;
-		Ref<std::vector<vk::CommandBuffer>> shadowCmdBuffers;
-		Ref<std::vector<vk::Fence>> fences;
-		Ref<std::vector<vk::Semaphore>> semaphores;
+		std::vector<FrameResources> frames{};
+		uint32_t frameIndex = 0;	// the frame in the ring that is recorded next
 
 		SDL_Window* window;
 		Surface surface;
 		Swapchain swapchain;
 		Image depth;
 		int graphicsFamilyId, computeFamilyId, transferFamilyId;
+		bool supportsDrawIndirectCount = false;
+		bool supportsViewportIndexLayer = false; // gl_ViewportIndex can be written from the vertex shader
+		bool supportsDescriptorIndexing = false; // partially bound texture arrays, updatable while in use (bindless materials)
 
 		// Helpers
 		void submit(
@@ -130,6 +140,8 @@ namespace vm
 			const vk::ArrayProxy<const vk::Semaphore> signalSemaphores,
 			const vk::Fence signalFence) const;
 		void waitFences(const vk::ArrayProxy<const vk::Fence> fences) const;
+		// waits the last submit of the frame, its fence stays signaled until the frame is submitted again
+		void waitFrame(uint32_t index) const;
 		void submitAndWaitFence(
 			const vk::ArrayProxy<const vk::CommandBuffer> commandBuffers,
 			const vk::ArrayProxy<const vk::PipelineStageFlags> waitStages,
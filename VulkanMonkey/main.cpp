@@ -45,6 +45,12 @@ int main(int argc, char* argv[])
 			interval.Start();
 			GUI::cpuWaitingTime = SECONDS_TO_MILLISECONDS<float>(frame_timer.timestamps[0]);
 			GUI::updatesTime = SECONDS_TO_MILLISECONDS<float>(GUI::updatesTimeCount);
+			GUI::jobTasks = GUI::jobTasksCount;
+			GUI::jobTime = GUI::jobTimeCount;
+			GUI::uploadedKB = GUI::uploadedKBCount;
+			GUI::skippedKB = GUI::skippedKBCount;
+			GUI::flushedKB = GUI::flushedKBCount;
+			GUI::memoryStats = MemoryAllocator::get()->getStats();
 			GUI::cpuTime = static_cast<float>(frame_timer.delta * 1000.0) - GUI::cpuWaitingTime;
 			for (int i = 0; i < GUI::metrics.size(); i++)
 				GUI::stats[i] = GUI::metrics[i];
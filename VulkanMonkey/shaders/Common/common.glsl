@@ -195,5 +195,14 @@ float mip_map_level(vec2 texture_coordinate) // in texel units
     return max( 0, mml);
 }
 
+// ordered 4x4 dither in (0, 1), a surface kept where it is below its coverage and the one replacing it kept
+// elsewhere share the pixels without overlap
+float crossfadeThreshold(vec2 fragCoord)
+{
+	const float bayer[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+	ivec2 p = ivec2(fragCoord) & 3;
+	return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
 
 #endif
\ No newline at end of file
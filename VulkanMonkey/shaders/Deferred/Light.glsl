@@ -29,6 +29,14 @@ layout(set = 2, binding = 1) uniform sampler2DShadow sampler_shadow_map1;
 layout(set = 3, binding = 1) uniform sampler2DShadow sampler_shadow_map2;
 layout(set = 4, binding = 0) uniform samplerCube sampler_cube_map;
 
+// The cascades share one shadow atlas, rect is the offset and scale of a cascade in it. The uv is kept
+// half a texel inside the cascade, so filtering never reads a neighbour.
+vec2 ShadowAtlasUV(vec2 uv, vec4 rect)
+{
+	vec2 half_texel = 0.5 / vec2(textureSize(sampler_shadow_map0, 0));
+	return clamp(rect.xy + uv * rect.zw, rect.xy + half_texel, rect.xy + rect.zw - half_texel);
+}
+
 vec3 compute_point_light(int lightIndex, Material material, vec3 world_pos, vec3 camera_pos, vec3 material_normal, float ssao)
 {
 	vec3 light_dir_full = world_pos - ubo.lights[lightIndex].position.xyz;
@@ -193,7 +201,7 @@ float ComputeScattering(float dir_dot_l)
 	return result;
 }
 
-vec3 VolumetricLighting(Light light, vec3 pos_world, vec2 uv, mat4 lightViewProj, float fog_factor)
+vec3 VolumetricLighting(Light light, vec3 pos_world, vec2 uv, mat4 lightViewProj, vec4 atlasRect, float fog_factor)
 {
 	float iterations = screenSpace.effects1.z; // 32 iterations default
 
@@ -225,7 +233,7 @@ vec3 VolumetricLighting(Light light, vec3 pos_world, vec2 uv, mat4 lightViewProj
 		vec2 ray_uv = pos_light.xy * vec2(0.5f, 0.5f) + 0.5f;
 		
 		// Check to see if the light can "see" the pixel		
-		float depth_delta = texture(sampler_shadow_map1, vec3(ray_uv, pos_light.z)).r;
+		float depth_delta = texture(sampler_shadow_map1, vec3(ShadowAtlasUV(ray_uv, atlasRect), pos_light.z)).r;
 		if (depth_delta > 0.0f)
 		{
 			volumetricFactor += ComputeScattering(dot(ray_dir, normalize(-light.position.xyz)));
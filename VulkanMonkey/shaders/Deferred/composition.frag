@@ -11,6 +11,9 @@ layout (location = 4) in float max_cascade_dist2;
 layout (location = 5) in mat4 shadow_coords0; // small area
 layout (location = 9) in mat4 shadow_coords1; // medium area
 layout (location = 13) in mat4 shadow_coords2; // large area
+layout (location = 17) in vec4 atlas_rect0;
+layout (location = 18) in vec4 atlas_rect1;
+layout (location = 19) in vec4 atlas_rect2;
 
 layout (location = 0) out vec4 outColor;
 
@@ -53,7 +56,7 @@ void main()
 
 			// Volumetric light
 			if (screenSpace.effects1.y > 0.5)
-				outColor.xyz += VolumetricLighting(ubo.lights[0], frag_pos, in_UV, shadow_coords1, fogFactor);
+				outColor.xyz += VolumetricLighting(ubo.lights[0], frag_pos, in_UV, shadow_coords1, atlas_rect1, fogFactor);
 		}
 
 		return;
@@ -129,7 +132,7 @@ void main()
 
 		// Volumetric light
 		if (screenSpace.effects1.y > 0.5)
-			outColor.xyz += VolumetricLighting(ubo.lights[0], frag_pos, in_UV, shadow_coords1, fogFactor);
+			outColor.xyz += VolumetricLighting(ubo.lights[0], frag_pos, in_UV, shadow_coords1, atlas_rect1, fogFactor);
 	}
 }
 
@@ -166,8 +169,8 @@ vec3 directLight(Material material, vec3 world_pos, vec3 camera_pos, vec3 materi
 	if (dist < max_cascade_dist0) {
 		for (int i = 0; i < 4 * cast_shadows; i++) {
 
-			float cascade0 = texture(sampler_shadow_map0, vec3(s_coords0.xy + poissonDisk[i] * 0.0008, s_coords0.z + bias));
-			float cascade1 = texture(sampler_shadow_map1, vec3(s_coords1.xy + poissonDisk[i] * 0.0008, s_coords1.z + bias));
+			float cascade0 = texture(sampler_shadow_map0, vec3(ShadowAtlasUV(s_coords0.xy + poissonDisk[i] * 0.0008, atlas_rect0), s_coords0.z + bias));
+			float cascade1 = texture(sampler_shadow_map1, vec3(ShadowAtlasUV(s_coords1.xy + poissonDisk[i] * 0.0008, atlas_rect1), s_coords1.z + bias));
 			float mix_factor = pow(dist / max_cascade_dist0, power);
 
 			lit += 0.25 * mix(cascade0, cascade1, mix_factor);
@@ -176,8 +179,8 @@ vec3 directLight(Material material, vec3 world_pos, vec3 camera_pos, vec3 materi
 	else if (dist < max_cascade_dist1) {
 		for (int i = 0; i < 4 * cast_shadows; i++) {
 
-			float cascade1 = texture(sampler_shadow_map1, vec3(s_coords1.xy + poissonDisk[i] * 0.0008, s_coords1.z + bias));
-			float cascade2 = texture(sampler_shadow_map2, vec3(s_coords2.xy + poissonDisk[i] * 0.0008, s_coords2.z + bias));
+			float cascade1 = texture(sampler_shadow_map1, vec3(ShadowAtlasUV(s_coords1.xy + poissonDisk[i] * 0.0008, atlas_rect1), s_coords1.z + bias));
+			float cascade2 = texture(sampler_shadow_map2, vec3(ShadowAtlasUV(s_coords2.xy + poissonDisk[i] * 0.0008, atlas_rect2), s_coords2.z + bias));
 			float mix_factor = pow(dist / max_cascade_dist1, power);
 
 			lit += 0.25 * mix(cascade1, cascade2, mix_factor);
@@ -186,7 +189,7 @@ vec3 directLight(Material material, vec3 world_pos, vec3 camera_pos, vec3 materi
 	else {
 		for (int i = 0; i < 4 * cast_shadows; i++) {
 
-			float cascade2 = texture(sampler_shadow_map2, vec3(s_coords2.xy + poissonDisk[i] * 0.0008, s_coords2.z + bias));
+			float cascade2 = texture(sampler_shadow_map2, vec3(ShadowAtlasUV(s_coords2.xy + poissonDisk[i] * 0.0008, atlas_rect2), s_coords2.z + bias));
 
 			lit += 0.25 * cascade2;
 		}
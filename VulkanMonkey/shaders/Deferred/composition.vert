@@ -7,18 +7,21 @@ layout(set = 1, binding = 0) uniform shadow_buffer0 {
 	float max_cascade_dist0;
 	float max_cascade_dist1;
 	float max_cascade_dist2;
+	vec4 atlas_rect;
 }sun0;
 
 layout(set = 2, binding = 0) uniform shadow_buffer1 {
 	mat4 projection;
 	mat4 view;
 	vec4 dummy;
+	vec4 atlas_rect;
 }sun1;
 
 layout(set = 3, binding = 0) uniform shadow_buffer2 {
 	mat4 projection;
 	mat4 view;
 	vec4 dummy;
+	vec4 atlas_rect;
 }sun2;
 
 layout (location = 0) out vec2 out_UV;
@@ -29,6 +32,9 @@ layout (location = 4) out float max_cascade_dist2;
 layout (location = 5) out mat4 shadow_coords0; // small area
 layout (location = 9) out mat4 shadow_coords1; // medium area
 layout (location = 13) out mat4 shadow_coords2; // large area
+layout (location = 17) out vec4 atlas_rect0;
+layout (location = 18) out vec4 atlas_rect1;
+layout (location = 19) out vec4 atlas_rect2;
 
 out gl_PerVertex
 {
@@ -43,6 +49,9 @@ void main()
 	shadow_coords0 = sun0.projection * sun0.view;
 	shadow_coords1 = sun1.projection * sun1.view;
 	shadow_coords2 = sun2.projection * sun2.view;
+	atlas_rect0 = sun0.atlas_rect;
+	atlas_rect1 = sun1.atlas_rect;
+	atlas_rect2 = sun2.atlas_rect;
 	cast_shadows = sun0.cast_shadows;
 	max_cascade_dist0 = sun0.max_cascade_dist0;
 	max_cascade_dist1 = sun0.max_cascade_dist1;
@@ -1,13 +1,28 @@
 #version 450
 #extension GL_GOOGLE_include_directive : require
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 #include "../Common/common.glsl"
 
+#ifdef BINDLESS
+// the indices come from the material of the draw, they are the same for all its fragments
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+layout (location = 9) flat in uvec4 inTextures;
+layout (location = 10) flat in uint inEmissiveTexture;
+#define bcSampler textures[inTextures.x]
+#define mrSampler textures[inTextures.y]
+#define nSampler textures[inTextures.z]
+#define oSampler textures[inTextures.w]
+#define eSampler textures[inEmissiveTexture]
+#else
 layout (set = 1, binding = 0) uniform sampler2D bcSampler; // BaseColor
 layout (set = 1, binding = 1) uniform sampler2D mrSampler; // MetallicRoughness
 layout (set = 1, binding = 2) uniform sampler2D nSampler;  // Normal
 layout (set = 1, binding = 3) uniform sampler2D oSampler;  // Occlusion
 layout (set = 1, binding = 4) uniform sampler2D eSampler;  // Emissive
+#endif
 
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in vec3 inNormal;
@@ -18,6 +33,7 @@ layout (location = 5) in vec4 metRoughAlphacutOcl;
 layout (location = 6) in vec4 posProj;
 layout (location = 7) in vec4 posLastProj;
 layout (location = 8) in vec4 inWorldPos;
+layout (location = 11) flat in float inCoverage;
 
 layout (location = 0) out float outDepth;
 layout (location = 1) out vec3 outNormal;
@@ -27,6 +43,7 @@ layout (location = 4) out vec2 outVelocity;
 layout (location = 5) out vec4 outEmissive;
 
 void main() {
+	if (crossfadeThreshold(gl_FragCoord.xy) >= inCoverage) discard; // the impostor of the model draws these pixels
 	vec4 basicColor = texture(bcSampler, inUV) + inColor; 
 	if (basicColor.a < metRoughAlphacutOcl.z) discard; // needed because alpha blending is messed up when objects are not in order
 	vec3 metRough = texture(mrSampler, inUV).xyz;
@@ -10,24 +10,47 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
 	float dummy[3];
 } uboMesh;
 
-layout(set = 1, binding = 5) uniform UniformBufferObject2 {
+struct Material {
 	vec4 baseColorFactor;
 	vec4 emissiveFactor;
-	float metallicFactor;
-	float roughnessFactor;
-	float alphaCutoff;
-	float occlusionlMetalRoughness;
+	vec4 factors; // metallic, roughness, alpha cutoff, occlusion
+	uint textures[5]; // base color, metallic roughness, normal, occlusion, emissive
 	float hasBones;
-	float dummy[3];
-} uboPrimitive;
+	float dummy[2];
+};
 
-layout(set = 2, binding = 0) uniform UniformBufferObject3 {
-	mat4 matrix;
+// the material table
+#ifdef BINDLESS
+layout(std430, set = 1, binding = 1) readonly buffer Materials {
+#else
+layout(std430, set = 1, binding = 5) readonly buffer Materials {
+#endif
+	Material materials[];
+};
+
+layout(push_constant) uniform Push {
+	uint material;
+	uint model; // slot of the model in the transforms, the instances follow it
+	float coverage; // share of the pixels the meshes keep, the impostor of the model draws the rest
+} push;
+
+// the frame constants, bound once per pass
+layout(set = 2, binding = 0) uniform UniformBufferView {
 	mat4 view;
 	mat4 projection;
-	mat4 previousMatrix;
 	mat4 previousView;
-} uboModel;
+	mat4 previousProjection;
+	vec4 jitter; // xy: current, zw: previous
+} uboView;
+
+struct Transform {
+	mat4 matrix;
+	mat4 previousMatrix;
+};
+
+layout(std430, set = 2, binding = 1) readonly buffer Transforms {
+	Transform transforms[];
+};
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inTexCoords;
@@ -45,6 +68,11 @@ layout (location = 5) out vec4 metRoughAlphacutOcl;
 layout (location = 6) out vec4 posProj;
 layout (location = 7) out vec4 posLastProj;
 layout (location = 8) out vec4 outWorldPos;
+#ifdef BINDLESS
+layout (location = 9) flat out uvec4 outTextures;
+layout (location = 10) flat out uint outEmissiveTexture;
+#endif
+layout (location = 11) flat out float outCoverage;
 
 void main() 
 {
@@ -58,8 +86,9 @@ void main()
 	}
 	
 	vec4 inPos = vec4(inPosition, 1.0f);
+	Transform model = transforms[push.model + gl_InstanceIndex];
 	
-	mat3 mNormal = transpose(inverse(mat3(uboModel.matrix * uboMesh.matrix * boneTransform)));
+	mat3 mNormal = transpose(inverse(mat3(model.matrix * uboMesh.matrix * boneTransform)));
 	
 	// UV
 	outUV = inTexCoords;
@@ -71,19 +100,25 @@ void main()
 	outColor = inColor;
 
 	// Factors
-	baseColorFactor = uboPrimitive.baseColorFactor;
-	emissiveFactor = uboPrimitive.emissiveFactor.xyz;
-	metRoughAlphacutOcl = vec4(uboPrimitive.metallicFactor, uboPrimitive.roughnessFactor, uboPrimitive.alphaCutoff, uboPrimitive.occlusionlMetalRoughness);
+	Material material = materials[push.material];
+	baseColorFactor = material.baseColorFactor;
+	emissiveFactor = material.emissiveFactor.xyz;
+	metRoughAlphacutOcl = material.factors;
+#ifdef BINDLESS
+	outTextures = uvec4(material.textures[0], material.textures[1], material.textures[2], material.textures[3]);
+	outEmissiveTexture = material.textures[4];
+#endif
+	outCoverage = push.coverage;
 
 	// Velocity
-	mat4 projectionNoJitter = uboModel.projection;
+	mat4 projectionNoJitter = uboView.projection;
 	projectionNoJitter[2][0] = 0.0;
 	projectionNoJitter[2][1] = 0.0;
-	posProj = projectionNoJitter * uboModel.view * uboModel.matrix * uboMesh.matrix * inPos; // clip space
-	posLastProj = projectionNoJitter * uboModel.previousView * uboModel.previousMatrix * uboMesh.previousMatrix * inPos; // clip space
+	posProj = projectionNoJitter * uboView.view * model.matrix * uboMesh.matrix * inPos; // clip space
+	posLastProj = projectionNoJitter * uboView.previousView * model.previousMatrix * uboMesh.previousMatrix * inPos; // clip space
 
 	// WorldPos
-	outWorldPos = uboModel.matrix * uboMesh.matrix * boneTransform * inPos;
+	outWorldPos = model.matrix * uboMesh.matrix * boneTransform * inPos;
 
-	gl_Position = uboModel.projection * uboModel.view * outWorldPos;
+	gl_Position = uboView.projection * uboView.view * outWorldPos;
 }
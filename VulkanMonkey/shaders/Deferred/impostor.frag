@@ -0,0 +1,46 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "../Common/common.glsl"
+
+// the atlases of the model, written by the G-buffer shaders
+layout (set = 0, binding = 0) uniform sampler2D albedoSampler;
+layout (set = 0, binding = 1) uniform sampler2D normalSampler;
+layout (set = 0, binding = 2) uniform sampler2D depthSampler;
+layout (set = 0, binding = 3) uniform sampler2D srmSampler;
+layout (set = 0, binding = 4) uniform sampler2D emissiveSampler;
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec4 posProj;
+layout (location = 2) flat in vec4 depthProj;
+layout (location = 3) in vec4 posLastProj;
+layout (location = 4) flat in vec4 depthLastProj;
+layout (location = 5) flat in mat3 inNormalMatrix;
+layout (location = 8) flat in float inBlend;
+
+layout (location = 0) out float outDepth;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec4 outAlbedo;
+layout (location = 3) out vec3 outMetRough;
+layout (location = 4) out vec2 outVelocity;
+layout (location = 5) out vec4 outEmissive;
+
+void main() {
+	// the texels the model does not cover keep the cleared depth
+	float depth = texture(depthSampler, inUV).r;
+	if (depth <= 0.0) discard;
+	if (crossfadeThreshold(gl_FragCoord.xy) < 1.0 - inBlend) discard; // the meshes of the model draw these pixels
+
+	// the baked depth is 0 at the back of the sphere, 0.5 at the quad and 1 at the front
+	float offset = depth * 2.0 - 1.0;
+	vec4 pos = posProj + depthProj * offset;
+	vec4 lastPos = posLastProj + depthLastProj * offset;
+	gl_FragDepth = pos.z / pos.w;
+
+	outDepth = gl_FragDepth;
+	outNormal = normalize(inNormalMatrix * texture(normalSampler, inUV).xyz);
+	outAlbedo = texture(albedoSampler, inUV);
+	outMetRough = texture(srmSampler, inUV).xyz;
+	outVelocity = (pos.xy / pos.w - lastPos.xy / lastPos.w) * vec2(0.5, 0.5); // ndc space
+	outEmissive = vec4(texture(emissiveSampler, inUV).xyz, 0.0);
+}
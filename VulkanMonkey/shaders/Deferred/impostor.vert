@@ -0,0 +1,98 @@
+#version 450
+
+// the frame constants, bound once per pass
+layout(set = 1, binding = 0) uniform UniformBufferView {
+	mat4 view;
+	mat4 projection;
+	mat4 previousView;
+	mat4 previousProjection;
+	vec4 jitter; // xy: current, zw: previous
+} uboView;
+
+struct Transform {
+	mat4 matrix;
+	mat4 previousMatrix;
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer Transforms {
+	Transform transforms[];
+};
+
+layout(push_constant) uniform Push {
+	vec4 sphere; // model space bounding sphere the views were rendered around
+	uint model; // slot of the model in the transforms
+	float blend; // share of the pixels the impostor draws, the meshes keep the rest
+} push;
+
+const uint GRID = 8; // views per side of the octahedral map (Impostors::GRID)
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 posProj;
+layout (location = 2) flat out vec4 depthProj; // clip space offset of a baked depth from the quad to the front of the sphere
+layout (location = 3) out vec4 posLastProj;
+layout (location = 4) flat out vec4 depthLastProj;
+layout (location = 5) flat out mat3 outNormalMatrix;
+layout (location = 8) flat out float outBlend;
+
+// octahedral map with y up
+vec2 octEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 p = n.xz;
+	if (n.y < 0.0)
+		p = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+	return p * 0.5 + 0.5;
+}
+
+vec3 octDecode(vec2 uv)
+{
+	vec2 f = uv * 2.0 - 1.0;
+	vec3 n = vec3(f.x, 1.0 - abs(f.x) - abs(f.y), f.y);
+	float t = max(-n.y, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.z += n.z >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+const vec2 corners[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main()
+{
+	Transform model = transforms[push.model];
+	vec3 center = push.sphere.xyz;
+	float radius = push.sphere.w;
+
+	// the direction of the camera in model space picks the cell, the view baked closest to it
+	vec3 eye = (inverse(model.matrix) * vec4(inverse(uboView.view)[3].xyz, 1.0)).xyz;
+	ivec2 cell = clamp(ivec2(octEncode(normalize(eye - center)) * float(GRID)), ivec2(0), ivec2(GRID - 1));
+	vec3 direction = octDecode((vec2(cell) + 0.5) / float(GRID));
+	vec3 reference = abs(direction.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+	vec3 right = normalize(cross(reference, direction));
+	vec3 up = cross(direction, right);
+
+	// the quad covers the sphere on the plane of its center the cell was rendered across
+	vec2 corner = corners[gl_VertexIndex];
+	vec4 inPos = vec4(center + (right * corner.x + up * corner.y) * radius, 1.0);
+	vec4 inDepth = vec4(direction * radius, 0.0);
+
+	// UV
+	outUV = (vec2(cell) + vec2(0.5 + 0.5 * corner.x, 0.5 - 0.5 * corner.y)) / float(GRID);
+
+	// Velocity and depth, the fragments move the quad point along the view direction to the baked surface
+	mat4 projectionNoJitter = uboView.projection;
+	projectionNoJitter[2][0] = 0.0;
+	projectionNoJitter[2][1] = 0.0;
+	mat4 viewProjection = projectionNoJitter * uboView.view * model.matrix;
+	mat4 previousViewProjection = projectionNoJitter * uboView.previousView * model.previousMatrix;
+	posProj = viewProjection * inPos; // clip space
+	depthProj = viewProjection * inDepth;
+	posLastProj = previousViewProjection * inPos; // clip space
+	depthLastProj = previousViewProjection * inDepth;
+
+	// Normal, the baked ones are in model space
+	outNormalMatrix = mat3(model.matrix);
+
+	outBlend = push.blend;
+
+	gl_Position = uboView.projection * uboView.view * model.matrix * inPos;
+}
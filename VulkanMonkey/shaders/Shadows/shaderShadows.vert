@@ -23,10 +23,19 @@ layout( set = 1, binding = 0 ) uniform UniformBuffer1 {
 	float dummy[3];
 }mesh;
 
-layout( set = 2, binding = 0 ) uniform UniformBuffer2 {	
+layout(push_constant) uniform Constants {
+	uint model; // slot of the model in the transforms, the instances follow it
+}constants;
+
+struct Transform {
 	mat4 matrix;
-	mat4 dummy[3];
-}model;
+	mat4 previousMatrix;
+};
+
+// the model matrices of the frame constants
+layout(std430, set = 2, binding = 1) readonly buffer Transforms {
+	Transform transforms[];
+};
 
 void main() {
 	mat4 boneTransform = mat4(1.0);
@@ -38,5 +47,5 @@ void main() {
 		inWeights[3] * mesh.jointMatrix[inJoint[3]]; 
 	}
 
-	gl_Position = ubo.projection * ubo.lightView * model.matrix * mesh.matrix * boneTransform * vec4(inPosition, 1.0);
+	gl_Position = ubo.projection * ubo.lightView * transforms[constants.model + gl_InstanceIndex].matrix * mesh.matrix * boneTransform * vec4(inPosition, 1.0);
 }
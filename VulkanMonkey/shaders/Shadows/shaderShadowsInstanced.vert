@@ -0,0 +1,63 @@
+#version 450
+#extension GL_ARB_shader_viewport_layer_array : require
+
+const int MAX_NUM_JOINTS = 128;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoords;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in vec4 inColor;
+layout(location = 4) in ivec4 inJoint;
+layout(location = 5) in vec4 inWeights;
+
+layout(push_constant) uniform Constants {
+	uint cascadeMask; // one bit per cascade this draw is rendered in
+	uint model; // slot of the model in the transforms
+	uint instances; // instances of the model, each cascade draws all of them
+}constants;
+
+layout( set = 0, binding = 0 ) uniform UniformBuffer0 {
+	mat4 viewProjection[3];
+}cascades;
+
+layout( set = 1, binding = 0 ) uniform UniformBuffer1 {	
+	mat4 matrix;
+	mat4 previousMatrix;
+	mat4 jointMatrix[MAX_NUM_JOINTS];
+	float jointCount;
+	float dummy[3];
+}mesh;
+
+struct Transform {
+	mat4 matrix;
+	mat4 previousMatrix;
+};
+
+// the model matrices of the frame constants
+layout(std430, set = 2, binding = 1) readonly buffer Transforms {
+	Transform transforms[];
+};
+
+void main() {
+	// every run of the model instances goes to the next cascade of the mask, each cascade has its own viewport in the atlas
+	int cascade = 0;
+	for (int n = gl_InstanceIndex / int(constants.instances); cascade < 3; cascade++) {
+		if ((constants.cascadeMask & (1u << cascade)) != 0u) {
+			if (n == 0)
+				break;
+			n--;
+		}
+	}
+	gl_ViewportIndex = cascade;
+
+	mat4 boneTransform = mat4(1.0);
+	if (mesh.jointCount > 0.0){
+		boneTransform  = 
+		inWeights[0] * mesh.jointMatrix[inJoint[0]] + 
+		inWeights[1] * mesh.jointMatrix[inJoint[1]] + 
+		inWeights[2] * mesh.jointMatrix[inJoint[2]] + 
+		inWeights[3] * mesh.jointMatrix[inJoint[3]]; 
+	}
+
+	gl_Position = cascades.viewProjection[cascade] * transforms[constants.model + gl_InstanceIndex % int(constants.instances)].matrix * mesh.matrix * boneTransform * vec4(inPosition, 1.0);
+}
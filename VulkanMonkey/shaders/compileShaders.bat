@@ -20,4 +20,6 @@ glslangValidator.exe -V Bloom/gaussianBlurHorizontal.frag -o Bloom/fragGaussianB
 glslangValidator.exe -V Bloom/gaussianBlurVertical.frag -o Bloom/fragGaussianBlurVertical.spv
 glslangValidator.exe -V Bloom/combine.frag -o Bloom/fragCombine.spv
 glslangValidator.exe -V MotionBlur/motionBlur.frag -o MotionBlur/frag.spv
-glslangValidator.exe -V DepthOfField/DOF.frag -o DepthOfField/frag.spv
\ No newline at end of file
+glslangValidator.exe -V DepthOfField/DOF.frag -o DepthOfField/frag.spv
+glslangValidator.exe -V Culling/cull.comp -o Culling/cull.spv
+glslangValidator.exe -V Culling/depthPyramid.comp -o Culling/depthPyramid.spv
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "Test.h"
+#include "Culling/FrustumCulling.h"
+#include <random>
+
+using namespace vm;
+
+namespace
+{
+	// planes with random orientations around the origin, and bounds scattered over them so every plane culls some
+	void randomScene(std::mt19937& random, size_t count, CullingBounds& bounds, Camera::Plane* planes, uint32_t planeCount)
+	{
+		std::uniform_real_distribution<float> unit(-1.f, 1.f);
+		for (uint32_t p = 0; p < planeCount; p++) {
+			vec3 normal(unit(random), unit(random), unit(random));
+			if (length(normal) < 1e-3f)
+				normal = vec3(0.f, 1.f, 0.f);
+			planes[p].normal = normalize(normal);
+			planes[p].d = 8.f + 4.f * unit(random);
+		}
+
+		bounds.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			const vec3 center(16.f * unit(random), 16.f * unit(random), 16.f * unit(random));
+			const vec3 extents(1.f + unit(random), 1.f + unit(random), 1.f + unit(random));
+			// the sphere encloses the box, like the bounds the models compute
+			bounds.set(i, vec4(center, length(extents)), center, extents);
+		}
+	}
+}
+
+TEST(FrustumCullingScalarMatchesAVX2)
+{
+	if (!FrustumCulling::HasAVX2()) {
+		std::printf("  no AVX2 on this cpu, skipped\n");
+		return;
+	}
+
+	std::mt19937 random(1234);
+	// counts around the batches of 8, the padded tail lanes must never be reported as visible
+	const size_t counts[] = { 1, 7, 8, 9, 15, 16, 17, 63, 100, 1001 };
+	for (size_t count : counts) {
+		for (uint32_t planeCount : { 4u, 6u }) {
+			CullingBounds bounds;
+			Camera::Plane planes[6];
+			randomScene(random, count, bounds, planes, planeCount);
+
+			VisibilityBitset scalar, avx2;
+			FrustumCulling::CullScalar(bounds, planes, planeCount, scalar);
+			FrustumCulling::CullAVX2(bounds, planes, planeCount, avx2);
+
+			CHECK(scalar.size() == count);
+			CHECK(avx2.size() == count);
+			CHECK(scalar.bytes == avx2.bytes);
+			CHECK(scalar.visibleCount() == avx2.visibleCount());
+			for (size_t i = 0; i < count; i++)
+				CHECK(scalar.test(i) == avx2.test(i));
+
+			// the bits past the count in the last byte stay clear
+			if (count % 8) {
+				const uint8_t tail = static_cast<uint8_t>(0xFF << (count % 8));
+				CHECK((scalar.bytes.back() & tail) == 0);
+				CHECK((avx2.bytes.back() & tail) == 0);
+			}
+		}
+	}
+}
+
+TEST(FrustumCullingScenesAreMixed)
+{
+	// the comparison above only means something if the scenes have both visible and culled bounds
+	std::mt19937 random(1234);
+	CullingBounds bounds;
+	Camera::Plane planes[6];
+	randomScene(random, 1001, bounds, planes, 6);
+
+	VisibilityBitset visibility;
+	FrustumCulling::CullScalar(bounds, planes, 6, visibility);
+	CHECK(visibility.visibleCount() > 0);
+	CHECK(visibility.visibleCount() < 1001);
+}
@@ -0,0 +1,60 @@
+#include "Test.h"
+#include "Culling/OcclusionCulling.h"
+
+using namespace vm;
+
+namespace
+{
+	// clip = (x, y, 0, z), a camera at the origin looking down +z with a 90 degree field of view
+	const mat4 projection(
+		vec4(1.f, 0.f, 0.f, 0.f),
+		vec4(0.f, 1.f, 0.f, 0.f),
+		vec4(0.f, 0.f, 0.f, 1.f),
+		vec4(0.f, 0.f, 0.f, 0.f));
+
+	// a 4x4 quad facing the camera at z = 5, covering the middle of the screen
+	void rasterizeWall(OcclusionCulling& occlusion)
+	{
+		occlusion.Init(64, 64);
+		occlusion.nearClip = 0.1f;
+
+		Vertex vertices[4];
+		vertices[0].position = vec3(-2.f, -2.f, 5.f);
+		vertices[1].position = vec3(2.f, -2.f, 5.f);
+		vertices[2].position = vec3(2.f, 2.f, 5.f);
+		vertices[3].position = vec3(-2.f, 2.f, 5.f);
+		const uint32_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+		occlusion.AddOccluder(projection, vertices, indices, 6);
+		// the whole screen as one band, without the job system
+		occlusion.RasterizeBand(0, occlusion.height);
+	}
+}
+
+TEST(OcclusionCullingHidesBoxBehindOccluder)
+{
+	OcclusionCulling occlusion;
+	rasterizeWall(occlusion);
+
+	CHECK(!occlusion.TestAABB(projection, vec3(0.f, 0.f, 10.f), vec3(.5f)));
+	CHECK(!occlusion.TestAABB(projection, vec3(1.f, -1.f, 20.f), vec3(1.f)));
+}
+
+TEST(OcclusionCullingKeepsBoxBesideOccluder)
+{
+	OcclusionCulling occlusion;
+	rasterizeWall(occlusion);
+
+	CHECK(occlusion.TestAABB(projection, vec3(8.f, 0.f, 10.f), vec3(.5f)));
+	// partly behind the edge of the wall
+	CHECK(occlusion.TestAABB(projection, vec3(4.f, 0.f, 10.f), vec3(.5f)));
+}
+
+TEST(OcclusionCullingKeepsBoxInFrontOfOccluder)
+{
+	OcclusionCulling occlusion;
+	rasterizeWall(occlusion);
+
+	CHECK(occlusion.TestAABB(projection, vec3(0.f, 0.f, 3.f), vec3(.5f)));
+	// flat on the wall, touching an occluder does not hide it
+	CHECK(occlusion.TestAABB(projection, vec3(0.f, 0.f, 5.f), vec3(1.f, 1.f, 0.f)));
+}
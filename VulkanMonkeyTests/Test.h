@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+namespace vm
+{
+	namespace test
+	{
+		// A test registers itself at static initialization, main runs them all in the order they were registered
+		struct TestCase
+		{
+			const char* name;
+			void(*func)();
+		};
+
+		std::vector<TestCase>& registry();
+		extern int failures;
+
+		struct Register
+		{
+			Register(const char* name, void(*func)()) { registry().push_back({ name, func }); }
+		};
+	}
+}
+
+#define TEST(name) \
+	static void name(); \
+	static vm::test::Register name##_register(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			vm::test::failures++; \
+		} \
+	} while (0)
@@ -0,0 +1,30 @@
+#include "Test.h"
+
+namespace vm
+{
+	namespace test
+	{
+		std::vector<TestCase>& registry()
+		{
+			static std::vector<TestCase> tests{};
+			return tests;
+		}
+
+		int failures = 0;
+	}
+}
+
+// Headless tests of the engine code that runs without a device, the exit code is the number of failed tests
+int main()
+{
+	int failedTests = 0;
+	for (auto& test : vm::test::registry()) {
+		const int before = vm::test::failures;
+		test.func();
+		const bool passed = vm::test::failures == before;
+		std::printf("[%s] %s\n", passed ? "PASS" : "FAIL", test.name);
+		failedTests += passed ? 0 : 1;
+	}
+	std::printf("%d of %d tests failed\n", failedTests, static_cast<int>(vm::test::registry().size()));
+	return failedTests;
+}